@@ -0,0 +1,41 @@
+#ifndef LCL_BENCH_H
+#define LCL_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// monotonic time in nanoseconds
+static inline uint64_t bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// small deterministic generator, so runs are comparable
+static inline uint32_t bench_rand(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static int bench_compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static inline void bench_sort(uint64_t *samples, size_t n) {
+    qsort(samples, n, sizeof(uint64_t), bench_compare);
+}
+
+// returns the given percentile (0-100) of sorted samples
+static inline uint64_t bench_percentile(uint64_t *samples, size_t n, double p) {
+    if (n == 0) return 0;
+    size_t i = (size_t)(p / 100.0 * (double)(n - 1) + 0.5);
+    return samples[i < n ? i : n - 1];
+}
+
+#endif /* LCL_BENCH_H */
@@ -0,0 +1,170 @@
+#include <lualib.h>
+#include <luaclasslib.h>
+#include <math.h>
+
+#include "bench.h"
+#include "classes/points.h"
+
+// generated versus hand-written classes. HandPoint is written the way the
+// classes in tests/classes are, with getters and setters as methods that check
+// their argument with luaC_checkuclass, while Point is generated by lclgen
+// from tests/schemas/point.lua. both are driven from Lua.
+//
+// usage: bench_codegen [iterations]
+// results are written to stdout as JSON.
+
+typedef struct {
+    lua_Number  x, y;
+    lua_Integer hits;
+} hand_point;
+
+#define HAND_CHECK(L) \
+    ((hand_point *)luaC_checkuclass((L), 1, "lcltests.HandPoint"))
+
+static int hand_init(lua_State *L) {
+    hand_point *p = HAND_CHECK(L);
+    p->x          = luaL_optnumber(L, 2, 0);
+    p->y          = luaL_optnumber(L, 3, 0);
+    return 0;
+}
+
+static int hand_getx(lua_State *L) {
+    lua_pushnumber(L, HAND_CHECK(L)->x);
+    return 1;
+}
+
+static int hand_setx(lua_State *L) {
+    HAND_CHECK(L)->x = luaL_checknumber(L, 2);
+    return 0;
+}
+
+static int hand_length(lua_State *L) {
+    hand_point *p = HAND_CHECK(L);
+    lua_pushnumber(L, sqrt(p->x * p->x + p->y * p->y));
+    return 1;
+}
+
+static int hand_scale(lua_State *L) {
+    hand_point *p = HAND_CHECK(L);
+    lua_Number  k = luaL_checknumber(L, 2);
+    p->x         *= k;
+    p->y         *= k;
+    p->hits++;
+    return 0;
+}
+
+static luaL_Reg hand_methods[] = {
+    {"new",    hand_init  },
+    {"getx",   hand_getx  },
+    {"setx",   hand_setx  },
+    {"length", hand_length},
+    {"scale",  hand_scale },
+    {NULL,     NULL       }
+};
+
+static luaC_Class hand_point_class = {
+    .name      = "HandPoint",
+    .parent    = NULL,
+    .user_ctor = 1,
+    .alloc     = NULL,
+    .gc        = NULL,
+    .methods   = hand_methods,
+    .flags     = LUAC_ZEROINIT,
+    .size      = sizeof(hand_point),
+    .nuv       = 1};
+
+typedef struct {
+    const char *name;
+    const char *hand;  // loop body for HandPoint
+    const char *gen;   // loop body for Point
+} operation;
+
+static const operation operations[] = {
+    {"method call", "p:length()",         "p:length()"   },
+    {"field read",  "local x = p:getx()", "local x = p.x"},
+    {"field write", "p:setx(i)",          "p.x = i"      },
+    {"mutation",    "p:scale(1)",         "p:scale(1)"   },
+};
+
+// constructors of the two classes, as Lua expressions
+static const char *hand_new = "require('lcltests').HandPoint(3, 4)";
+static const char *gen_new  = "require('lcltests').Point{x = 3, y = 4}";
+
+static void register_class(lua_State *L, const char *name) {
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    luaL_getsubtable(L, -1, "lcltests");
+    lua_insert(L, -3);
+    lua_pop(L, 1);  // pop package.loaded
+    lua_setfield(L, -2, name);
+    lua_pop(L, 1);  // pop module table
+}
+
+// times *n* iterations of *body* with p bound to the result of *ctor*
+static double time_loop(
+    lua_State  *L,
+    const char *ctor,
+    const char *body,
+    int         n) {
+    char chunk[512];
+    snprintf(
+        chunk,
+        sizeof(chunk),
+        "local p, n = %s, ...\n"
+        "for i = 1, n do %s end\n",
+        ctor,
+        body);
+
+    if (luaL_loadstring(L, chunk) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        exit(1);
+    }
+
+    lua_pushinteger(L, n);
+    uint64_t t = bench_now();
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        exit(1);
+    }
+    return (double)(bench_now() - t) / n;
+}
+
+int main(int argc, char **argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    if (n <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+
+    lua_pushlightuserdata(L, &hand_point_class);
+    luaC_classfromptr(L);
+    register_class(L, "HandPoint");
+    point_register(L);
+    register_class(L, "Point");
+
+    printf(
+        "{\n  \"benchmark\": \"codegen\",\n  \"iterations\": %d,\n"
+        "  \"results\": [\n",
+        n);
+
+    for (size_t i = 0; i < sizeof(operations) / sizeof(*operations); i++) {
+        const operation *op   = &operations[i];
+        double           hand = time_loop(L, hand_new, op->hand, n);
+        double           gen  = time_loop(L, gen_new, op->gen, n);
+        printf(
+            "%s    {\"operation\": \"%s\", \"hand_ns\": %.1f, "
+            "\"generated_ns\": %.1f, \"speedup\": %.2f}",
+            i ? ",\n" : "",
+            op->name,
+            hand,
+            gen,
+            hand / gen);
+    }
+
+    printf("\n  ]\n}\n");
+    lua_close(L);
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include <lualib.h>
+#include <luaclasslib.h>
+
+#include "bench.h"
+
+// multiple dispatch benchmark. selects a rule for random pairs of objects from
+// a small class heirarchy and calls it, once by testing the rules in order with
+// luaC_isinstance, as a hand-written rules engine would, and once through a
+// generic function.
+//
+// usage: bench_dispatch [calls]
+// results are written to stdout as JSON.
+
+#define OBJECTS 1024
+
+static const char *const classes[][2] = {
+    {"Entity",   NULL               },
+    {"Ship",     "lcltests.Entity"  },
+    {"Station",  "lcltests.Ship"    },
+    {"Asteroid", "lcltests.Entity"  },
+    {"Comet",    "lcltests.Asteroid"},
+};
+
+// the rules, most specific first
+static const char *const rules[][2] = {
+    {"lcltests.Station",  "lcltests.Comet"   },
+    {"lcltests.Ship",     "lcltests.Comet"   },
+    {"lcltests.Ship",     "lcltests.Asteroid"},
+    {"lcltests.Asteroid", "lcltests.Ship"    },
+    {"lcltests.Asteroid", "lcltests.Entity"  },
+    {"lcltests.Entity",   "lcltests.Entity"  },
+};
+
+#define NCLASSES (sizeof(classes) / sizeof(*classes))
+#define NRULES   (sizeof(rules) / sizeof(*rules))
+
+static luaL_Reg no_methods[] = {
+    {NULL, NULL}
+};
+
+static void register_class(lua_State *L, const char *name) {
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    luaL_getsubtable(L, -1, "lcltests");
+    lua_insert(L, -3);
+    lua_pop(L, 1);  // pop package.loaded
+    lua_setfield(L, -2, name);
+    lua_pop(L, 1);  // pop module table
+}
+
+// returns the number of its rule
+static int rule(lua_State *L) {
+    lua_pushvalue(L, lua_upvalueindex(1));
+    return 1;
+}
+
+// the index of the first rule matching the objects at *a* and *b*, or -1
+static int select_rule(lua_State *L, int a, int b) {
+    for (size_t r = 0; r < NRULES; r++)
+        if (luaC_isinstance(L, a, rules[r][0]) &&
+            luaC_isinstance(L, b, rules[r][1]))
+            return (int)r;
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    int calls = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    if (calls <= 0) {
+        fprintf(stderr, "usage: %s [calls]\n", argv[0]);
+        return 1;
+    }
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+
+    for (size_t c = 0; c < NCLASSES; c++) {
+        luaC_newclass(L, classes[c][0], classes[c][1], no_methods);
+        register_class(L, classes[c][0]);
+    }
+
+    // 1: rule functions, 2: generic function, 3: objects
+    lua_createtable(L, NRULES, 0);
+    luaC_newgeneric(L, "collide", 2);
+    for (size_t r = 0; r < NRULES; r++) {
+        lua_pushinteger(L, (lua_Integer)r);
+        lua_pushcclosure(L, rule, 1);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, 1, (lua_Integer)r + 1);
+        lua_pushstring(L, rules[r][0]);
+        lua_pushstring(L, rules[r][1]);
+        lua_rotate(L, -3, 2);  // move the classes below the function
+        luaC_defmethod(L, 2);
+    }
+
+    uint32_t seed = 12345;
+    lua_createtable(L, OBJECTS, 0);
+    for (int i = 1; i <= OBJECTS; i++) {
+        char name[32];
+        snprintf(
+            name,
+            sizeof(name),
+            "lcltests.%s",
+            classes[bench_rand(&seed) % NCLASSES][0]);
+        luaC_construct(L, 0, name);
+        lua_rawseti(L, 3, i);
+    }
+
+    int     *pairs = malloc(2 * calls * sizeof(int));
+    uint64_t sums[2] = {0, 0}, times[2];
+    for (int i = 0; i < 2 * calls; i++)
+        pairs[i] = bench_rand(&seed) % OBJECTS + 1;
+
+    // rules tested in order
+    uint64_t t = bench_now();
+    for (int i = 0; i < calls; i++) {
+        lua_rawgeti(L, 3, pairs[2 * i]);
+        lua_rawgeti(L, 3, pairs[2 * i + 1]);
+        int r = select_rule(L, -2, -1);
+        lua_rawgeti(L, 1, r + 1);
+        lua_rotate(L, -3, 1);  // move the rule below the objects
+        lua_call(L, 2, 1);
+        sums[0] += lua_tointeger(L, -1);
+        lua_pop(L, 1);
+    }
+    times[0] = bench_now() - t;
+
+    // generic function
+    t = bench_now();
+    for (int i = 0; i < calls; i++) {
+        lua_pushvalue(L, 2);
+        lua_rawgeti(L, 3, pairs[2 * i]);
+        lua_rawgeti(L, 3, pairs[2 * i + 1]);
+        lua_call(L, 2, 1);
+        sums[1] += lua_tointeger(L, -1);
+        lua_pop(L, 1);
+    }
+    times[1] = bench_now() - t;
+
+    if (sums[0] != sums[1]) {
+        fprintf(stderr, "dispatch results differ\n");
+        return 1;
+    }
+
+    printf(
+        "{\n  \"benchmark\": \"dispatch\",\n  \"calls\": %d,\n"
+        "  \"rules\": %d,\n  \"results\": [\n"
+        "    {\"dispatch\": \"isinstance\", \"ns_per_call\": %.1f},\n"
+        "    {\"dispatch\": \"generic\", \"ns_per_call\": %.1f}\n"
+        "  ],\n  \"speedup\": %.2f\n}\n",
+        calls,
+        (int)NRULES,
+        (double)times[0] / calls,
+        (double)times[1] / calls,
+        (double)times[0] / times[1]);
+
+    free(pairs);
+    lua_close(L);
+    return 0;
+}
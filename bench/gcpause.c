@@ -0,0 +1,217 @@
+#include <lualib.h>
+#include <luaclasslib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "classes/blocking_signal.h"
+#include "classes/counted.h"
+#include "classes/file.h"
+#include "classes/signal.h"
+
+// garbage collector pause benchmark. creates and drops populations of user
+// data objects in batches, with the collector stopped, then drives it by hand
+// with `lua_gc` steps and times each step. a step is the longest stretch the
+// program would be paused for, including the finalizers run during it.
+//
+// usage: bench_gcpause [objects] [batch] [filename]
+// results are written to stdout as JSON.
+
+#define MAX_STEPS 1000000
+#define BUCKETS   20  // powers of two from 256ns
+
+// a Moonscript subclass of File, as compiled by moonc
+static const char *file_subclass =
+    "local File = require('lcltests').File\n"
+    "local _class_0\n"
+    "local _parent_0 = File\n"
+    "local _base_0 = {}\n"
+    "for _key_0, _val_0 in pairs(_parent_0.__base) do\n"
+    "  if _base_0[_key_0] == nil and _key_0:match('^__') and\n"
+    "     not (_key_0 == '__index' and _val_0 == _parent_0.__base) then\n"
+    "    _base_0[_key_0] = _val_0\n"
+    "  end\n"
+    "end\n"
+    "_base_0.__index = _base_0\n"
+    "setmetatable(_base_0, _parent_0.__base)\n"
+    "_class_0 = setmetatable({\n"
+    "  __init = function(self, filename)\n"
+    "    _class_0.__parent.__init(self, filename)\n"
+    "  end,\n"
+    "  __base = _base_0,\n"
+    "  __name = 'FileSubclass',\n"
+    "  __parent = _parent_0\n"
+    "}, {\n"
+    "  __index = function(cls, name)\n"
+    "    local val = rawget(_base_0, name)\n"
+    "    if val == nil then\n"
+    "      local parent = rawget(cls, '__parent')\n"
+    "      if parent then return parent[name] end\n"
+    "    else\n"
+    "      return val\n"
+    "    end\n"
+    "  end,\n"
+    "  __call = function(cls, ...)\n"
+    "    local _self_0 = setmetatable({}, _base_0)\n"
+    "    cls.__init(_self_0, ...)\n"
+    "    return _self_0\n"
+    "  end\n"
+    "})\n"
+    "_base_0.__class = _class_0\n"
+    "if _parent_0.__inherited then\n"
+    "  _parent_0.__inherited(_parent_0, _class_0)\n"
+    "end\n"
+    "return _class_0\n";
+
+typedef struct {
+    const char *name;   // the workload name
+    const char *class;  // the class to construct
+    int         file;   // whether the constructor takes a filename
+} workload;
+
+static const workload workloads[] = {
+    {"Plain",          "lcltests.Plain",          0},
+    {"File",           "lcltests.File",           1},
+    {"Signal",         "lcltests.Signal",         0},
+    {"BlockingSignal", "lcltests.BlockingSignal", 0},
+    {"FileSubclass",   "lcltests.FileSubclass",   1},
+};
+
+static void register_class(lua_State *L, luaC_Class *c) {
+    lua_pushlightuserdata(L, c);
+    luaC_classfromptr(L);
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    luaL_getsubtable(L, -1, "lcltests");
+    lua_insert(L, -3);
+    lua_pop(L, 1);  // pop package.loaded
+    lua_setfield(L, -2, c->name);
+    lua_pop(L, 1);  // pop module table
+}
+
+static lua_State *new_state(void) {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    register_class(L, &plain_class);
+    register_class(L, &file_class);
+    register_class(L, &signal_class);
+    register_class(L, &blocking_signal_class);
+
+    if (luaL_dostring(L, file_subclass) != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        exit(1);
+    }
+
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    luaL_getsubtable(L, -1, "lcltests");
+    lua_pushvalue(L, -3);
+    lua_setfield(L, -2, "FileSubclass");
+    lua_pop(L, 3);
+    return L;
+}
+
+// times one collector step and records it
+static int timed_step(
+    lua_State *L,
+    uint64_t  *samples,
+    size_t    *n,
+    uint64_t  *total) {
+    uint64_t t    = bench_now();
+    int      done = lua_gc(L, LUA_GCSTEP, 0);
+    t             = bench_now() - t;
+    if (*n < MAX_STEPS) samples[(*n)++] = t;
+    *total += t;
+    return done;
+}
+
+static void run(
+    const workload *w,
+    int             generational,
+    int             objects,
+    int             batch,
+    const char     *filename,
+    int             first) {
+    lua_State *L = new_state();
+    uint64_t  *samples = malloc(MAX_STEPS * sizeof(uint64_t));
+    size_t     n = 0, hist[BUCKETS + 1] = {0};
+    uint64_t   total = 0;
+
+    if (generational) lua_gc(L, LUA_GCGEN, 0, 0);
+    else lua_gc(L, LUA_GCINC, 0, 0, 0);
+    lua_gc(L, LUA_GCCOLLECT);
+    lua_gc(L, LUA_GCSTOP);
+
+    for (int made = 0; made < objects; made += batch) {
+        lua_createtable(L, batch, 0);
+        for (int i = 1; i <= batch; i++) {
+            if (w->file) lua_pushstring(L, filename);
+            luaC_construct(L, w->file, w->class);
+            lua_rawseti(L, -2, i);
+        }
+        lua_pop(L, 1);  // drop the batch
+
+        // a generational step is a whole (usually young) collection, while
+        // incremental steps are taken until the cycle finishes
+        if (generational) timed_step(L, samples, &n, &total);
+        else
+            for (int s = 0; s < MAX_STEPS; s++)
+                if (timed_step(L, samples, &n, &total)) break;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        int b = 0;
+        while (b < BUCKETS && samples[i] > (256ull << b))
+            b++;
+        hist[b]++;
+    }
+
+    bench_sort(samples, n);
+    printf(
+        "%s    {\"workload\": \"%s\", \"gc\": \"%s\", \"steps\": %zu, "
+        "\"p50_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu, "
+        "\"total_ms\": %.3f, \"histogram\": [",
+        first ? "" : ",\n",
+        w->name,
+        generational ? "generational" : "incremental",
+        n,
+        (unsigned long long)bench_percentile(samples, n, 50),
+        (unsigned long long)bench_percentile(samples, n, 99),
+        (unsigned long long)(n ? samples[n - 1] : 0),
+        total / 1e6);
+
+    for (int b = 0; b <= BUCKETS; b++) {
+        if (b < BUCKETS)
+            printf("{\"le_ns\": %llu, ", (unsigned long long)(256ull << b));
+        else printf("{\"le_ns\": null, ");
+        printf("\"count\": %zu}%s", hist[b], b < BUCKETS ? ", " : "");
+    }
+    printf("]}");
+
+    free(samples);
+    lua_close(L);
+}
+
+int main(int argc, char **argv) {
+    int         objects  = argc > 1 ? atoi(argv[1]) : 100000;
+    int         batch    = argc > 2 ? atoi(argv[2]) : 500;
+    const char *filename = argc > 3 ? argv[3] : argv[0];
+
+    if (objects <= 0 || batch <= 0) {
+        fprintf(stderr, "usage: %s [objects] [batch] [filename]\n", argv[0]);
+        return 1;
+    }
+
+    printf(
+        "{\n  \"benchmark\": \"gcpause\",\n  \"objects\": %d,\n"
+        "  \"batch\": %d,\n  \"results\": [\n",
+        objects,
+        batch);
+
+    int first = 1;
+    for (int gen = 0; gen <= 1; gen++)
+        for (size_t w = 0; w < sizeof(workloads) / sizeof(*workloads); w++) {
+            run(&workloads[w], gen, objects, batch, filename, first);
+            first = 0;
+        }
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
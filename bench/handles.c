@@ -0,0 +1,129 @@
+#include <lualib.h>
+#include <luaclasslib.h>
+
+#include "bench.h"
+#include "classes/counted.h"
+
+// handle table benchmark. keeps references to a population of objects from C,
+// through registry references and through strong and weak handles, and times
+// acquiring, pushing and releasing them. pushes and releases visit the
+// references in random order, as C code holding them rarely does so in order.
+//
+// usage: bench_handles [objects] [rounds]
+// results are written to stdout as JSON.
+
+enum { REGISTRY, STRONG, WEAK };
+
+static const char *const kinds[] = {"registry", "strong", "weak"};
+
+static void register_class(lua_State *L, luaC_Class *c) {
+    lua_pushlightuserdata(L, c);
+    luaC_classfromptr(L);
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    luaL_getsubtable(L, -1, "lcltests");
+    lua_insert(L, -3);
+    lua_pop(L, 1);  // pop package.loaded
+    lua_setfield(L, -2, c->name);
+    lua_pop(L, 1);  // pop module table
+}
+
+static void acquire(lua_State *L, int kind, luaC_Handle *refs, int i) {
+    if (kind == REGISTRY) {
+        lua_pushvalue(L, -1);
+        refs[i] = (luaC_Handle)luaL_ref(L, LUA_REGISTRYINDEX);
+    } else refs[i] = luaC_newhandle(L, -1, kind == WEAK);
+}
+
+static void push(lua_State *L, int kind, luaC_Handle ref) {
+    if (kind == REGISTRY) lua_rawgeti(L, LUA_REGISTRYINDEX, (lua_Integer)ref);
+    else luaC_pushhandle(L, ref);
+}
+
+static void release(lua_State *L, int kind, luaC_Handle ref) {
+    if (kind == REGISTRY) luaL_unref(L, LUA_REGISTRYINDEX, (int)ref);
+    else luaC_releasehandle(L, ref);
+}
+
+static void run(int kind, int objects, int rounds, int first) {
+    lua_State   *L    = luaL_newstate();
+    luaC_Handle *refs = malloc(objects * sizeof(luaC_Handle));
+    int         *perm = malloc(objects * sizeof(int));
+    uint64_t     t_acquire = 0, t_push = 0, t_release = 0;
+    uint32_t     seed = 12345;
+
+    luaL_openlibs(L);
+    register_class(L, &plain_class);
+
+    // objects are kept alive by a table, so weak handles stay valid
+    lua_createtable(L, objects, 0);
+    for (int i = 0; i < objects; i++) {
+        luaC_construct(L, 0, "lcltests.Plain");
+        lua_rawseti(L, -2, i + 1);
+        perm[i] = i;
+    }
+
+    for (int r = 0; r < rounds; r++) {
+        for (int i = objects - 1; i > 0; i--) {
+            int j   = (int)(bench_rand(&seed) % (uint32_t)(i + 1));
+            int tmp = perm[i];
+            perm[i] = perm[j];
+            perm[j] = tmp;
+        }
+
+        uint64_t t = bench_now();
+        for (int i = 0; i < objects; i++) {
+            lua_rawgeti(L, -1, i + 1);
+            acquire(L, kind, refs, i);
+            lua_pop(L, 1);
+        }
+        t_acquire += bench_now() - t;
+
+        t = bench_now();
+        for (int i = 0; i < objects; i++) {
+            push(L, kind, refs[perm[i]]);
+            lua_pop(L, 1);
+        }
+        t_push += bench_now() - t;
+
+        t = bench_now();
+        for (int i = 0; i < objects; i++)
+            release(L, kind, refs[perm[i]]);
+        t_release += bench_now() - t;
+    }
+
+    double n = (double)objects * rounds;
+    printf(
+        "%s    {\"kind\": \"%s\", \"acquire_ns\": %.1f, \"push_ns\": %.1f, "
+        "\"release_ns\": %.1f}",
+        first ? "" : ",\n",
+        kinds[kind],
+        t_acquire / n,
+        t_push / n,
+        t_release / n);
+
+    free(perm);
+    free(refs);
+    lua_close(L);
+}
+
+int main(int argc, char **argv) {
+    int objects = argc > 1 ? atoi(argv[1]) : 1000000;
+    int rounds  = argc > 2 ? atoi(argv[2]) : 5;
+
+    if (objects <= 0 || rounds <= 0) {
+        fprintf(stderr, "usage: %s [objects] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    printf(
+        "{\n  \"benchmark\": \"handles\",\n  \"objects\": %d,\n"
+        "  \"rounds\": %d,\n  \"results\": [\n",
+        objects,
+        rounds);
+
+    for (int kind = REGISTRY; kind <= WEAK; kind++)
+        run(kind, objects, rounds, kind == REGISTRY);
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
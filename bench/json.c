@@ -0,0 +1,198 @@
+#include <lualib.h>
+#include <luaclasslib.h>
+
+#include "bench.h"
+#include "classes/points.h"
+
+// JSON codec benchmark. encodes and decodes large arrays of objects with
+// luaC_tojson and luaC_fromjson, and encodes them with a generic JSON encoder
+// written in Lua for comparison, which converts user data with totable and
+// walks tables with pairs.
+//
+// usage: bench_json [objects] [rounds]
+// results are written to stdout as JSON.
+
+typedef struct {
+    const char *name;
+    const char *make;   // Lua expression for object i
+    const char *class;  // the class to decode into, or NULL
+} workload;
+
+static const workload workloads[] = {
+    {"Point",
+     "Point{x = i, y = i / 2, hits = i, visible = i % 2 == 0, "
+     "label = 'p' .. i}",
+     "lcltests.Point"},
+    {"instance",
+     "fill(Plain(), {x = i, y = i / 2, hits = i, visible = i % 2 == 0, "
+     "label = 'p' .. i})",
+     "lcltests.JsonPlain"},
+    {"table",
+     "{x = i, y = i / 2, hits = i, visible = i % 2 == 0, label = 'p' .. i}",
+     NULL},
+};
+
+static const char *lua_encoder =
+    "local concat, fmt, type, pairs = table.concat, string.format, type, pairs\n"
+    "local function esc(s)\n"
+    "  return '\"' .. s:gsub('[%c\"\\\\]', function(c)\n"
+    "    return fmt('\\\\u%04x', c:byte())\n"
+    "  end) .. '\"'\n"
+    "end\n"
+    "local enc\n"
+    "function enc(v, out)\n"
+    "  local t = type(v)\n"
+    "  if t == 'userdata' then v, t = v:totable(), 'table' end\n"
+    "  if t == 'table' then\n"
+    "    if #v > 0 then\n"
+    "      out[#out + 1] = '['\n"
+    "      for i = 1, #v do\n"
+    "        if i > 1 then out[#out + 1] = ',' end\n"
+    "        enc(v[i], out)\n"
+    "      end\n"
+    "      out[#out + 1] = ']'\n"
+    "    else\n"
+    "      local first = true\n"
+    "      out[#out + 1] = '{'\n"
+    "      for k, x in pairs(v) do\n"
+    "        if type(x) ~= 'function' then\n"
+    "          if not first then out[#out + 1] = ',' end\n"
+    "          first = false\n"
+    "          out[#out + 1] = esc(k)\n"
+    "          out[#out + 1] = ':'\n"
+    "          enc(x, out)\n"
+    "        end\n"
+    "      end\n"
+    "      out[#out + 1] = '}'\n"
+    "    end\n"
+    "  elseif t == 'string' then out[#out + 1] = esc(v)\n"
+    "  elseif t == 'number' then out[#out + 1] = fmt('%.17g', v)\n"
+    "  else out[#out + 1] = tostring(v) end\n"
+    "end\n"
+    "return function(v)\n"
+    "  local out = {}\n"
+    "  enc(v, out)\n"
+    "  return concat(out)\n"
+    "end\n";
+
+static luaL_Reg no_methods[] = {
+    {NULL, NULL}
+};
+
+static void register_class(lua_State *L, const char *name) {
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    luaL_getsubtable(L, -1, "lcltests");
+    lua_insert(L, -3);
+    lua_pop(L, 1);  // pop package.loaded
+    lua_setfield(L, -2, name);
+    lua_pop(L, 1);  // pop module table
+}
+
+static void check(lua_State *L, int status) {
+    if (status != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        exit(1);
+    }
+}
+
+// pushes an array of *n* objects made by the workload
+static void make_objects(lua_State *L, const workload *w, int n) {
+    char chunk[512];
+    snprintf(
+        chunk,
+        sizeof(chunk),
+        "local lcltests = require('lcltests')\n"
+        "local Point, Plain = lcltests.Point, lcltests.JsonPlain\n"
+        "local function fill(o, f)\n"
+        "  for k, v in pairs(f) do o[k] = v end\n"
+        "  return o\n"
+        "end\n"
+        "local t = {}\n"
+        "for i = 1, ... do\n"
+        "  t[i] = %s\n"
+        "end\n"
+        "return t\n",
+        w->make);
+
+    check(L, luaL_loadstring(L, chunk));
+    lua_pushinteger(L, n);
+    check(L, lua_pcall(L, 1, 1, 0));
+}
+
+static void
+run(lua_State *L, const workload *w, int objects, int rounds, int first) {
+    uint64_t t_encode = 0, t_decode = 0, t_lua = 0;
+    size_t   len      = 0;
+
+    make_objects(L, w, objects);  // 1: objects
+    check(L, luaL_loadstring(L, lua_encoder));
+    check(L, lua_pcall(L, 0, 1, 0));  // 2: Lua encoder
+
+    for (int r = 0; r < rounds; r++) {
+        uint64_t t = bench_now();
+        luaC_tojson(L, 1);
+        t_encode += bench_now() - t;
+
+        const char *json = lua_tolstring(L, -1, &len);
+        t                = bench_now();
+        if (!luaC_fromjson(L, json, len, w->class)) check(L, LUA_ERRRUN);
+        t_decode += bench_now() - t;
+        lua_pop(L, 2);  // pop document and decoded objects
+
+        lua_pushvalue(L, 2);
+        lua_pushvalue(L, 1);
+        t = bench_now();
+        check(L, lua_pcall(L, 1, 1, 0));
+        t_lua += bench_now() - t;
+        lua_pop(L, 1);  // pop document
+    }
+
+    double n = (double)objects * rounds;
+    printf(
+        "%s    {\"workload\": \"%s\", \"bytes\": %zu, "
+        "\"encode_ns\": %.1f, \"encode_mb_s\": %.1f, "
+        "\"decode_ns\": %.1f, \"decode_mb_s\": %.1f, "
+        "\"lua_encode_ns\": %.1f, \"encode_speedup\": %.2f}",
+        first ? "" : ",\n",
+        w->name,
+        len,
+        t_encode / n,
+        len * 1e3 * rounds / t_encode,
+        t_decode / n,
+        len * 1e3 * rounds / t_decode,
+        t_lua / n,
+        (double)t_lua / t_encode);
+
+    lua_pop(L, 2);  // pop encoder and objects
+    lua_gc(L, LUA_GCCOLLECT);
+}
+
+int main(int argc, char **argv) {
+    int objects = argc > 1 ? atoi(argv[1]) : 100000;
+    int rounds  = argc > 2 ? atoi(argv[2]) : 5;
+
+    if (objects <= 0 || rounds <= 0) {
+        fprintf(stderr, "usage: %s [objects] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    point_register(L);
+    register_class(L, "Point");
+    luaC_newclass(L, "JsonPlain", NULL, no_methods);
+    register_class(L, "JsonPlain");
+
+    printf(
+        "{\n  \"benchmark\": \"json\",\n  \"objects\": %d,\n"
+        "  \"rounds\": %d,\n  \"results\": [\n",
+        objects,
+        rounds);
+
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(*workloads); w++)
+        run(L, &workloads[w], objects, rounds, w == 0);
+
+    printf("\n  ]\n}\n");
+    lua_close(L);
+    return 0;
+}
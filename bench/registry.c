@@ -0,0 +1,220 @@
+#include <lualib.h>
+#include <luaclasslib.h>
+#include <string.h>
+
+#include "bench.h"
+
+// registry scaling benchmark. registers N classes in a wide (every class
+// derives from the root) or deep (every class derives from the previous one)
+// heirarchy, then measures lookups by name and by pointer while a fraction
+// of the operations unregister and re-register a random class. then registers
+// the same descriptors, with methods, in a series of states, as worker threads
+// would, to show how much of the registration cost is repeated per state.
+
+#define LOOKUPS 200000
+#define STATES  64
+
+typedef struct {
+    int          count;
+    int          deep;
+    double       churn;
+    luaC_Class  *classes;
+    char       (*names)[16];  // class names
+    char       (*paths)[24];  // module paths, "bench.<name>"
+} bench_config;
+
+static void bench_alloc(lua_State *L) {
+    lua_newuserdatauv(L, sizeof(int), 1);
+}
+
+static void bench_gc(lua_State *L, void *p) {
+    (void)L;
+    (void)p;
+}
+
+static int bench_method(lua_State *L) {
+    (void)L;
+    return 0;
+}
+
+static luaL_Reg bench_methods[] = {
+    {NULL, NULL}
+};
+
+static luaL_Reg bench_full_methods[] = {
+    {"new",        bench_method},
+    {"get",        bench_method},
+    {"set",        bench_method},
+    {"update",     bench_method},
+    {"draw",       bench_method},
+    {"resize",     bench_method},
+    {"__tostring", bench_method},
+    {"__eq",       bench_method},
+    {"__len",      bench_method},
+    {NULL,         NULL        }
+};
+
+// registers class i and stores it as package.loaded.bench[name]
+static void register_class(lua_State *L, bench_config *cfg, int i) {
+    lua_pushlightuserdata(L, &cfg->classes[i]);
+    if (!luaC_classfromptr(L)) {
+        fprintf(stderr, "failed to register %s\n", cfg->paths[i]);
+        exit(1);
+    }
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    luaL_getsubtable(L, -1, "bench");
+    lua_insert(L, -3);
+    lua_pop(L, 1);  // pop package.loaded
+    lua_setfield(L, -2, cfg->names[i]);
+    lua_pop(L, 1);  // pop module table
+}
+
+static void setup(bench_config *cfg) {
+    cfg->classes = calloc(cfg->count, sizeof(luaC_Class));
+    cfg->names   = calloc(cfg->count, sizeof(*cfg->names));
+    cfg->paths   = calloc(cfg->count, sizeof(*cfg->paths));
+
+    for (int i = 0; i < cfg->count; i++) {
+        luaC_Class *c = &cfg->classes[i];
+        snprintf(cfg->names[i], sizeof(*cfg->names), "C%d", i);
+        snprintf(cfg->paths[i], sizeof(*cfg->paths), "bench.C%d", i);
+        c->name      = cfg->names[i];
+        c->parent    = i == 0 ? NULL : cfg->paths[cfg->deep ? i - 1 : 0];
+        c->user_ctor = 1;
+        c->alloc     = i == 0 ? bench_alloc : NULL;
+        c->gc        = i % 2 ? bench_gc : NULL;
+        c->methods   = bench_methods;
+    }
+}
+
+static void teardown(bench_config *cfg) {
+    free(cfg->classes);
+    free(cfg->names);
+    free(cfg->paths);
+}
+
+static void run(bench_config *cfg) {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    setup(cfg);
+    lua_gc(L, LUA_GCCOLLECT);
+    double mem0 = lua_gc(L, LUA_GCCOUNT) + lua_gc(L, LUA_GCCOUNTB) / 1024.0;
+
+    // registration throughput
+    uint64_t t0 = bench_now();
+    for (int i = 0; i < cfg->count; i++) register_class(L, cfg, i);
+    uint64_t reg_ns = bench_now() - t0;
+
+    lua_gc(L, LUA_GCCOLLECT);
+    double mem = lua_gc(L, LUA_GCCOUNT) + lua_gc(L, LUA_GCCOUNTB) / 1024.0 -
+                 mem0;
+
+    // lookup latency under churn
+    uint64_t *samples = malloc(LOOKUPS * sizeof(uint64_t));
+    size_t    n = 0, churned = 0;
+    uint64_t  churn_ns = 0;
+    uint32_t  seed     = 0x9e3779b9u;
+    uint32_t  cutoff   = (uint32_t)(cfg->churn * 4294967295.0);
+
+    for (int op = 0; op < LOOKUPS; op++) {
+        int i = (int)(bench_rand(&seed) % (uint32_t)cfg->count);
+
+        if (cfg->churn > 0 && bench_rand(&seed) < cutoff && i > 0) {
+            uint64_t t = bench_now();
+            luaC_unregister(L, cfg->paths[i]);
+            register_class(L, cfg, i);
+            churn_ns += bench_now() - t;
+            churned++;
+            continue;
+        }
+
+        uint64_t t = bench_now();
+        if (op % 2) luaC_pushclass(L, cfg->paths[i]);
+        else {
+            lua_pushlightuserdata(L, &cfg->classes[i]);
+            luaC_classfromptr(L);
+        }
+        samples[n++] = bench_now() - t;
+        lua_pop(L, 1);
+    }
+
+    bench_sort(samples, n);
+    printf(
+        "%-5s %7d %6.1f%% %12.0f %8llu %8llu %8llu %10.0f %8.0f %10.0f\n",
+        cfg->deep ? "deep" : "wide",
+        cfg->count,
+        cfg->churn * 100.0,
+        cfg->count / (reg_ns / 1e9),
+        (unsigned long long)bench_percentile(samples, n, 50),
+        (unsigned long long)bench_percentile(samples, n, 99),
+        (unsigned long long)samples[n - 1],
+        churned ? churn_ns / (double)churned : 0.0,
+        mem,
+        mem * 1024.0 / cfg->count);
+
+    free(samples);
+    lua_close(L);
+    teardown(cfg);
+}
+
+// registers the same descriptors in a series of states and reports the cost
+// per class in the first, second and last state
+static void run_states(int count) {
+    bench_config cfg = {.count = count, .deep = 0, .churn = 0};
+    uint64_t     ns[STATES];
+    setup(&cfg);
+    for (int i = 0; i < count; i++) cfg.classes[i].methods = bench_full_methods;
+
+    for (int s = 0; s < STATES; s++) {
+        lua_State *L = luaL_newstate();
+        luaL_openlibs(L);
+        uint64_t t0 = bench_now();
+        for (int i = 0; i < count; i++) register_class(L, &cfg, i);
+        ns[s] = bench_now() - t0;
+        lua_close(L);
+    }
+
+    printf(
+        "%7d %10.0f %10.0f %10.0f\n",
+        count,
+        ns[0] / (double)count,
+        ns[1] / (double)count,
+        ns[STATES - 1] / (double)count);
+    teardown(&cfg);
+}
+
+int main(void) {
+    static const int    counts[] = {10, 100, 1000, 10000, 100000};
+    static const double churn[]  = {0.0, 0.01, 0.1};
+
+    // first, while the process has seen no other descriptors
+    printf(
+        "%7s %10s %10s %10s\n", "classes", "state 1", "state 2", "state 64");
+    for (size_t c = 0; c < 4; c++) run_states(counts[c]);
+
+    printf("\n");
+
+    printf(
+        "%-5s %7s %7s %12s %8s %8s %8s %10s %8s %10s\n",
+        "shape",
+        "classes",
+        "churn",
+        "reg/s",
+        "p50 ns",
+        "p99 ns",
+        "max ns",
+        "churn ns",
+        "mem KB",
+        "B/class");
+
+    for (int deep = 0; deep <= 1; deep++)
+        for (size_t c = 0; c < sizeof(counts) / sizeof(*counts); c++)
+            for (size_t r = 0; r < sizeof(churn) / sizeof(*churn); r++) {
+                bench_config cfg = {
+                    .count = counts[c], .deep = deep, .churn = churn[r]};
+                run(&cfg);
+            }
+
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include <lualib.h>
+#include <luaclasslib.h>
+
+#include "bench.h"
+#include "classes/signal.h"
+#include "classes/timerwheel.h"
+
+// timer wheel throughput benchmark. schedules a population of timers with
+// random delays from Lua, cancels a fraction of them, then advances the wheel
+// one tick at a time until every timer has fired, timing each tick.
+//
+// usage: bench_timerwheel [timers] [max delay] [cancel every nth]
+// results are written to stdout as JSON.
+
+static const char *schedule_chunk =
+    "local wheel, n, maxdelay, target = ...\n"
+    "local ids, x = {}, 12345\n"
+    "for i = 1, n do\n"
+    "  x = (x * 1103515245 + 12345) % 2147483648\n"
+    "  ids[i] = wheel:schedule(x % maxdelay + 1, target)\n"
+    "end\n"
+    "return ids\n";
+
+static const char *cancel_chunk =
+    "local wheel, ids, step = ...\n"
+    "local n = 0\n"
+    "for i = 1, #ids, step do\n"
+    "  if wheel:cancel(ids[i]) then n = n + 1 end\n"
+    "end\n"
+    "return n\n";
+
+static const char *counter_chunk =
+    "fired = 0\n"
+    "return function() fired = fired + 1 end\n";
+
+static void register_class(lua_State *L, luaC_Class *c) {
+    lua_pushlightuserdata(L, c);
+    luaC_classfromptr(L);
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    luaL_getsubtable(L, -1, "lcltests");
+    lua_insert(L, -3);
+    lua_pop(L, 1);  // pop package.loaded
+    lua_setfield(L, -2, c->name);
+    lua_pop(L, 1);  // pop module table
+}
+
+// pushes the target for the timers: a function, or a signal connected to one
+static void push_target(lua_State *L, int signal) {
+    luaL_dostring(L, counter_chunk);
+    if (signal) {
+        luaC_construct(L, 0, "lcltests.Signal");
+        lua_insert(L, -2);
+        luaC_mcall(L, "connect", 1, 0);
+    }
+}
+
+static void run(int signal, int timers, int maxdelay, int step, int first) {
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    register_class(L, &timer_wheel_class);
+    register_class(L, &signal_class);
+
+    size_t    nticks  = (size_t)maxdelay + 1, n = 0;
+    uint64_t *samples = malloc(nticks * sizeof(uint64_t));
+
+    luaC_construct(L, 0, "lcltests.TimerWheel");
+    int wheel = lua_gettop(L);
+
+    // schedule
+    luaL_loadstring(L, schedule_chunk);
+    lua_pushvalue(L, wheel);
+    lua_pushinteger(L, timers);
+    lua_pushinteger(L, maxdelay);
+    push_target(L, signal);
+    uint64_t t = bench_now();
+    lua_call(L, 4, 1);
+    uint64_t schedule_ns = bench_now() - t;
+    int      ids         = lua_gettop(L);
+
+    // cancel
+    luaL_loadstring(L, cancel_chunk);
+    lua_pushvalue(L, wheel);
+    lua_pushvalue(L, ids);
+    lua_pushinteger(L, step);
+    t = bench_now();
+    lua_call(L, 3, 1);
+    uint64_t    cancel_ns = bench_now() - t;
+    lua_Integer cancelled = lua_tointeger(L, -1);
+    lua_settop(L, wheel);
+
+    // expire
+    uint64_t total = 0;
+    for (;;) {
+        lua_pushvalue(L, wheel);
+        luaC_mcall(L, "pending", 0, 1);
+        lua_Integer pending = lua_tointeger(L, -1);
+        lua_pop(L, 2);
+        if (pending == 0) break;
+
+        lua_pushvalue(L, wheel);
+        t = bench_now();
+        luaC_mcall(L, "advance", 0, 0);
+        t = bench_now() - t;
+        lua_pop(L, 1);
+        if (n < nticks) samples[n++] = t;
+        total += t;
+    }
+
+    lua_getglobal(L, "fired");
+    lua_Integer fired = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+
+    bench_sort(samples, n);
+    printf(
+        "%s    {\"target\": \"%s\", \"schedule_ns_per_timer\": %.1f, "
+        "\"cancelled\": %lld, \"cancel_ns_per_timer\": %.1f, "
+        "\"fired\": %lld, \"expire_ns_per_timer\": %.1f, \"ticks\": %zu, "
+        "\"tick_p50_ns\": %llu, \"tick_p99_ns\": %llu, \"tick_max_ns\": %llu}",
+        first ? "" : ",\n",
+        signal ? "signal" : "function",
+        (double)schedule_ns / timers,
+        (long long)cancelled,
+        cancelled ? (double)cancel_ns / (double)cancelled : 0.0,
+        (long long)fired,
+        fired ? (double)total / (double)fired : 0.0,
+        n,
+        (unsigned long long)bench_percentile(samples, n, 50),
+        (unsigned long long)bench_percentile(samples, n, 99),
+        (unsigned long long)(n ? samples[n - 1] : 0));
+
+    free(samples);
+    lua_close(L);
+}
+
+int main(int argc, char **argv) {
+    int timers   = argc > 1 ? atoi(argv[1]) : 1000000;
+    int maxdelay = argc > 2 ? atoi(argv[2]) : 65536;
+    int step     = argc > 3 ? atoi(argv[3]) : 10;
+
+    if (timers <= 0 || maxdelay <= 0 || step <= 0) {
+        fprintf(
+            stderr,
+            "usage: %s [timers] [max delay] [cancel every nth]\n",
+            argv[0]);
+        return 1;
+    }
+
+    printf(
+        "{\n  \"benchmark\": \"timerwheel\",\n  \"timers\": %d,\n"
+        "  \"max_delay\": %d,\n  \"cancel_every\": %d,\n  \"results\": [\n",
+        timers,
+        maxdelay,
+        step);
+
+    run(0, timers, maxdelay, step, 1);
+    run(1, timers, maxdelay, step, 0);
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
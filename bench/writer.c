@@ -0,0 +1,137 @@
+#include <lualib.h>
+#include <luaclasslib.h>
+
+#include "bench.h"
+#include "classes/writer.h"
+
+// buffered writer benchmark. writes a log of short records to a file with
+// io.write, and with the Writer class one record at a time, with a background
+// thread, and in batches through writev. times include closing the file, so
+// every byte has been handed to the kernel.
+//
+// usage: bench_writer [records] [filename]
+// results are written to stdout as JSON.
+
+typedef struct {
+    const char *name;
+    const char *chunk;  // called with the records and the filename
+} workload;
+
+static const workload workloads[] = {
+    {"io.write",
+     "local recs, path = ...\n"
+     "local f = assert(io.open(path, 'wb'))\n"
+     "for i = 1, #recs do f:write(recs[i], '\\n') end\n"
+     "f:close()\n"},
+    {"Writer",
+     "local recs, path = ...\n"
+     "local w = require('lcltests').Writer(path)\n"
+     "for i = 1, #recs do w:write(recs[i], '\\n') end\n"
+     "w:close()\n"
+     "return select(2, w:stats())\n"},
+    {"Writer background",
+     "local recs, path = ...\n"
+     "local w = require('lcltests').Writer(path, {background = true})\n"
+     "for i = 1, #recs do w:write(recs[i], '\\n') end\n"
+     "w:close()\n"
+     "return select(2, w:stats())\n"},
+    {"Writer writev",
+     "local recs, path = ...\n"
+     "local w = require('lcltests').Writer(path)\n"
+     "local batch = {}\n"
+     "for i = 1, #recs, 256 do\n"
+     "  local n = 0\n"
+     "  for j = i, math.min(i + 255, #recs) do\n"
+     "    batch[n + 1], batch[n + 2] = recs[j], '\\n'\n"
+     "    n = n + 2\n"
+     "  end\n"
+     "  w:writev(batch, 1, n)\n"
+     "end\n"
+     "w:close()\n"
+     "return select(2, w:stats())\n"},
+};
+
+static const char *make_records =
+    "local recs = {}\n"
+    "for i = 1, ... do\n"
+    "  recs[i] = string.format('%d,event,%08x,%.3f', i, i * 2654435761 % 2^32, "
+    "i / 7)\n"
+    "end\n"
+    "return recs\n";
+
+static void register_class(lua_State *L, luaC_Class *c) {
+    lua_pushlightuserdata(L, c);
+    luaC_classfromptr(L);
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    luaL_getsubtable(L, -1, "lcltests");
+    lua_insert(L, -3);
+    lua_pop(L, 1);  // pop package.loaded
+    lua_setfield(L, -2, c->name);
+    lua_pop(L, 1);  // pop module table
+}
+
+static void check(lua_State *L, int status) {
+    if (status != LUA_OK) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv) {
+    int         records  = argc > 1 ? atoi(argv[1]) : 1000000;
+    const char *filename = argc > 2 ? argv[2] : "bench_writer.out";
+
+    if (records <= 0) {
+        fprintf(stderr, "usage: %s [records] [filename]\n", argv[0]);
+        return 1;
+    }
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    register_class(L, &writer_class);
+
+    check(L, luaL_loadstring(L, make_records));
+    lua_pushinteger(L, records);
+    check(L, lua_pcall(L, 1, 1, 0));  // 1: records
+
+    size_t bytes = 0;
+    for (int i = 1; i <= records; i++) {
+        lua_rawgeti(L, 1, i);
+        bytes += lua_rawlen(L, -1) + 1;
+        lua_pop(L, 1);
+    }
+
+    printf(
+        "{\n  \"benchmark\": \"writer\",\n  \"records\": %d,\n"
+        "  \"bytes\": %zu,\n  \"results\": [\n",
+        records,
+        bytes);
+
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(*workloads); w++) {
+        check(L, luaL_loadstring(L, workloads[w].chunk));
+        lua_pushvalue(L, 1);
+        lua_pushstring(L, filename);
+        lua_gc(L, LUA_GCCOLLECT);
+
+        uint64_t t = bench_now();
+        check(L, lua_pcall(L, 2, 1, 0));
+        t = bench_now() - t;
+
+        printf(
+            "%s    {\"writer\": \"%s\", \"ns_per_record\": %.1f, "
+            "\"mb_s\": %.1f, \"syscalls\": ",
+            w == 0 ? "" : ",\n",
+            workloads[w].name,
+            (double)t / records,
+            bytes * 1e3 / t);
+        if (lua_isinteger(L, -1))
+            printf("%lld}", (long long)lua_tointeger(L, -1));
+        else printf("null}");  // not counted for io.write
+        lua_pop(L, 1);
+    }
+
+    printf("\n  ]\n}\n");
+    remove(filename);
+    lua_close(L);
+    return 0;
+}
@@ -0,0 +1,29 @@
+# luaclass_generate(<target> <schema>...)
+#
+# Generates a user data class from each schema with lclgen, and adds the
+# generated sources to <target>. The header and source are named after the
+# schema file, and written to ${CMAKE_CURRENT_BINARY_DIR}/lclgen, which is
+# added to the target's include directories.
+function(luaclass_generate target)
+    if(TARGET LuaClass::lclgen)
+        set(lclgen LuaClass::lclgen)
+    else()
+        set(lclgen lclgen)
+    endif()
+
+    set(dir ${CMAKE_CURRENT_BINARY_DIR}/lclgen)
+    file(MAKE_DIRECTORY ${dir})
+
+    foreach(schema ${ARGN})
+        get_filename_component(name ${schema} NAME_WE)
+        get_filename_component(path ${schema} ABSOLUTE)
+        add_custom_command(
+            OUTPUT ${dir}/${name}.h ${dir}/${name}.c
+            COMMAND ${lclgen} ${path} ${dir}/${name}.h ${dir}/${name}.c
+            DEPENDS ${lclgen} ${path}
+            COMMENT "Generating class from ${schema}")
+        target_sources(${target} PRIVATE ${dir}/${name}.c ${dir}/${name}.h)
+    endforeach()
+
+    target_include_directories(${target} PRIVATE ${dir})
+endfunction()
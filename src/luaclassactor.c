@@ -0,0 +1,354 @@
+#include "luaclassactor.h"
+
+// actors and their scheduler. each actor keeps a ring buffer of messages in its
+// user data. scalar messages are stored in the ring itself, and other values in
+// a table in user value 2 at the same position, so sending a message never
+// allocates once that table exists. an actor with messages is put in the run
+// queue of its scheduler, which resumes the coroutine of each queued actor in
+// turn. a resumed actor handles at most *budget* messages before it yields and
+// goes to the back of the queue, so busy actors cannot starve the others.
+//
+// the user values of an actor are 2: non-scalar messages, 3: its coroutine
+// (created when it first runs), 4: its scheduler.
+enum {
+    MSG_NIL,
+    MSG_BOOLEAN,
+    MSG_INTEGER,
+    MSG_NUMBER,
+    MSG_LIGHTUSERDATA,
+    MSG_VALUE
+};
+
+typedef struct {
+    LUAC_ACTOR_HEADER
+} actor;
+
+typedef struct {
+    int         budget;      // messages an actor may handle per turn
+    unsigned    head, tail;  // the run queue, kept in user value 2
+    unsigned    cap;         // the size of the run queue, a power of two
+    int         running;     // whether the scheduler is running
+    lua_Integer handled;     // messages handled so far
+} scheduler;
+
+// the body of an actor's coroutine. take returns true and a message, or false
+// when the actor should yield.
+static const char *actor_body =
+    "local self, take = ...\n"
+    "while true do\n"
+    "  local ok, msg = take(self)\n"
+    "  if ok then self:receive(msg) else coroutine.yield() end\n"
+    "end\n";
+
+static const char body_key = 0;
+
+// checks that argument *arg* is an instance of the user data class *c* or one
+// of its subclasses, and returns its memory block. classes are matched by
+// descriptor, as their names depend on where they were registered.
+static void *check_instance(lua_State *L, int arg, const luaC_Class *c) {
+    int top = lua_gettop(L);
+
+    if (lua_isuserdata(L, arg) && luaC_isobject(L, arg) &&
+        luaC_getclass(L, arg)) {
+        while (luaC_uclass(L, -1) != c && luaC_getparent(L, -1))
+            lua_remove(L, -2);  // remove previous class
+
+        if (luaC_uclass(L, -1) == c) {
+            lua_settop(L, top);
+            return lua_touserdata(L, arg);
+        }
+    }
+
+    lua_settop(L, top);
+    luaL_error(L, "Value is not an instance of class %s", c->name);
+    return NULL;
+}
+
+// puts the actor at index *aidx* at the back of the run queue of the scheduler
+// at index *sidx*, unless it is already queued
+static void scheduler_push(lua_State *L, int sidx, int aidx) {
+    scheduler *s = (scheduler *)lua_touserdata(L, sidx);
+    actor     *a = (actor *)lua_touserdata(L, aidx);
+
+    if (a->queued) return;
+    lua_getiuservalue(L, sidx, 2);
+
+    if (s->tail - s->head == s->cap) {  // full, double the queue
+        unsigned cap = s->cap ? s->cap * 2 : 64;
+        lua_createtable(L, (int)cap, 0);
+        for (unsigned i = 0; i < s->cap; i++) {
+            lua_rawgeti(L, -2, ((s->head + i) & (s->cap - 1)) + 1);
+            lua_rawseti(L, -2, i + 1);
+        }
+        lua_pushvalue(L, -1);
+        lua_setiuservalue(L, sidx, 2);
+        lua_remove(L, -2);  // remove old queue
+        s->head = 0;
+        s->tail = s->cap;
+        s->cap  = cap;
+    }
+
+    lua_pushvalue(L, aidx);
+    lua_rawseti(L, -2, (s->tail++ & (s->cap - 1)) + 1);
+    lua_pop(L, 1);  // pop queue
+    a->queued = 1;
+}
+
+int luaC_actorsend(lua_State *L, int idx) {
+    idx      = lua_absindex(L, idx);
+    actor *a = (actor *)check_instance(L, idx, &luaC_actorclass);
+
+    if (a->tail - a->head == LUAC_ACTOR_MAILBOX) {
+        lua_pop(L, 1);
+        return 0;
+    }
+
+    unsigned       pos = a->tail & (LUAC_ACTOR_MAILBOX - 1);
+    luaC_ActorMessage *m   = &a->mailbox[pos];
+
+    switch (lua_type(L, -1)) {
+        case LUA_TNIL:
+            m->type = MSG_NIL;
+            break;
+        case LUA_TBOOLEAN:
+            m->type = MSG_BOOLEAN;
+            m->v.i  = lua_toboolean(L, -1);
+            break;
+        case LUA_TNUMBER:
+            if (lua_isinteger(L, -1)) {
+                m->type = MSG_INTEGER;
+                m->v.i  = lua_tointeger(L, -1);
+            } else {
+                m->type = MSG_NUMBER;
+                m->v.n  = lua_tonumber(L, -1);
+            }
+            break;
+        case LUA_TLIGHTUSERDATA:
+            m->type = MSG_LIGHTUSERDATA;
+            m->v.p  = lua_touserdata(L, -1);
+            break;
+        default:
+            m->type = MSG_VALUE;
+            if (lua_getiuservalue(L, idx, 2) != LUA_TTABLE) {
+                lua_pop(L, 1);
+                lua_createtable(L, LUAC_ACTOR_MAILBOX, 0);
+                lua_pushvalue(L, -1);
+                lua_setiuservalue(L, idx, 2);
+            }
+            lua_pushvalue(L, -2);
+            lua_rawseti(L, -2, pos + 1);
+            lua_pop(L, 1);  // pop message table
+    }
+
+    lua_pop(L, 1);  // pop message
+    a->tail++;
+
+    if (lua_getiuservalue(L, idx, 4) != LUA_TUSERDATA)
+        return luaL_error(L, "Actor has no scheduler.");
+    scheduler_push(L, lua_gettop(L), idx);
+    lua_pop(L, 1);  // pop scheduler
+    return 1;
+}
+
+// pushes true and the next message of the actor in argument 1, or false if its
+// mailbox is empty or it has used up its budget
+static int actor_take(lua_State *L) {
+    actor *a = (actor *)lua_touserdata(L, 1);
+
+    if (a->head == a->tail || a->budget <= 0) {
+        a->waiting = 1;
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    unsigned       pos = a->head++ & (LUAC_ACTOR_MAILBOX - 1);
+    luaC_ActorMessage *m   = &a->mailbox[pos];
+    a->budget--;
+    lua_pushboolean(L, 1);
+
+    switch (m->type) {
+        case MSG_BOOLEAN:
+            lua_pushboolean(L, (int)m->v.i);
+            break;
+        case MSG_INTEGER:
+            lua_pushinteger(L, m->v.i);
+            break;
+        case MSG_NUMBER:
+            lua_pushnumber(L, m->v.n);
+            break;
+        case MSG_LIGHTUSERDATA:
+            lua_pushlightuserdata(L, m->v.p);
+            break;
+        case MSG_VALUE:
+            lua_getiuservalue(L, 1, 2);
+            lua_rawgeti(L, -1, pos + 1);
+            lua_pushnil(L);
+            lua_rawseti(L, -3, pos + 1);  // release the message
+            lua_remove(L, -2);            // remove message table
+            break;
+        default:
+            lua_pushnil(L);
+    }
+
+    return 2;
+}
+
+// resumes the actor at index *idx* for one turn. requeues it if it still has
+// work to do. returns the status of the resume, leaving the error on the stack
+// if there is one.
+static int actor_resume(lua_State *L, scheduler *s, int sidx, int idx) {
+    actor     *a = (actor *)lua_touserdata(L, idx);
+    lua_State *co;
+    int        nargs = 0, nres;
+
+    if (lua_getiuservalue(L, idx, 3) == LUA_TTHREAD) co = lua_tothread(L, -1);
+    else {
+        lua_pop(L, 1);
+        co = lua_newthread(L);
+        lua_pushvalue(L, -1);
+        lua_setiuservalue(L, idx, 3);
+        if (lua_rawgetp(L, LUA_REGISTRYINDEX, &body_key) != LUA_TFUNCTION) {
+            lua_pop(L, 1);
+            luaL_loadstring(L, actor_body);
+            lua_pushvalue(L, -1);
+            lua_rawsetp(L, LUA_REGISTRYINDEX, &body_key);
+        }
+        lua_pushvalue(L, idx);
+        lua_pushcfunction(L, actor_take);
+        lua_xmove(L, co, 3);
+        nargs = 2;
+    }
+
+    a->budget   = s->budget;
+    a->waiting  = 0;
+    int status  = lua_resume(co, L, nargs, &nres);
+    s->handled += s->budget - a->budget;
+
+    if (status == LUA_YIELD) {
+        lua_pop(co, nres);
+        lua_pop(L, 1);  // pop coroutine
+        // an actor that yielded in the middle of a message is resumed again
+        if (!a->waiting || a->head != a->tail) scheduler_push(L, sidx, idx);
+        return LUA_OK;
+    }
+
+    // the coroutine is dead, so the actor gets a new one if it runs again
+    lua_xmove(co, L, 1);  // move error
+    lua_remove(L, -2);    // remove coroutine
+    lua_pushnil(L);
+    lua_setiuservalue(L, idx, 3);
+    if (a->head != a->tail) scheduler_push(L, sidx, idx);
+    return status == LUA_OK ? LUA_ERRRUN : status;
+}
+
+static int actor_init(lua_State *L) {
+    check_instance(L, 1, &luaC_actorclass);
+    check_instance(L, 2, &luaC_schedulerclass);
+    lua_settop(L, 2);
+    lua_setiuservalue(L, 1, 4);
+    return 0;
+}
+
+// sends argument 2 to the actor. returns false if its mailbox is full.
+static int actor_send_method(lua_State *L) {
+    lua_settop(L, 2);
+    lua_pushboolean(L, luaC_actorsend(L, 1));
+    return 1;
+}
+
+static int actor_pending(lua_State *L) {
+    actor *a = (actor *)check_instance(L, 1, &luaC_actorclass);
+    lua_pushinteger(L, a->tail - a->head);
+    return 1;
+}
+
+static int actor_receive(lua_State *L) {
+    return luaL_error(L, "Actor does not implement receive.");
+}
+
+static luaL_Reg actor_methods[] = {
+    {"new",     actor_init       },
+    {"send",    actor_send_method},
+    {"pending", actor_pending    },
+    {"receive", actor_receive    },
+    {NULL,      NULL             }
+};
+
+luaC_Class luaC_actorclass = {
+    .name      = "Actor",
+    .parent    = NULL,
+    .user_ctor = 1,
+    .alloc     = NULL,
+    .gc        = NULL,
+    .methods   = actor_methods,
+    .flags     = LUAC_ZEROINIT,  // an empty mailbox is all zeros
+    .size      = sizeof(actor),
+    .nuv       = LUAC_ACTOR_NUV};
+
+static int scheduler_init(lua_State *L) {
+    scheduler *s = (scheduler *)check_instance(L, 1, &luaC_schedulerclass);
+    s->budget    = (int)luaL_optinteger(L, 2, 16);
+    luaL_argcheck(L, s->budget > 0, 2, "budget must be positive");
+    return 0;
+}
+
+// resumes queued actors. each round resumes the actors that were queued when
+// it started, once each. runs argument 2 rounds, or until no actors are queued
+// if it is omitted. returns the number of messages handled. if an actor raises
+// an error, the message it was handling is dropped and the error is raised
+// after its turn, leaving the rest of the queue for the next run.
+static int scheduler_run(lua_State *L) {
+    scheduler *s = (scheduler *)check_instance(L, 1, &luaC_schedulerclass);
+    lua_Integer rounds  = luaL_optinteger(L, 2, -1);
+    lua_Integer handled = s->handled;
+
+    if (s->running) return luaL_error(L, "Scheduler is already running.");
+
+    lua_settop(L, 1);
+    s->running = 1;
+
+    while (s->head != s->tail && rounds-- != 0) {
+        for (unsigned n = s->tail - s->head; n > 0; n--) {
+            int slot = (int)(s->head++ & (s->cap - 1)) + 1;
+            lua_getiuservalue(L, 1, 2);
+            lua_rawgeti(L, 2, slot);  // 3: actor
+            lua_pushnil(L);
+            lua_rawseti(L, 2, slot);
+            ((actor *)lua_touserdata(L, 3))->queued = 0;
+
+            if (actor_resume(L, s, 1, 3) != LUA_OK) {
+                s->running = 0;
+                return lua_error(L);
+            }
+            lua_settop(L, 1);
+        }
+    }
+
+    s->running = 0;
+    lua_pushinteger(L, s->handled - handled);
+    return 1;
+}
+
+static int scheduler_runnable(lua_State *L) {
+    scheduler *s = (scheduler *)check_instance(L, 1, &luaC_schedulerclass);
+    lua_pushinteger(L, s->tail - s->head);
+    return 1;
+}
+
+static luaL_Reg scheduler_methods[] = {
+    {"new",      scheduler_init    },
+    {"run",      scheduler_run     },
+    {"runnable", scheduler_runnable},
+    {NULL,       NULL              }
+};
+
+luaC_Class luaC_schedulerclass = {
+    .name      = "Scheduler",
+    .parent    = NULL,
+    .user_ctor = 1,
+    .alloc     = NULL,
+    .gc        = NULL,
+    .methods   = scheduler_methods,
+    .flags     = LUAC_ZEROINIT,
+    .size      = sizeof(scheduler),
+    .nuv       = 2};
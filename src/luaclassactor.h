@@ -0,0 +1,70 @@
+/// @file luaclassactor.h
+
+#ifndef LUACLASSACTOR_H
+#define LUACLASSACTOR_H
+
+#include <luaclasslib.h>
+
+/// The number of messages an actor's mailbox holds. A power of two.
+#define LUAC_ACTOR_MAILBOX 64
+
+/// A message in an actor's mailbox.
+typedef struct {
+    /** How the message is stored. */
+    int type;
+    /** The message, if it is a scalar. */
+    union {
+        lua_Integer i;
+        lua_Number  n;
+        void       *p;
+    } v;
+} luaC_ActorMessage;
+
+/// Header for the user data of actors. Actors are allocated by LCL, so a C
+/// subclass of @rstref{luaC_actorclass} declares its own `size`, of a struct
+/// with this header first, and `LUAC_ACTOR_NUV` user values.
+#define LUAC_ACTOR_HEADER                                \
+    /** The messages, in a ring buffer. */               \
+    luaC_ActorMessage mailbox[LUAC_ACTOR_MAILBOX];       \
+    /** The read and write positions, free running. */   \
+    unsigned          head, tail;                        \
+    /** The messages left in the current turn. */        \
+    int               budget;                            \
+    /** Whether the actor is in the run queue. */        \
+    int               queued;                            \
+    /** Whether the actor yielded for messages. */       \
+    int               waiting;
+
+/// The number of user values of actors.
+#define LUAC_ACTOR_NUV 4
+
+/**
+ * @brief The Actor class. Each actor has a mailbox, and handles the messages
+ * sent to it by calling its `receive` method, which subclasses implement, in a
+ * coroutine of its own. Actors are constructed with the scheduler that runs
+ * them. C subclasses embed `LUAC_ACTOR_HEADER`, and Moonscript subclasses
+ * extend the class as usual.
+ */
+extern luaC_Class luaC_actorclass;
+
+/**
+ * @brief The Scheduler class. Its `run` method resumes actors that have
+ * messages, in turn, and each one handles at most a budget of messages per
+ * turn, so busy actors cannot starve the others. The budget is the argument of
+ * its constructor, 16 by default.
+ */
+extern luaC_Class luaC_schedulerclass;
+
+/**
+ * @brief Sends the value at the top of the stack to the actor at the given
+ * index, and pops it. Sending nil, booleans, numbers and light user data does
+ * not allocate.
+ *
+ * @param L The Lua state.
+ * @param idx The index of the actor.
+ *
+ * @return 1 if the message was sent, and 0 if the actor's mailbox is full.
+ */
+int luaC_actorsend(lua_State *L, int idx);
+
+#endif
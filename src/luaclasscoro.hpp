@@ -0,0 +1,362 @@
+/// @file luaclasscoro.hpp
+
+#ifndef LUACLASSCORO_HPP
+#define LUACLASSCORO_HPP
+
+#if __cplusplus < 202002L
+#error "luaclasscoro.hpp requires C++20"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+extern "C" {
+#include <luaclasslib.h>
+}
+
+namespace lcl {
+
+/**
+ * @brief Thrown when awaiting a Lua call that raised an error. Holds the error
+ * message.
+ */
+class lua_error : public std::runtime_error {
+  public:
+    explicit lua_error(const std::string &what) : std::runtime_error(what) {}
+};
+
+class call;
+
+/**
+ * @brief Drives Lua calls that have yielded. Each turn resumes every pending
+ * call once, and resumes the C++ coroutine awaiting a call when it finishes.
+ * A loop and the calls it drives must be used from a single thread.
+ */
+class loop {
+  public:
+    /**
+     * @brief Resumes every call that was pending when the turn started.
+     *
+     * @return Whether any calls are still pending.
+     */
+    bool run_once();
+
+    /**
+     * @brief Runs turns until no calls are pending.
+     */
+    void run() {
+        while (run_once()) {}
+    }
+
+    /**
+     * @brief The number of pending calls.
+     */
+    size_t pending() const { return calls_.size(); }
+
+  private:
+    friend class call;
+
+    struct entry {
+        call                   *op;
+        std::coroutine_handle<> waiter;
+    };
+
+    std::vector<entry> calls_;
+};
+
+/**
+ * @brief Awaitable call of a Lua function on its own thread (see
+ * `lua_newthread`). Awaiting it runs the function until it finishes or yields.
+ * If it yields, the awaiting coroutine is suspended and the function is resumed
+ * by the loop until it finishes. Values passed to `coroutine.yield` are
+ * discarded.
+ *
+ * Awaiting the call pushes the results onto the stack of the state the call was
+ * made from and returns their count, or throws lcl::lua_error.
+ */
+class call {
+  public:
+    /**
+     * @brief Prepares a call to the function below the top *nargs* values on
+     * the stack, and pops the function and its arguments. Throws
+     * lcl::lua_error if the call's thread has no room for the arguments.
+     *
+     * @param lp The loop that drives the call.
+     * @param L The Lua state.
+     * @param nargs The number of arguments.
+     * @param nresults The number of results, or `LUA_MULTRET`.
+     */
+    call(loop &lp, lua_State *L, int nargs, int nresults = LUA_MULTRET)
+        : loop_(lp), L_(L), nargs_(nargs), nresults_(nresults) {
+        co_ = lua_newthread(L);
+        if (!lua_checkstack(co_, nargs + 1)) {
+            lua_pop(L, nargs + 2);  // pop thread, function and args
+            throw lua_error("too many arguments");
+        }
+        ref_ = luaL_ref(L, LUA_REGISTRYINDEX);  // anchor the thread
+        lua_xmove(L, co_, nargs + 1);
+    }
+
+    call(const call &)            = delete;
+    call &operator=(const call &) = delete;
+
+    ~call() {
+        if (ref_ != LUA_NOREF) luaL_unref(L_, LUA_REGISTRYINDEX, ref_);
+    }
+
+    bool await_ready() {
+        resume(nargs_);
+        return status_ != LUA_YIELD;
+    }
+
+    void await_suspend(std::coroutine_handle<> h) {
+        loop_.calls_.push_back({this, h});
+    }
+
+    int await_resume() {
+        if (status_ != LUA_OK) {
+            const char *msg = lua_tostring(co_, -1);
+            throw lua_error(msg ? msg : "error object is not a string");
+        }
+
+        int n = lua_gettop(co_);
+        if (nresults_ != LUA_MULTRET) {
+            lua_settop(co_, nresults_);
+            n = nresults_;
+        }
+
+        if (!lua_checkstack(L_, n)) throw lua_error("too many results");
+        lua_xmove(co_, L_, n);
+        return n;
+    }
+
+  private:
+    friend class loop;
+
+    // resumes the thread with *nargs* arguments on its stack. values yielded
+    // by the thread are dropped.
+    void resume(int nargs) {
+        int nres;
+        status_ = lua_resume(co_, L_, nargs, &nres);
+        if (status_ == LUA_YIELD) lua_pop(co_, nres);
+    }
+
+    loop      &loop_;
+    lua_State *L_;
+    lua_State *co_;
+    int        ref_;
+    int        nargs_;
+    int        nresults_;
+    int        status_ = LUA_OK;
+};
+
+inline bool loop::run_once() {
+    std::vector<entry> turn;
+    turn.swap(calls_);  // calls made during this turn wait for the next one
+
+    for (auto &e : turn) {
+        e.op->resume(0);
+        if (e.op->status_ == LUA_YIELD) calls_.push_back(e);
+        else e.waiter.resume();
+    }
+
+    return !calls_.empty();
+}
+
+/**
+ * @brief Awaitable method call, the asynchronous counterpart of
+ * @rstref{luaC_mcall}. The object below the top *nargs* values on the stack is
+ * left in place and the arguments are popped.
+ */
+class mcall : public call {
+  public:
+    /**
+     * @param lp The loop that drives the call.
+     * @param L The Lua state.
+     * @param method The name of the method to call.
+     * @param nargs The number of arguments.
+     * @param nresults The number of results, or `LUA_MULTRET`.
+     */
+    mcall(
+        loop       &lp,
+        lua_State  *L,
+        const char *method,
+        int         nargs,
+        int         nresults = LUA_MULTRET)
+        : call(lp, prepare(L, method, nargs), nargs + 1, nresults) {}
+
+  private:
+    static lua_State *prepare(lua_State *L, const char *method, int nargs) {
+        lua_getfield(L, -nargs - 1, method);  // get the method
+        lua_pushvalue(L, -nargs - 2);         // push a copy of the object
+        lua_rotate(L, -nargs - 2, 2);         // rotate args to top
+        return L;
+    }
+};
+
+/**
+ * @brief Awaitable construction, the asynchronous counterpart of
+ * @rstref{luaC_construct}. Calls the class, so its constructor must be
+ * accessible from Lua. Pops the arguments, and awaiting it pushes the new
+ * object.
+ */
+class construct : public call {
+  public:
+    /**
+     * @param lp The loop that drives the call.
+     * @param L The Lua state.
+     * @param nargs The number of arguments.
+     * @param name The fully qualified name of the class.
+     */
+    construct(loop &lp, lua_State *L, int nargs, const char *name)
+        : call(lp, prepare(L, nargs, name), nargs, 1) {}
+
+  private:
+    static lua_State *prepare(lua_State *L, int nargs, const char *name) {
+        if (luaC_pushclass(L, name) != LUA_TTABLE) {
+            lua_pop(L, nargs + 1);  // pop nil and args
+            throw lua_error(
+                std::string("Class ") + name + " is not registered.");
+        }
+        lua_insert(L, -nargs - 1);  // insert class before args
+        return L;
+    }
+};
+
+template <typename T = void>
+class task;
+
+namespace detail {
+
+struct promise_base {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr      error;
+
+    std::suspend_never initial_suspend() noexcept { return {}; }
+
+    // resumes the awaiting coroutine, if any, when the task finishes
+    auto final_suspend() noexcept {
+        struct awaiter {
+            promise_base *p;
+
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<>) noexcept {
+                if (p->continuation) return p->continuation;
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+        return awaiter{this};
+    }
+
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+}  // namespace detail
+
+/**
+ * @brief Coroutine type for C++ code awaiting Lua calls. A task starts running
+ * when it is created, and can itself be awaited. Destroying a task destroys its
+ * coroutine, so it must outlive any pending calls it awaits.
+ *
+ * @tparam T The type of the result.
+ */
+template <typename T>
+class task {
+  public:
+    struct promise_type : detail::promise_base {
+        std::variant<std::monostate, T> value;
+
+        task get_return_object() {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        void return_value(T v) { value.template emplace<1>(std::move(v)); }
+    };
+
+    task(task &&other) noexcept : h_(std::exchange(other.h_, nullptr)) {}
+    task &operator=(task &&) = delete;
+
+    ~task() {
+        if (h_) h_.destroy();
+    }
+
+    /**
+     * @brief Whether the task has finished.
+     */
+    bool done() const { return h_.done(); }
+
+    /**
+     * @brief Gets the result of a finished task, rethrowing its exception if
+     * it failed.
+     */
+    T get() {
+        if (h_.promise().error) std::rethrow_exception(h_.promise().error);
+        return std::get<1>(std::move(h_.promise().value));
+    }
+
+    bool await_ready() const { return h_.done(); }
+
+    void await_suspend(std::coroutine_handle<> h) {
+        h_.promise().continuation = h;
+    }
+
+    T await_resume() { return get(); }
+
+  private:
+    explicit task(std::coroutine_handle<promise_type> h) : h_(h) {}
+
+    std::coroutine_handle<promise_type> h_;
+};
+
+/// @cond
+template <>
+class task<void> {
+  public:
+    struct promise_type : detail::promise_base {
+        task get_return_object() {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        void return_void() {}
+    };
+
+    task(task &&other) noexcept : h_(std::exchange(other.h_, nullptr)) {}
+    task &operator=(task &&) = delete;
+
+    ~task() {
+        if (h_) h_.destroy();
+    }
+
+    bool done() const { return h_.done(); }
+
+    void get() {
+        if (h_.promise().error) std::rethrow_exception(h_.promise().error);
+    }
+
+    bool await_ready() const { return h_.done(); }
+
+    void await_suspend(std::coroutine_handle<> h) {
+        h_.promise().continuation = h;
+    }
+
+    void await_resume() { get(); }
+
+  private:
+    explicit task(std::coroutine_handle<promise_type> h) : h_(h) {}
+
+    std::coroutine_handle<promise_type> h_;
+};
+/// @endcond
+
+}  // namespace lcl
+
+#endif /* LUACLASSCORO_HPP */
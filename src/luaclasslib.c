@@ -1,11 +1,514 @@
 #include <lua.h>
 #include <luaclasslib.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 // to suppress warnings
 #define UNUSED(...) (void)(__VA_ARGS__)
 
 #define CLASSLIB_REGISTRY_KEY "luaclass.lib"
+#define CLASSLIB_SCOPES_KEY   "luaclass.scopes"
+#define CLASSLIB_STATE_KEY    "luaclass.state"
+#define CLASSLIB_INFO_KEY     "luaclass.info"
+#define CLASSLIB_DEADMT_KEY   "luaclass.dead"
+#define CLASSLIB_DEFER_KEY    "luaclass.deferred"
+#define CLASSLIB_TRACE_KEY    "luaclass.trace"
+#define CLASSLIB_DIRTY_KEY    "luaclass.dirty"
+#define CLASSLIB_NS_KEY       "luaclass.namespaces"
+#define CLASSLIB_ACTIVENS_KEY "luaclass.namespace"
+#define CLASSLIB_FIN_KEY      "luaclass.finalizers"
+#define CLASSLIB_SLOWFIN_KEY  "luaclass.slowfinalizer"
+#define CLASSLIB_CHAIN_KEY    "luaclass.chains"
+#define CLASSLIB_HANDLES_KEY  "luaclass.handles"
+#define CLASSLIB_JSONBUF_KEY  "luaclass.jsonbuffer"
+#define CLASSLIB_GENERIC_KEY  "luaclass.generic"
+#define CLASSLIB_BOUND_KEY    "luaclass.bound"
+#define CLASSLIB_PREEMPT_KEY  "luaclass.preempt"
+#define CLASSLIB_PREEMPTS_KEY "luaclass.preemptions"
+
+struct classlib_trace;
+struct classlib_handles;
+
+// per-state library data
+typedef struct {
+    int                      closing;  // whether the state is being closed by
+                                       // luaC_fastclose
+    struct classlib_trace   *trace;    // the startup trace, if tracing
+    struct classlib_handles *handles;  // the handle table, if any
+    unsigned                 classes;  // bumped when a class is created
+    int                      budget;   // the default instruction budget
+    struct {
+        int                enabled;    // whether destructors are timed
+        unsigned long long threshold;  // the slow finalizer threshold, or 0
+        luaC_SlowFinalizer slow;       // the slow finalizer callback
+        void              *ud;         // and its user data
+    } fin;
+} classlib_state;
+
+// gets the library data for the given state, creating it if necessary
+static classlib_state *get_state(lua_State *L) {
+    classlib_state *st;
+
+    if (lua_getfield(L, LUA_REGISTRYINDEX, CLASSLIB_STATE_KEY) !=
+        LUA_TUSERDATA) {
+        lua_pop(L, 1);
+        st = lua_newuserdatauv(L, sizeof(classlib_state), 0);
+        memset(st, 0, sizeof(classlib_state));
+        lua_pushvalue(L, -1);
+        lua_setfield(L, LUA_REGISTRYINDEX, CLASSLIB_STATE_KEY);
+    } else st = lua_touserdata(L, -1);
+
+    lua_pop(L, 1);
+    return st;
+}
+
+// a timed span of startup work
+typedef struct {
+    const char *kind;      // what kind of work, e.g. "register"
+    char        name[64];  // what it was done for, possibly truncated
+    int         parent;    // the enclosing span, or -1
+    uint64_t    start;     // wall time in ns when the span began
+    uint64_t    total;     // wall time in ns spent in the span
+    size_t      bytes;     // bytes allocated during the span
+    size_t      allocs;    // allocations during the span
+} trace_span;
+
+// startup trace data. allocations are counted by wrapping the allocator.
+typedef struct classlib_trace {
+    lua_Alloc   allocf;  // the wrapped allocator
+    void       *ud;      // and its user data
+    size_t      bytes;   // bytes allocated so far
+    size_t      allocs;  // allocations so far
+    trace_span *spans;   // spans in the order they began
+    int         nspans;
+    int         cap;
+    int         open;    // the innermost open span, or -1
+    int         active;  // whether spans are being recorded
+} classlib_trace;
+
+static uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void *trace_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+    classlib_trace *tr = ud;
+
+    if (nsize > 0 && (ptr == NULL || nsize > osize)) {
+        tr->bytes += ptr == NULL ? nsize : nsize - osize;
+        tr->allocs++;
+    }
+
+    return tr->allocf(tr->ud, ptr, osize, nsize);
+}
+
+static int trace_gc(lua_State *L) {
+    classlib_trace *tr = lua_touserdata(L, 1);
+    if (tr->active) lua_setallocf(L, tr->allocf, tr->ud);
+    free(tr->spans);
+    tr->spans = NULL;
+    return 0;
+}
+
+void luaC_tracestartup(lua_State *L, int enable) {
+    classlib_state *st = get_state(L);
+    classlib_trace *tr = st->trace;
+
+    if (enable && !tr) {
+        tr = lua_newuserdatauv(L, sizeof(classlib_trace), 0);
+        memset(tr, 0, sizeof(classlib_trace));
+        tr->open = -1;
+        lua_createtable(L, 0, 1);
+        lua_pushcfunction(L, trace_gc);
+        lua_setfield(L, -2, "__gc");
+        lua_setmetatable(L, -2);
+        lua_setfield(L, LUA_REGISTRYINDEX, CLASSLIB_TRACE_KEY);
+        st->trace = tr;
+    }
+
+    if (!tr || tr->active == !!enable) return;
+
+    if (enable) {  // start a new trace
+        tr->nspans = 0;
+        tr->open   = -1;
+        tr->allocf = lua_getallocf(L, &tr->ud);
+        lua_setallocf(L, trace_alloc, tr);
+    } else lua_setallocf(L, tr->allocf, tr->ud);
+
+    tr->active = !!enable;
+}
+
+int luaC_tracebegin(lua_State *L, const char *kind, const char *name) {
+    classlib_trace *tr = get_state(L)->trace;
+
+    if (!tr || !tr->active) return -1;
+
+    if (tr->nspans == tr->cap) {
+        int         cap   = tr->cap ? tr->cap * 2 : 64;
+        trace_span *spans = realloc(tr->spans, cap * sizeof(trace_span));
+        if (!spans) return -1;
+        tr->spans = spans;
+        tr->cap   = cap;
+    }
+
+    trace_span *sp = &tr->spans[tr->nspans];
+    sp->kind       = kind;
+    sp->parent     = tr->open;
+    sp->bytes      = tr->bytes;
+    sp->allocs     = tr->allocs;
+    sp->total      = 0;
+    snprintf(sp->name, sizeof(sp->name), "%s", name ? name : "?");
+    sp->start = trace_now();
+    return tr->open = tr->nspans++;
+}
+
+void luaC_traceend(lua_State *L, int span) {
+    classlib_trace *tr = get_state(L)->trace;
+
+    if (!tr || !tr->active || span < 0 || span >= tr->nspans) return;
+
+    // only open spans can be ended. spans begin after their parents, so the
+    // span is open if it is reached from the innermost open span.
+    int i = tr->open;
+    while (i > span) i = tr->spans[i].parent;
+    if (i != span) return;
+
+    // closing a span also closes any spans left open inside it by errors
+    uint64_t now = trace_now();
+    for (i = tr->open; i >= span; i = tr->spans[i].parent) {
+        trace_span *sp = &tr->spans[i];
+        sp->total      = now - sp->start;
+        sp->bytes      = tr->bytes - sp->bytes;
+        sp->allocs     = tr->allocs - sp->allocs;
+    }
+    tr->open = tr->spans[span].parent;
+}
+
+// begins a span named after the class at the given index
+static int trace_beginclass(lua_State *L, int idx, const char *kind) {
+    classlib_trace *tr = get_state(L)->trace;
+    if (!tr || !tr->active) return -1;
+    luaC_getname(L, idx);
+    int span = luaC_tracebegin(L, kind, lua_tostring(L, -1));
+    lua_pop(L, 1);
+    return span;
+}
+
+typedef struct {
+    int      index;
+    uint64_t total;
+} trace_child;
+
+static int trace_compare(const void *a, const void *b) {
+    uint64_t x = ((const trace_child *)a)->total,
+             y = ((const trace_child *)b)->total;
+    return (x < y) - (x > y);  // longest first
+}
+
+// adds the children of span *parent* to the report, longest first
+static void trace_report(
+    luaL_Buffer    *b,
+    classlib_trace *tr,
+    int             parent,
+    int             depth,
+    int             json) {
+    trace_child *children = malloc((tr->nspans + 1) * sizeof(trace_child));
+    int          n        = 0;
+    char         line[256];
+
+    for (int i = parent + 1; children && i < tr->nspans; i++)
+        if (tr->spans[i].parent == parent)
+            children[n++] = (trace_child){i, tr->spans[i].total};
+    if (children) qsort(children, n, sizeof(trace_child), trace_compare);
+
+    if (json) luaL_addchar(b, '[');
+
+    for (int c = 0; c < n; c++) {
+        trace_span *sp   = &tr->spans[children[c].index];
+        uint64_t    self = sp->total;
+
+        for (int i = children[c].index + 1; i < tr->nspans; i++)
+            if (tr->spans[i].parent == children[c].index)
+                self -= tr->spans[i].total;
+
+        if (json) {
+            if (c > 0) luaL_addchar(b, ',');
+            luaL_addstring(b, "{\"kind\":\"");
+            luaL_addstring(b, sp->kind);
+            luaL_addstring(b, "\",\"name\":\"");
+            for (const char *p = sp->name; *p; p++) {
+                if (*p == '"' || *p == '\\') luaL_addchar(b, '\\');
+                luaL_addchar(b, *p);
+            }
+            snprintf(
+                line, sizeof(line),
+                "\",\"total_ns\":%llu,\"self_ns\":%llu,\"bytes\":%zu,"
+                "\"allocs\":%zu,\"children\":",
+                (unsigned long long)sp->total, (unsigned long long)self,
+                sp->bytes, sp->allocs);
+            luaL_addstring(b, line);
+        } else {
+            snprintf(
+                line, sizeof(line), "%10.3f %10.3f %10.1f %8zu  %-9s %*s%s\n",
+                sp->total / 1e6, self / 1e6, sp->bytes / 1024.0, sp->allocs,
+                sp->kind, depth * 2, "", sp->name);
+            luaL_addstring(b, line);
+        }
+
+        trace_report(b, tr, children[c].index, depth + 1, json);
+        if (json) luaL_addchar(b, '}');
+    }
+
+    if (json) luaL_addchar(b, ']');
+    free(children);
+}
+
+void luaC_startupreport(lua_State *L, int json) {
+    classlib_trace *tr = get_state(L)->trace;
+    luaL_Buffer     b;
+    luaL_buffinit(L, &b);
+
+    if (!json)
+        luaL_addstring(
+            &b, "  total ms    self ms   alloc KB   allocs  kind      name\n");
+    if (tr) trace_report(&b, tr, -1, 0, json);
+    else if (json) luaL_addstring(&b, "[]");
+
+    luaL_pushresult(&b);
+}
+
+// lock-free map from descriptors to process-wide records. records are
+// published once and never freed. probing is bounded, so a map crowded by
+// short-lived descriptors fails fast instead of scanning every slot.
+#define DESCRIPTOR_CAPACITY 4096  // must be a power of two
+#define DESCRIPTOR_PROBES   32
+
+typedef struct {
+    _Atomic(const luaC_Class *) keys[DESCRIPTOR_CAPACITY];
+    _Atomic(void *)             values[DESCRIPTOR_CAPACITY];
+} descriptor_map;
+
+// finds the record of a descriptor, creating it with *make* if it is not NULL.
+// returns NULL if there is no record and none could be created.
+static void *descriptor_find(
+    descriptor_map   *m,
+    const luaC_Class *c,
+    void *(*make)(const luaC_Class *c)) {
+    void  *ret = NULL;
+    size_t i   = ((uintptr_t)c >> 4) * 2654435761u;
+
+    for (size_t n = 0; n < DESCRIPTOR_PROBES; n++, i++) {
+        i &= DESCRIPTOR_CAPACITY - 1;
+        const luaC_Class *key =
+            atomic_load_explicit(&m->keys[i], memory_order_acquire);
+
+        if (key == NULL) {
+            if (!make) break;
+
+            // make the record first, so it is published right after the slot
+            // is claimed
+            if (!ret && !(ret = make(c))) break;
+
+            if (atomic_compare_exchange_strong(&m->keys[i], &key, c)) {
+                atomic_store_explicit(&m->values[i], ret, memory_order_release);
+                return ret;
+            }
+        }
+
+        if (key == c) {  // wait for the thread that claimed it to publish
+            free(ret);
+            while (!(ret = atomic_load_explicit(
+                         &m->values[i], memory_order_acquire))) {}
+            return ret;
+        }
+    }
+
+    free(ret);
+    return NULL;
+}
+
+// process-wide metrics. each tracked descriptor gets a record of counters that
+// is split into shards of one cache line each. threads take shards in turn, and
+// there are at least as many shards as processors, so threads running at the
+// same time rarely write to the same line. threads beyond that share shards.
+#define METRICS_MIN_SHARDS 16
+#define METRICS_MAX_SHARDS 1024
+#define CACHE_LINE         64
+
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_llong constructions;
+    atomic_llong finalizations;
+    atomic_llong live;
+    atomic_llong calls;
+} metrics_shard;
+
+typedef struct {
+    const luaC_Class *uclass;
+    int               nshards;
+    metrics_shard     shards[];
+} metrics_record;
+
+static struct {
+    atomic_int     enabled;
+    atomic_int     nthreads;  // threads that have used a shard
+    atomic_int     nshards;   // the number of shards in new records
+    descriptor_map records;
+} metrics;
+
+static _Thread_local int metrics_thread = -1;
+
+// adds *n* to a counter in the calling thread's shard of the record
+#define metrics_add(r, counter, n) \
+    atomic_fetch_add_explicit(     \
+        &metrics_shard_get(r)->counter, (n), memory_order_relaxed)
+
+static metrics_shard *metrics_shard_get(metrics_record *r) {
+    if (metrics_thread < 0)
+        metrics_thread = atomic_fetch_add_explicit(
+            &metrics.nthreads, 1, memory_order_relaxed);
+    return &r->shards[metrics_thread % r->nshards];
+}
+
+// gets the number of shards for new records, the number of processors rounded
+// up to a power of two
+static int metrics_shards(void) {
+    int n = atomic_load_explicit(&metrics.nshards, memory_order_relaxed);
+
+    if (n == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_CONF);
+        for (n = METRICS_MIN_SHARDS; n < cpus && n < METRICS_MAX_SHARDS; n *= 2)
+            ;
+        atomic_store_explicit(&metrics.nshards, n, memory_order_relaxed);
+    }
+
+    return n;
+}
+
+static void *metrics_new(const luaC_Class *c) {
+    int             n    = metrics_shards();
+    size_t          size = sizeof(metrics_record) + n * sizeof(metrics_shard);
+    metrics_record *r    = aligned_alloc(CACHE_LINE, size);
+    if (r) {
+        memset(r, 0, size);
+        r->uclass  = c;
+        r->nshards = n;
+    }
+    return r;
+}
+
+// finds the record of a descriptor, creating it if *create* is set. returns
+// NULL if the descriptor is not tracked and no record could be created.
+static metrics_record *metrics_find(const luaC_Class *c, int create) {
+    return descriptor_find(&metrics.records, c, create ? metrics_new : NULL);
+}
+
+// counts a method call, then calls the method in upvalue 1
+static int metered_method(lua_State *L) {
+    metrics_add(lua_touserdata(L, lua_upvalueindex(2)), calls, 1);
+    return lua_tocfunction(L, lua_upvalueindex(1))(L);
+}
+
+static void metrics_read(metrics_record *r, luaC_Metrics *m) {
+    memset(m, 0, sizeof(luaC_Metrics));
+    m->uclass = r->uclass;
+
+    for (int i = 0; i < r->nshards; i++) {
+        metrics_shard *sh = &r->shards[i];
+        m->constructions +=
+            atomic_load_explicit(&sh->constructions, memory_order_relaxed);
+        m->finalizations +=
+            atomic_load_explicit(&sh->finalizations, memory_order_relaxed);
+        m->live  += atomic_load_explicit(&sh->live, memory_order_relaxed);
+        m->calls += atomic_load_explicit(&sh->calls, memory_order_relaxed);
+    }
+}
+
+void luaC_enablemetrics(int enable) {
+    atomic_store(&metrics.enabled, enable != 0);
+}
+
+int luaC_getmetrics(const luaC_Class *c, luaC_Metrics *m) {
+    metrics_record *r = metrics_find(c, 0);
+    if (r) metrics_read(r, m);
+    return r != NULL;
+}
+
+size_t luaC_snapshotmetrics(luaC_Metrics *buf, size_t n) {
+    size_t ret = 0;
+
+    for (size_t i = 0; i < DESCRIPTOR_CAPACITY; i++) {
+        metrics_record *r = atomic_load_explicit(
+            &metrics.records.values[i], memory_order_acquire);
+        if (!r) continue;
+        if (ret < n) metrics_read(r, &buf[ret]);
+        ret++;
+    }
+
+    return ret;
+}
+
+// appends formatted text to a buffer, keeping track of the full length
+static void
+metrics_printf(char *buf, size_t size, size_t *len, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(
+        *len < size ? buf + *len : NULL, *len < size ? size - *len : 0, fmt,
+        args);
+    va_end(args);
+    if (n > 0) *len += (size_t)n;
+}
+
+size_t luaC_formatmetrics(char *buf, size_t size) {
+    static const struct {
+        const char *name, *type, *help;
+    } families[] = {
+        {"lcl_constructions_total", "counter", "Objects constructed."       },
+        {"lcl_finalizations_total", "counter", "User data objects finalized."},
+        {"lcl_live_instances",      "gauge",   "User data objects alive."   },
+        {"lcl_method_calls_total",  "counter", "Method calls."              },
+    };
+    size_t len = 0;
+
+    if (size > 0) buf[0] = '\0';
+
+    for (size_t f = 0; f < sizeof(families) / sizeof(*families); f++) {
+        metrics_printf(
+            buf, size, &len, "# HELP %s %s\n# TYPE %s %s\n",
+            families[f].name, families[f].help, families[f].name,
+            families[f].type);
+
+        for (size_t i = 0; i < DESCRIPTOR_CAPACITY; i++) {
+            metrics_record *r = atomic_load_explicit(
+                &metrics.records.values[i], memory_order_acquire);
+            if (!r) continue;
+
+            luaC_Metrics m;
+            metrics_read(r, &m);
+            long long values[] = {
+                m.constructions, m.finalizations, m.live, m.calls};
+
+            metrics_printf(buf, size, &len, "%s{class=\"", families[f].name);
+            for (const char *c = r->uclass->name; c && *c; c++) {
+                if (*c == '\\' || *c == '"')
+                    metrics_printf(buf, size, &len, "\\%c", *c);
+                else if (*c == '\n') metrics_printf(buf, size, &len, "\\n");
+                else metrics_printf(buf, size, &len, "%c", *c);
+            }
+            metrics_printf(buf, size, &len, "\"} %lld\n", values[f]);
+        }
+    }
+
+    return len;
+}
 
 static void luaC_setreg(lua_State *L) {
     if (lua_gettop(L) >= 2) {
@@ -77,6 +580,13 @@ static int classlib_rawset(lua_State *L) {
     return 0;
 }
 
+// instance __newindex of classes that track writes
+static int classlib_dirtyset(lua_State *L) {
+    luaC_rawset(L, 1);
+    luaC_markdirty(L, 1);
+    return 0;
+}
+
 static int classlib_type(lua_State *L) {
     luaL_checkany(L, 1);
     lua_pushstring(L, luaC_typename(L, 1));
@@ -110,9 +620,8 @@ int luaC_isinstance(lua_State *L, int idx, const char *name) {
     lua_pushvalue(L, idx);
 
     if (luaC_pushclass(L, name) && luaC_getclass(L, -2)) {
-        do {
-            ret = lua_rawequal(L, -1, refidx);
-        } while (!ret && luaC_getparent(L, -1));
+        while (!(ret = lua_rawequal(L, -1, refidx)) && luaC_getparent(L, -1))
+            lua_remove(L, -2);  // remove previous class
     }
 
     lua_settop(L, top);
@@ -125,52 +634,127 @@ void *luaC_checkuclass(lua_State *L, int arg, const char *name) {
     return lua_touserdata(L, arg);
 }
 
-int luaC_pushclass(lua_State *L, const char *name) {
-    // check the registry first
-    if (luaC_getregfield(L, name) == LUA_TTABLE) return LUA_TTABLE;
-    else lua_pop(L, 1);
-
-    // otherwise, try to `require` the module
-    lua_pushfstring(L, "return require('%s')", name);
-    luaL_loadstring(L, lua_tostring(L, -1));
+// pushes package.loaded[name], or the result of `require(name)` if the module is
+// not loaded and *load* is set. returns the type of the pushed value.
+static int push_module(lua_State *L, const char *name, int load) {
+    lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    int type = lua_getfield(L, -1, name);
     lua_remove(L, -2);
 
-    if (lua_pcall(L, 0, 1, 0) != LUA_OK) {
+    if (type != LUA_TNIL || !load) return type;
+
+    lua_pop(L, 1);
+    if (lua_getglobal(L, "require") == LUA_TFUNCTION) {
+        int span = luaC_tracebegin(L, "require", name);
+        lua_pushstring(L, name);
+        int status = lua_pcall(L, 1, 1, 0);
+        luaC_traceend(L, span);
+        if (status == LUA_OK) return lua_type(L, -1);
+    }
+
+    lua_pop(L, 1);  // pop error or non-function
+    lua_pushnil(L);
+    return LUA_TNIL;
+}
+
+// pushes the class *name* from its module, which is either the class itself or
+// a module table containing it as a field. returns 1 if the class was found,
+// otherwise pushes nothing and returns 0.
+static int push_moduleclass(lua_State *L, const char *name, int load) {
+    if (push_module(L, name, load) == LUA_TTABLE && luaC_isclass(L, -1))
+        return 1;
+    lua_pop(L, 1);
+
+    const char *pos = strrchr(name, '.');
+    if (!pos || strlen(pos) == 1) return 0;
+
+    // try the module table and get class as field
+    lua_pushlstring(L, name, pos - name);
+    int type = push_module(L, lua_tostring(L, -1), load);
+    lua_remove(L, -2);  // remove module name
+
+    if (type == LUA_TTABLE) {
+        lua_getfield(L, -1, pos + 1);
+        lua_remove(L, -2);  // remove module table
+        if (luaC_isclass(L, -1)) return 1;
+    }
+
+    lua_pop(L, 1);
+    return 0;
+}
+
+// pushes the active namespace, returning 1 if there is one. otherwise pushes
+// nil and returns 0.
+static int push_namespace(lua_State *L) {
+    return lua_getfield(L, LUA_REGISTRYINDEX, CLASSLIB_ACTIVENS_KEY) ==
+           LUA_TTABLE;
+}
+
+// pushes the class *name* from the active namespace, where it is stored either
+// under its name or as a field of its module table. returns 1 if the class was
+// found, otherwise pushes nothing and returns 0.
+static int push_nsclass(lua_State *L, const char *name) {
+    if (!push_namespace(L)) {
         lua_pop(L, 1);
-        const char *pos = strrchr(name, '.');
+        return 0;
+    }
 
-        if (!pos || strlen(pos) == 1) {
-            lua_pushnil(L);
-            return LUA_TNIL;
-        }
+    lua_getfield(L, -1, name);
+    if (luaC_isclass(L, -1)) {
+        lua_remove(L, -2);  // remove namespace
+        return 1;
+    }
+    lua_pop(L, 1);
 
-        // try to `require` module table and get class as field
-        lua_pushstring(L, "return require('");
+    const char *pos = strrchr(name, '.');
+    if (pos && strlen(pos) > 1) {
         lua_pushlstring(L, name, pos - name);
-        lua_pushstring(L, "')");
-        lua_concat(L, 3);
-        luaL_loadstring(L, lua_tostring(L, -1));
-        lua_remove(L, -2);
-
-        if (lua_pcall(L, 0, 1, 0) != LUA_OK) {
-            lua_pop(L, 1);
-            lua_pushnil(L);
-            return LUA_TNIL;
-        } else if (lua_istable(L, -1)) {
+        if (lua_gettable(L, -2) == LUA_TTABLE) {  // get module table
             lua_getfield(L, -1, pos + 1);
-            lua_remove(L, -2);
+            if (luaC_isclass(L, -1)) {
+                lua_pushvalue(L, -1);
+                lua_setfield(L, -4, name);  // cache class under its full name
+                lua_rotate(L, -3, 1);       // move class below module table
+                lua_pop(L, 2);              // pop module table and namespace
+                return 1;
+            }
+            lua_pop(L, 1);  // pop field
         }
+        lua_pop(L, 1);  // pop module table (or other value)
     }
 
-    if (!luaC_isclass(L, -1)) {
-        lua_pop(L, 1);
+    lua_pop(L, 1);  // pop namespace
+    return 0;
+}
+
+int luaC_pushclass(lua_State *L, const char *name) {
+    // classes in the active namespace shadow shared ones
+    if (push_nsclass(L, name)) return LUA_TTABLE;
+
+    // check the registry first
+    if (luaC_getregfield(L, name) == LUA_TTABLE) return LUA_TTABLE;
+    else lua_pop(L, 1);
+
+    // then modules that are already loaded, which is much cheaper than
+    // having `require` search the package path for each miss, and finally
+    // try to `require` the module
+    if (!push_moduleclass(L, name, 0) && !push_moduleclass(L, name, 1)) {
         lua_pushnil(L);
         return LUA_TNIL;
     }
 
-    // add class to registry for quick access
+    // add class to the active namespace, or to the registry, for quick
+    // access. classes resolved for a namespace must not become visible to
+    // the others.
     lua_pushvalue(L, -1);
-    luaC_setregfield(L, name);
+    if (push_namespace(L)) {
+        lua_insert(L, -2);
+        lua_setfield(L, -2, name);  // ns[name] = class
+        lua_pop(L, 1);              // pop namespace
+    } else {
+        lua_pop(L, 1);  // pop nil
+        luaC_setregfield(L, name);
+    }
 
     return LUA_TTABLE;
 }
@@ -188,41 +772,177 @@ luaC_Class *luaC_uclass(lua_State *L, int idx) {
     return ret;
 }
 
-// gets the first allocator up the inheritance heirarchy
-static luaC_Constructor get_alloc(lua_State *L, int idx) {
-    int              top = lua_gettop(L);
-    luaC_Constructor ret = NULL;
-    lua_pushvalue(L, idx);
+// per-class library data
+typedef struct class_info {
+    luaC_Class          *uclass;   // the user data class, if any
+    luaC_Class          *alloc;    // the nearest class in the heirarchy that
+                                   // allocates user data, if any
+    struct class_info   *dtor;     // the nearest class in the heirarchy with a
+                                   // destructor, starting from this one
+    struct class_info   *next;     // the next class up the heirarchy with a
+                                   // destructor, if this class has one
+    metrics_record      *metrics;  // the metrics of the nearest descriptor, if
+                                   // it is tracked
+    int                  dirty;    // whether writes to instances are tracked
+    luaC_FinalizerStats *fin;      // the finalizer stats of the class, once
+                                   // its destructor has been timed
+    struct class_info   *layout;   // the nearest class in the heirarchy that
+                                   // declares fields, starting from this one
+    struct class_info   *lnext;    // the next class up the heirarchy that
+                                   // declares fields, if this class does
+    int                  budget;   // the instruction budget of calls on
+                                   // instances, or 0 to use the parent's
+} class_info;
+
+// gets the library data for the class at the given index
+static class_info *get_info(lua_State *L, int idx) {
+    class_info *ret = NULL;
+    idx             = lua_absindex(L, idx);
+
+    if (lua_getfield(L, LUA_REGISTRYINDEX, CLASSLIB_INFO_KEY) == LUA_TTABLE) {
+        lua_pushvalue(L, idx);
+        if (lua_rawget(L, -2) == LUA_TUSERDATA) ret = lua_touserdata(L, -1);
+        lua_pop(L, 1);
+    }
+
+    lua_pop(L, 1);
+    return ret;
+}
 
-    do {
-        luaC_Class *class = luaC_uclass(L, -1);
-        if (class && class->alloc) ret = class->alloc;
-    } while (!ret && luaC_getparent(L, -1));
+// creates the library data for the class at the given index, whose user data
+// class is *c*, and pushes it onto the stack. the class must already be linked
+// to its parent. the data is derived from the nearest ancestor that has any, so
+// this takes constant time regardless of the depth of the heirarchy.
+static class_info *new_info(lua_State *L, int idx, luaC_Class *c) {
+    int         top    = lua_gettop(L);
+    class_info *parent = NULL;
+    idx                = lua_absindex(L, idx);
 
+    // find the nearest ancestor with library data
+    lua_pushvalue(L, idx);
+    while (!parent && luaC_getparent(L, -1)) {
+        lua_remove(L, -2);  // remove previous class
+        parent = get_info(L, -1);
+    }
     lua_settop(L, top);
-    return ret;
+
+    get_state(L)->classes++;  // invalidate dispatch caches
+
+    class_info *info = lua_newuserdatauv(L, sizeof(class_info), 0);
+    info->uclass     = c;
+    info->alloc      = parent ? parent->alloc : NULL;
+    info->next       = parent ? parent->dtor : NULL;
+    info->dtor       = info->next;
+
+    info->metrics    = parent ? parent->metrics : NULL;
+    info->dirty      = parent ? parent->dirty : 0;
+    info->fin        = NULL;
+    info->lnext      = parent ? parent->layout : NULL;
+    info->layout     = info->lnext;
+    info->budget     = 0;
+
+    if (c && (c->alloc || c->size)) info->alloc = c;
+    if (c && c->gc) info->dtor = info;
+    if (c && c->fields) info->layout = info;
+    if (c) info->metrics = metrics.enabled ? metrics_find(c, 1) : NULL;
+    if (c && (c->flags & LUAC_TRACKDIRTY)) info->dirty = 1;
+
+    // info[class] = info
+    if (!luaL_getsubtable(L, LUA_REGISTRYINDEX, CLASSLIB_INFO_KEY)) {
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "k");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+    }
+    lua_pushvalue(L, idx);
+    lua_pushvalue(L, -3);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+    return info;
 }
 
-// default class __call
-static int default_class_call(lua_State *L) {
-    // create the object
-    luaC_Constructor alloc = get_alloc(L, 1);
+// gets the nearest class up the inheritance heirarchy that allocates user data
+static luaC_Class *get_alloc(lua_State *L, int idx) {
+    class_info *info = get_info(L, idx);
+    return info ? info->alloc : NULL;
+}
+
+// allocates an instance of the user data class *c* and pushes it onto the stack
+static void alloc_udata(lua_State *L, luaC_Class *c) {
+    if (c->alloc) {
+        c->alloc(L);
+        return;
+    }
+
+    void *p = lua_newuserdatauv(L, c->size, c->nuv > 0 ? c->nuv : 1);
+    if (c->flags & LUAC_ZEROINIT) memset(p, 0, c->size);
+}
+
+// adds the object at the top of the stack to the innermost scope, if any
+static void scope_track(lua_State *L) {
+    if (lua_getfield(L, LUA_REGISTRYINDEX, CLASSLIB_SCOPES_KEY) == LUA_TTABLE) {
+        lua_Unsigned depth = lua_rawlen(L, -1);
+
+        if (depth > 0 && lua_rawgeti(L, -1, depth) == LUA_TTABLE) {
+            lua_pushvalue(L, -3);  // push a copy of the object
+            lua_rawseti(L, -2, lua_rawlen(L, -2) + 1);  // append it
+        }
+
+        lua_pop(L, 1);  // pop scope list (or nil)
+    }
+
+    lua_pop(L, 1);  // pop scope stack (or nil)
+}
+
+// pushes a new, uninitialized instance of the class at index *cls*, whose
+// library data is *info*. returns 0 if the class has no base.
+static int new_instance(lua_State *L, int cls, class_info *info) {
+    luaC_Class *alloc = info ? info->alloc : NULL;
 
     if (alloc) {
-        alloc(L);
+        alloc_udata(L, alloc);
         lua_newtable(L);
         lua_setiuservalue(L, -2, 1);
     } else lua_newtable(L);
 
-    if (!luaC_getbase(L, 1)) return 0;
+    if (!luaC_getbase(L, cls)) return 0;
+
+    lua_setmetatable(L, -2);  // set object metatable to class base
+    scope_track(L);           // track object in the current scope
+
+    // the object is finalized from here on, even if init fails
+    if (alloc && info->metrics) metrics_add(info->metrics, live, 1);
+    return 1;
+}
+
+// counts the construction of an instance of the class with library data *info*
+static void count_construction(class_info *info) {
+    if (info && info->metrics) metrics_add(info->metrics, constructions, 1);
+}
+
+// finishes default_class_call once init has returned, possibly after yielding
+static int class_call_done(lua_State *L, int status, lua_KContext ctx) {
+    UNUSED(L);
+    UNUSED(status);
+    count_construction((class_info *)ctx);
+    return 1;
+}
+
+// default class __call
+static int default_class_call(lua_State *L) {
+    // create the object
+    class_info *info = get_info(L, 1);
+
+    if (!new_instance(L, 1, info)) return 0;
 
-    lua_setmetatable(L, -2);            // set object metatable to class base
     lua_pushvalue(L, -1);               // push a copy of object for call
     lua_rotate(L, 2, 2);                // rotate objects before other args
     lua_getfield(L, 1, "__init");       // get init
     lua_insert(L, 3);                   // insert before args
-    lua_call(L, lua_gettop(L) - 3, 0);  // call init
-    return 1;
+
+    // init may yield, as when preempted (see luaC_setbudget)
+    lua_callk(L, lua_gettop(L) - 3, 0, (lua_KContext)info, class_call_done);
+    return class_call_done(L, LUA_OK, (lua_KContext)info);
 }
 
 int luaC_construct(lua_State *L, int nargs, const char *name) {
@@ -253,6 +973,7 @@ int luaC_injectmethod(
         lua_pushcclosure(L, f, 1);  // push into closure
         lua_rawset(L, -3);          // overwrite method
         lua_pop(L, 1);              // pop base
+        luaC_clearchains(L);        // cached chains may hold the old method
         return 1;
     }
 
@@ -332,77 +1053,1136 @@ void luaC_super(lua_State *L, const char *name, int nargs, int nresults) {
     lua_call(L, nargs + 1, nresults);
 }
 
-// default class __init
-static int default_init(lua_State *L) {
-    UNUSED(L);
-    return 0;
+// calls the method named by upvalue 2 of the object in upvalue 1, with the
+// arguments of the call
+static int bound_call(lua_State *L) {
+    int nargs = lua_gettop(L);
+    lua_pushvalue(L, lua_upvalueindex(1));  // push obj
+    lua_pushvalue(L, lua_upvalueindex(2));
+    lua_gettable(L, -2);  // get the method
+    lua_insert(L, 1);     // put method before args
+    lua_insert(L, 2);     // and obj after it
+    lua_call(L, nargs + 1, LUA_MULTRET);
+    return lua_gettop(L);
 }
 
-// default subclass __index
-static int default_class_index(lua_State *L) {
-    // check upvalue (base) for key
-    lua_pushvalue(L, 2);
+int luaC_bind(lua_State *L, int idx, const char *method) {
+    idx = lua_absindex(L, idx);
 
-    if (lua_rawget(L, lua_upvalueindex(1)) == LUA_TNIL) {
-        lua_pop(L, 1);
-        lua_pushstring(L, "__parent");
+    if (lua_getfield(L, idx, method) == LUA_TNIL) return 0;
+    lua_pop(L, 1);
 
-        if (lua_rawget(L, 1) != LUA_TNIL) {  // get parent from arg 1 (self)
-            lua_insert(L, -2);               // put parent behind key
-            lua_gettable(L, -2);             // get value (or nil) from parent
-        }
+    // bound[obj][method]. objects are weak keys, and their tables have weak
+    // values, so a bound method lives as long as it is in use and its object
+    // is alive
+    if (!luaL_getsubtable(L, LUA_REGISTRYINDEX, CLASSLIB_BOUND_KEY)) {
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "k");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
     }
 
-    return 1;
-}
+    lua_pushvalue(L, idx);
+    if (lua_rawget(L, -2) != LUA_TTABLE) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "v");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_pushvalue(L, idx);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, -4);  // bound[obj] = methods
+    }
+    lua_remove(L, -2);  // remove bound
 
-// default __index for userdata classes
-static int default_udata_index(lua_State *L) {
-    // check upvalue (base) for key
-    if (luaC_deferindex(L) == LUA_TNIL) {
+    if (lua_getfield(L, -1, method) != LUA_TFUNCTION) {
         lua_pop(L, 1);
-        luaC_rawget(L, 1);
+        lua_pushvalue(L, idx);
+        lua_pushstring(L, method);
+        lua_pushcclosure(L, bound_call, 2);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -3, method);  // methods[method] = bound method
     }
 
+    lua_remove(L, -2);  // remove methods
     return 1;
 }
 
-static int index_invalid(lua_State *L) {
-    return luaL_error(
-        L, "attempt to index an object that was already garbage collected");
+// a call running under an instruction budget. its user value is the name its
+// preemptions are counted under.
+typedef struct {
+    int budget;     // the instruction budget, or 0
+    int preempted;  // whether the last yield was a preemption
+} budget_call;
+
+// pushes the budgeted call record of the thread *co*, creating it if necessary.
+// records are kept in a table with weak keys, so they live as long as their
+// threads.
+static budget_call *push_budget_call(lua_State *co) {
+    if (!luaL_getsubtable(co, LUA_REGISTRYINDEX, CLASSLIB_PREEMPT_KEY)) {
+        lua_createtable(co, 0, 1);
+        lua_pushliteral(co, "k");
+        lua_setfield(co, -2, "__mode");
+        lua_setmetatable(co, -2);
+    }
+
+    lua_pushthread(co);
+    if (lua_rawget(co, -2) != LUA_TUSERDATA) {
+        lua_pop(co, 1);
+        budget_call *bc = lua_newuserdatauv(co, sizeof(budget_call), 1);
+        bc->budget      = 0;
+        bc->preempted   = 0;
+        lua_pushthread(co);
+        lua_pushvalue(co, -2);
+        lua_rawset(co, -4);  // records[co] = record
+    }
+
+    lua_remove(co, -2);  // remove records
+    return lua_touserdata(co, -1);
 }
 
-static int default_udata_gc(lua_State *L) {
-    if (lua_type(L, 1) == LUA_TUSERDATA && luaC_getclass(L, 1)) {
-        // loop through the class and all its parents and call their finalizers
-        do {
-            luaC_Class *class = luaC_uclass(L, -1);
-            if (class && class->gc) class->gc(L, lua_touserdata(L, 1));
-        } while (luaC_getparent(L, -1));
+// pushes the budgeted call record of the thread *co* and returns it. if the
+// thread has none, pushes nothing and returns NULL.
+static budget_call *get_budget_call(lua_State *co) {
+    budget_call *bc = NULL;
+
+    if (lua_getfield(co, LUA_REGISTRYINDEX, CLASSLIB_PREEMPT_KEY) ==
+        LUA_TTABLE) {
+        lua_pushthread(co);
+        if (lua_rawget(co, -2) == LUA_TUSERDATA) bc = lua_touserdata(co, -1);
+        else lua_pop(co, 1);  // pop nil
     }
 
-    // clear the metatable
-    lua_newtable(L);
-    lua_pushcfunction(L, index_invalid);
-    lua_setfield(L, -2, "__index");
-    lua_pushcfunction(L, index_invalid);
-    lua_setfield(L, -2, "__newindex");
-    lua_setmetatable(L, 1);
-    return 0;
+    if (bc) lua_remove(co, -2);  // remove records
+    else lua_pop(co, 1);         // pop records (or nil)
+    return bc;
 }
 
-static int default_class_inherited(lua_State *L) {
-    // get derived class __call metamethod
-    lua_getmetatable(L, 2);
-    lua_pushstring(L, "__base");
-    lua_rawget(L, 2);
-    int base = lua_gettop(L), class_mt = base - 1;
-    lua_pushstring(L, "__call");
-    lua_rawget(L, class_mt);  // get derived constructor
+// yields the running call when its slice of instructions is used up, unless
+// it is inside a C call it cannot yield across, in which case it gets another
+// slice
+static void budget_hook(lua_State *L, lua_Debug *ar) {
+    UNUSED(ar);
+
+    // threads created during a budgeted call inherit its hook, but only the
+    // threads running budgeted calls are preempted
+    budget_call *bc = get_budget_call(L);
+    if (!bc) {
+        lua_sethook(L, NULL, 0, 0);
+        return;
+    }
 
-    // if there's an allocator in the heirarcy and the derived class
-    // __call metamethod is not a C function, then we have a Moonscript
-    // class derived from a userdata class
+    if (!lua_isyieldable(L)) {
+        lua_pop(L, 1);  // pop record
+        return;
+    }
+
+    bc->preempted = 1;
+
+    // preemptions[name] = preemptions[name] + 1
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, CLASSLIB_PREEMPTS_KEY);
+    lua_getiuservalue(L, -2, 1);
+    lua_pushvalue(L, -1);
+    lua_rawget(L, -3);
+    lua_Integer n = lua_tointeger(L, -1);  // 0 if nil
+    lua_pop(L, 1);
+    lua_pushinteger(L, n + 1);
+    lua_rawset(L, -3);
+    lua_pop(L, 2);  // pop preemptions and record
+
+    lua_yield(L, 0);
+}
+
+// resumes the budgeted call on *co* with a fresh slice
+static int budget_resume(
+    lua_State   *co,
+    lua_State   *from,
+    budget_call *bc,
+    int          nargs,
+    int         *nresults) {
+    bc->preempted = 0;
+    if (bc->budget > 0)
+        lua_sethook(co, budget_hook, LUA_MASKCOUNT, bc->budget);
+
+    int status = lua_resume(co, from, nargs, nresults);
+    if (status != LUA_YIELD) lua_sethook(co, NULL, 0, 0);
+    return status;
+}
+
+// starts the call below the top *nargs* values on the stack of *co*, with the
+// name its preemptions are counted under on top, which is popped
+static int budget_start(
+    lua_State *co,
+    lua_State *from,
+    int        budget,
+    int        nargs,
+    int       *nresults) {
+    budget_call *bc = push_budget_call(co);
+    lua_insert(co, -2);
+    lua_setiuservalue(co, -2, 1);  // record.name = name
+    lua_pop(co, 1);                // pop record
+    bc->budget = budget;
+    return budget_resume(co, from, bc, nargs, nresults);
+}
+
+// gets the instruction budget of calls on the object or class at the given index
+static int call_budget(lua_State *L, int idx) {
+    int top = lua_gettop(L), budget = 0;
+
+    if (luaC_isclass(L, idx)) lua_pushvalue(L, idx);
+    else if (!luaC_isobject(L, idx) || !luaC_getclass(L, idx))
+        lua_pushnil(L);
+
+    while (lua_istable(L, -1)) {
+        class_info *info = get_info(L, -1);
+        if (info && (budget = info->budget)) break;
+        if (!luaC_getparent(L, -1)) break;
+        lua_remove(L, -2);  // remove previous class
+    }
+
+    lua_settop(L, top);
+    return budget ? budget : get_state(L)->budget;
+}
+
+void luaC_setbudget(lua_State *L, int budget) {
+    get_state(L)->budget = budget > 0 ? budget : 0;
+}
+
+void luaC_setclassbudget(lua_State *L, int idx, int budget) {
+    class_info *info = get_info(L, idx);
+
+    if (!info) {
+        info = new_info(L, idx, NULL);
+        lua_pop(L, 1);  // pop info
+    }
+
+    info->budget = budget > 0 ? budget : 0;
+}
+
+int luaC_mstart(
+    lua_State  *co,
+    lua_State  *from,
+    const char *method,
+    int         nargs,
+    int        *nresults) {
+    int obj = lua_gettop(co) - nargs;
+    luaL_checkstack(co, 4, "too many arguments");
+    lua_getfield(co, obj, method);  // get the method
+    lua_insert(co, obj++);          // insert it before obj
+
+    int budget = call_budget(co, obj);
+    lua_pushfstring(co, "%s.%s", luaC_typename(co, obj), method);
+    return budget_start(co, from, budget, nargs + 1, nresults);
+}
+
+int luaC_cstart(
+    lua_State  *co,
+    lua_State  *from,
+    int         nargs,
+    const char *name,
+    int        *nresults) {
+    luaL_checkstack(co, 4, "too many arguments");
+
+    if (luaC_pushclass(co, name) != LUA_TTABLE) {
+        lua_pop(co, nargs + 1);  // pop nil and args
+        lua_pushfstring(co, "Class %s is not registered.", name);
+        *nresults = 1;
+        return LUA_ERRRUN;
+    }
+
+    lua_insert(co, -nargs - 1);  // insert class before args
+    int budget = call_budget(co, -nargs - 1);
+    lua_getfield(co, -nargs - 1, "__name");
+    lua_pushfstring(co, "%s.new", lua_tostring(co, -1));
+    lua_remove(co, -2);  // remove class name
+    return budget_start(co, from, budget, nargs, nresults);
+}
+
+int luaC_resumecall(lua_State *co, lua_State *from, int nargs, int *nresults) {
+    budget_call *bc = push_budget_call(co);
+    lua_pop(co, 1);  // pop record
+    return budget_resume(co, from, bc, nargs, nresults);
+}
+
+int luaC_preempted(lua_State *co) {
+    budget_call *bc  = push_budget_call(co);
+    int          ret = bc->preempted;
+    lua_pop(co, 1);  // pop record
+    return ret;
+}
+
+void luaC_pushpreemptions(lua_State *L) {
+    lua_newtable(L);
+    if (lua_getfield(L, LUA_REGISTRYINDEX, CLASSLIB_PREEMPTS_KEY) ==
+        LUA_TTABLE) {
+        lua_pushnil(L);
+        while (lua_next(L, -2) != 0) {
+            lua_pushvalue(L, -2);
+            lua_insert(L, -2);
+            lua_rawset(L, -5);  // copy[name] = count
+        }
+    }
+    lua_pop(L, 1);  // pop preemptions (or nil)
+}
+
+// pushes the functions defined for *method* at each level of the heirarchy of
+// the class at the given index, as a list in base first order. lists are
+// cached per class and method in a table with weak keys.
+static void push_chain(lua_State *L, int idx, const char *method) {
+    idx = lua_absindex(L, idx);
+
+    if (!luaL_getsubtable(L, LUA_REGISTRYINDEX, CLASSLIB_CHAIN_KEY)) {
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "k");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+    }
+
+    lua_pushvalue(L, idx);
+    if (lua_rawget(L, -2) != LUA_TTABLE) {  // get the lists of the class
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, idx);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, -4);  // chains[class] = lists
+    }
+    lua_remove(L, -2);  // remove chains
+
+    if (lua_getfield(L, -1, method) == LUA_TTABLE) {
+        lua_remove(L, -2);  // remove lists
+        return;
+    }
+    lua_pop(L, 1);
+
+    // collect the functions derived first. Moonscript copies metamethods into
+    // derived bases, so a function equal to the one found below it is the
+    // same definition, and is only listed once.
+    lua_newtable(L);
+    int list = lua_gettop(L), n = 0;
+    lua_pushvalue(L, idx);
+
+    for (;;) {
+        if (luaC_getbase(L, -1)) {
+            lua_pushstring(L, method);
+            lua_rawget(L, -2);  // get the method defined at this level
+        } else lua_pushnil(L);
+
+        if (lua_isfunction(L, -1)) {
+            int dup = 0;
+            if (n > 0) {
+                lua_rawgeti(L, list, n);
+                dup = lua_rawequal(L, -1, -2);
+                lua_pop(L, 1);
+            }
+            if (!dup) {
+                lua_pushvalue(L, -1);
+                lua_rawseti(L, list, ++n);
+            }
+        }
+
+        lua_pop(L, 2);  // pop function and base
+        if (!luaC_getparent(L, -1)) break;
+        lua_remove(L, -2);  // remove previous class
+    }
+    lua_pop(L, 2);  // pop nil and class
+
+    for (int i = 1, j = n; i < j; i++, j--) {  // reverse into base first order
+        lua_rawgeti(L, list, i);
+        lua_rawgeti(L, list, j);
+        lua_rawseti(L, list, i);
+        lua_rawseti(L, list, j);
+    }
+
+    lua_pushvalue(L, list);
+    lua_setfield(L, -3, method);  // lists[method] = list
+    lua_remove(L, -2);            // remove lists
+}
+
+int luaC_callchain(
+    lua_State  *L,
+    int         idx,
+    const char *method,
+    int         order,
+    int         nargs) {
+    int args = lua_gettop(L) - nargs + 1, n = 0;
+    idx      = lua_absindex(L, idx);
+
+    if (luaC_isobject(L, idx)) {
+        luaC_getclass(L, idx);
+        push_chain(L, -1, method);
+        lua_remove(L, -2);  // remove class
+        n = (int)lua_rawlen(L, -1);
+        luaL_checkstack(L, nargs + 2, "too many arguments");
+
+        for (int i = 0; i < n; i++) {
+            lua_rawgeti(L, -1, order == LUAC_CHAIN_DERIVEDFIRST ? n - i : i + 1);
+            lua_pushvalue(L, idx);  // push obj
+            for (int a = 0; a < nargs; a++)
+                lua_pushvalue(L, args + a);
+            lua_call(L, nargs + 1, 0);
+        }
+    }
+
+    lua_settop(L, args - 1);  // pop list and args
+    return n;
+}
+
+void luaC_clearchains(lua_State *L) {
+    lua_pushnil(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, CLASSLIB_CHAIN_KEY);
+}
+
+#define DISPATCH_MAXDEPTH 64  // ancestors further up are not matched
+
+// a cached dispatch result
+typedef struct {
+    const void *key[LUAC_DISPATCH_MAX];  // the metatables of the arguments
+    int         method;  // the index of the selected method, 0 if none apply,
+                         // or -1 if the entry is empty
+} dispatch_entry;
+
+// a generic function. its user values are the list of method functions, the
+// list of method classes, a table anchoring the metatables used as cache keys
+// so their addresses are not reused while cached, and the name.
+typedef struct {
+    classlib_state *st;        // the state data, for the class counter
+    unsigned        classes;   // the class counter when the cache was cleared
+    int             arity;     // the number of arguments dispatched on
+    int             nmethods;  // the number of methods
+    int             cap;       // the number of methods *classes* has room for
+    const void    **specs;     // the classes of each method, NULL for any
+    dispatch_entry *cache;     // the dispatch cache, a power of two in size
+    size_t          mask;      // the size of the cache minus one
+    size_t          count;     // the number of cache entries
+} generic;
+
+static int generic_gc(lua_State *L) {
+    generic *g = lua_touserdata(L, 1);
+    free(g->specs);
+    free(g->cache);
+    g->specs = NULL;
+    g->cache = NULL;
+    return 0;
+}
+
+static size_t dispatch_hash(const void *const *key, int n) {
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < n; i++) {
+        h ^= (uintptr_t)key[i];
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    return (size_t)h;
+}
+
+// finds the cache entry for *key*, or the empty entry it belongs in
+static dispatch_entry *dispatch_find(generic *g, const void *const *key) {
+    size_t i = dispatch_hash(key, g->arity) & g->mask;
+
+    for (;; i = (i + 1) & g->mask) {
+        dispatch_entry *e = &g->cache[i];
+        if (e->method < 0 ||
+            memcmp(e->key, key, g->arity * sizeof(const void *)) == 0)
+            return e;
+    }
+}
+
+// resizes the cache of the generic function to *size* entries, emptying it
+static void dispatch_resize(lua_State *L, generic *g, size_t size) {
+    dispatch_entry *cache = realloc(g->cache, size * sizeof(dispatch_entry));
+    if (!cache) luaL_error(L, "not enough memory");
+
+    for (size_t i = 0; i < size; i++)
+        cache[i].method = -1;
+
+    g->cache = cache;
+    g->mask  = size - 1;
+    g->count = 0;
+}
+
+// empties the cache of the generic function at index *gidx*
+static void dispatch_clear(lua_State *L, generic *g, int gidx) {
+    dispatch_resize(L, g, 16);
+    lua_newtable(L);
+    lua_setiuservalue(L, gidx, 3);  // drop the anchored metatables
+    g->classes = g->st->classes;
+}
+
+// doubles the size of the cache, keeping its entries
+static void dispatch_grow(lua_State *L, generic *g) {
+    size_t          size = g->mask + 1, count = g->count;
+    dispatch_entry *old  = malloc(size * sizeof(dispatch_entry));
+    if (!old) luaL_error(L, "not enough memory");
+    memcpy(old, g->cache, size * sizeof(dispatch_entry));
+
+    dispatch_resize(L, g, size * 2);
+    for (size_t i = 0; i < size; i++)
+        if (old[i].method >= 0) *dispatch_find(g, old[i].key) = old[i];
+
+    g->count = count;
+    free(old);
+}
+
+// selects the most specific method of the generic function for the *nargs*
+// arguments starting at index *args*. returns its index, or 0 if none apply.
+static int dispatch_resolve(lua_State *L, generic *g, int args, int nargs) {
+    const void *ancestors[LUAC_DISPATCH_MAX][DISPATCH_MAXDEPTH];
+    int depth[LUAC_DISPATCH_MAX], best[LUAC_DISPATCH_MAX], ret = 0;
+    int top = lua_gettop(L);
+
+    // list the classes of each argument, nearest first
+    for (int i = 0; i < g->arity; i++) {
+        depth[i] = 0;
+        if (i >= nargs || !lua_getmetatable(L, args + i)) continue;
+
+        lua_pushliteral(L, "__class");
+        if (lua_rawget(L, -2) == LUA_TTABLE) {
+            for (;;) {
+                ancestors[i][depth[i]++] = lua_topointer(L, -1);
+                if (depth[i] == DISPATCH_MAXDEPTH || !luaC_getparent(L, -1))
+                    break;
+                lua_remove(L, -2);  // remove previous class
+            }
+        }
+
+        lua_settop(L, top);
+    }
+
+    for (int m = 0; m < g->nmethods; m++) {
+        const void **spec = g->specs + (size_t)m * g->arity;
+        int          dist[LUAC_DISPATCH_MAX], applies = 1, better = !ret;
+
+        for (int i = 0; applies && i < g->arity; i++) {
+            dist[i] = spec[i] ? -1 : DISPATCH_MAXDEPTH;  // nil matches last
+            for (int d = 0; spec[i] && d < depth[i]; d++)
+                if (ancestors[i][d] == spec[i]) {
+                    dist[i] = d;
+                    break;
+                }
+            applies = dist[i] >= 0;
+        }
+
+        if (!applies) continue;
+
+        for (int i = 0; ret && i < g->arity; i++)
+            if (dist[i] != best[i]) {
+                better = dist[i] < best[i];
+                break;
+            }
+
+        if (better) {
+            ret = m + 1;
+            memcpy(best, dist, sizeof(best));
+        }
+    }
+
+    return ret;
+}
+
+// gets the index of the method of the generic function at index *gidx* to call
+// with the *nargs* arguments starting at index *args*, or 0 if none apply
+static int dispatch(lua_State *L, generic *g, int gidx, int args, int nargs) {
+    const void *key[LUAC_DISPATCH_MAX];
+
+    if (g->classes != g->st->classes) dispatch_clear(L, g, gidx);
+
+    for (int i = 0; i < g->arity; i++) {
+        key[i] = NULL;
+        if (i < nargs && lua_getmetatable(L, args + i)) {
+            key[i] = lua_topointer(L, -1);
+            lua_pop(L, 1);
+        }
+    }
+
+    dispatch_entry *e = dispatch_find(g, key);
+    if (e->method >= 0) return e->method;
+
+    int method = dispatch_resolve(L, g, args, nargs);
+
+    if ((g->count + 1) * 2 > g->mask + 1) {
+        dispatch_grow(L, g);
+        e = dispatch_find(g, key);
+    }
+
+    memcpy(e->key, key, sizeof(key));
+    e->method = method;
+    g->count++;
+
+    lua_getiuservalue(L, gidx, 3);
+    for (int i = 0; i < g->arity; i++) {
+        if (key[i] && lua_getmetatable(L, args + i)) {
+            lua_pushboolean(L, 1);
+            lua_rawset(L, -3);  // anchors[metatable] = true
+        }
+    }
+    lua_pop(L, 1);  // pop anchors
+
+    return method;
+}
+
+// raises an error listing the classes of the arguments of a failed dispatch
+static int dispatch_error(lua_State *L, int gidx, int args, int nargs) {
+    generic    *g = lua_touserdata(L, gidx);
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+
+    if (lua_getiuservalue(L, gidx, 4) == LUA_TSTRING) {
+        luaL_addstring(&b, "No method of ");
+        luaL_addvalue(&b);
+    } else {
+        lua_pop(L, 1);
+        luaL_addstring(&b, "No method");
+    }
+
+    luaL_addstring(&b, " applies to (");
+    for (int i = 0; i < g->arity; i++) {
+        if (i > 0) luaL_addstring(&b, ", ");
+        luaL_addstring(&b, i < nargs ? luaC_typename(L, args + i) : "nil");
+    }
+    luaL_addstring(&b, ").");
+    luaL_pushresult(&b);
+    return lua_error(L);
+}
+
+static int generic_call(lua_State *L) {
+    generic *g      = lua_touserdata(L, 1);
+    int      nargs  = lua_gettop(L) - 1;
+    int      method = dispatch(L, g, 1, 2, nargs);
+
+    if (!method) return dispatch_error(L, 1, 2, nargs);
+
+    lua_getiuservalue(L, 1, 1);
+    lua_rawgeti(L, -1, method);
+    lua_replace(L, 1);  // replace the generic function with the method
+    lua_pop(L, 1);      // pop methods
+    lua_call(L, nargs, LUA_MULTRET);
+    return lua_gettop(L);
+}
+
+void luaC_newgeneric(lua_State *L, const char *name, int arity) {
+    if (arity < 1 || arity > LUAC_DISPATCH_MAX)
+        luaL_error(
+            L,
+            "Generic functions dispatch on 1 to %d arguments.",
+            LUAC_DISPATCH_MAX);
+
+    classlib_state *st = get_state(L);
+    generic        *g  = lua_newuserdatauv(L, sizeof(generic), 4);
+    memset(g, 0, sizeof(generic));
+    g->st    = st;
+    g->arity = arity;
+
+    if (luaL_newmetatable(L, CLASSLIB_GENERIC_KEY)) {
+        lua_pushcfunction(L, generic_call);
+        lua_setfield(L, -2, "__call");
+        lua_pushcfunction(L, generic_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+
+    lua_newtable(L);
+    lua_setiuservalue(L, -2, 1);  // method functions
+    lua_newtable(L);
+    lua_setiuservalue(L, -2, 2);  // method classes
+    if (name) {
+        lua_pushstring(L, name);
+        lua_setiuservalue(L, -2, 4);
+    }
+
+    dispatch_clear(L, g, lua_gettop(L));
+}
+
+void luaC_defmethod(lua_State *L, int idx) {
+    idx        = lua_absindex(L, idx);
+    generic *g = luaL_checkudata(L, idx, CLASSLIB_GENERIC_KEY);
+    int      fn = lua_gettop(L), first = fn - g->arity, m;
+    const void *spec[LUAC_DISPATCH_MAX];
+
+    luaL_checktype(L, fn, LUA_TFUNCTION);
+    for (int i = 0; i < g->arity; i++) {
+        int c = first + i;
+
+        if (lua_type(L, c) == LUA_TSTRING) {
+            const char *name = lua_tostring(L, c);
+            if (luaC_pushclass(L, name) != LUA_TTABLE)
+                luaL_error(L, "Class %s is not registered.", name);
+            lua_replace(L, c);
+        }
+
+        if (lua_isnil(L, c)) spec[i] = NULL;
+        else if (luaC_isclass(L, c)) spec[i] = lua_topointer(L, c);
+        else luaL_error(L, "Method class %d is not a class.", i + 1);
+    }
+
+    // find the method for the same classes, or add one
+    size_t size = g->arity * sizeof(const void *);
+    for (m = 0; m < g->nmethods; m++)
+        if (memcmp(g->specs + (size_t)m * g->arity, spec, size) == 0) break;
+
+    if (m == g->nmethods) {
+        if (m == g->cap) {
+            int          cap   = g->cap ? g->cap * 2 : 8;
+            const void **specs = realloc(g->specs, cap * size);
+            if (!specs) luaL_error(L, "not enough memory");
+            g->specs = specs;
+            g->cap   = cap;
+        }
+
+        memcpy(g->specs + (size_t)m * g->arity, spec, size);
+        g->nmethods++;
+
+        lua_getiuservalue(L, idx, 2);
+        for (int i = 0; i < g->arity; i++) {
+            lua_pushvalue(L, first + i);
+            lua_rawseti(L, -2, m * g->arity + i + 1);  // anchor the class
+        }
+        lua_pop(L, 1);  // pop method classes
+    }
+
+    lua_getiuservalue(L, idx, 1);
+    lua_pushvalue(L, fn);
+    lua_rawseti(L, -2, m + 1);  // methods[m] = fn
+    lua_settop(L, first - 1);   // pop methods, classes, and fn
+
+    dispatch_clear(L, g, idx);
+}
+
+int luaC_pushmethod(lua_State *L, int idx, int nargs) {
+    idx        = lua_absindex(L, idx);
+    generic *g = luaL_checkudata(L, idx, CLASSLIB_GENERIC_KEY);
+    int method = dispatch(L, g, idx, lua_gettop(L) - nargs + 1, nargs);
+
+    if (!method) {
+        lua_pushnil(L);
+        return 0;
+    }
+
+    lua_getiuservalue(L, idx, 1);
+    lua_rawgeti(L, -1, method);
+    lua_remove(L, -2);  // remove methods
+    return 1;
+}
+
+// default class __init
+static int default_init(lua_State *L) {
+    UNUSED(L);
+    return 0;
+}
+
+// default subclass __index
+static int default_class_index(lua_State *L) {
+    // check upvalue (base) for key
+    lua_pushvalue(L, 2);
+
+    if (lua_rawget(L, lua_upvalueindex(1)) == LUA_TNIL) {
+        lua_pop(L, 1);
+        lua_pushstring(L, "__parent");
+
+        if (lua_rawget(L, 1) != LUA_TNIL) {  // get parent from arg 1 (self)
+            lua_insert(L, -2);               // put parent behind key
+            lua_gettable(L, -2);             // get value (or nil) from parent
+        }
+    }
+
+    return 1;
+}
+
+// default __index for userdata classes
+static int default_udata_index(lua_State *L) {
+    // check upvalue (base) for key
+    if (luaC_deferindex(L) == LUA_TNIL) {
+        lua_pop(L, 1);
+        luaC_rawget(L, 1);
+    }
+
+    return 1;
+}
+
+static int index_invalid(lua_State *L) {
+    return luaL_error(
+        L, "attempt to index an object that was already garbage collected");
+}
+
+// gets the finalizer stats of the class in *dtor*, creating them if necessary.
+// stats are kept in the registry by descriptor, so they outlive the class.
+static luaC_FinalizerStats *get_finalizer_stats(lua_State *L, class_info *dtor) {
+    if (dtor->fin) return dtor->fin;
+
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, CLASSLIB_FIN_KEY);
+    if (lua_rawgetp(L, -1, dtor->uclass) != LUA_TUSERDATA) {
+        lua_pop(L, 1);
+        luaC_FinalizerStats *s =
+            lua_newuserdatauv(L, sizeof(luaC_FinalizerStats), 0);
+        memset(s, 0, sizeof(luaC_FinalizerStats));
+        s->uclass = dtor->uclass;
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, -3, dtor->uclass);  // stats[uclass] = s
+    }
+
+    dtor->fin = lua_touserdata(L, -1);
+    lua_pop(L, 2);  // pop stats and stats table
+    return dtor->fin;
+}
+
+// calls the destructor of the class in *dtor* on the user data *p* and records
+// how long it took
+static void
+timed_destructor(lua_State *L, classlib_state *st, class_info *dtor, void *p) {
+    uint64_t t = trace_now();
+    dtor->uclass->gc(L, p);
+    t = trace_now() - t;
+
+    luaC_FinalizerStats *s = get_finalizer_stats(L, dtor);
+    int                  b = 0;
+    while (b < LUAC_FINALIZER_BUCKETS - 1 && (t >> b))
+        b++;
+
+    s->calls++;
+    s->total_ns += t;
+    s->histogram[b]++;
+    if (t > s->max_ns) s->max_ns = t;
+
+    if (st->fin.threshold && t > st->fin.threshold) {
+        s->slow++;
+        if (st->fin.slow) st->fin.slow(L, dtor->uclass, t, st->fin.ud);
+    }
+}
+
+// calls the destructors in *info* on the user data *p*, except those of
+// classes with any of the flags in *skip*
+static void call_destructors(
+    lua_State      *L,
+    classlib_state *st,
+    class_info     *info,
+    void           *p,
+    int             skip) {
+    if (info->metrics) {
+        metrics_add(info->metrics, finalizations, 1);
+        metrics_add(info->metrics, live, -1);
+    }
+
+    for (class_info *dtor = info->dtor; dtor; dtor = dtor->next) {
+        luaC_Class *class = dtor->uclass;
+        if (class->flags & skip) continue;
+        if (st->fin.enabled) timed_destructor(L, st, dtor, p);
+        else class->gc(L, p);
+    }
+}
+
+// replaces the metatable of the object at the given index with one that
+// raises an error on access
+static void mark_dead(lua_State *L, int idx) {
+    idx = lua_absindex(L, idx);
+
+    if (lua_getfield(L, LUA_REGISTRYINDEX, CLASSLIB_DEADMT_KEY) != LUA_TTABLE) {
+        lua_pop(L, 1);
+        lua_createtable(L, 0, 2);
+        lua_pushcfunction(L, index_invalid);
+        lua_setfield(L, -2, "__index");
+        lua_pushcfunction(L, index_invalid);
+        lua_setfield(L, -2, "__newindex");
+        lua_pushvalue(L, -1);
+        lua_setfield(L, LUA_REGISTRYINDEX, CLASSLIB_DEADMT_KEY);
+    }
+
+    lua_setmetatable(L, idx);
+}
+
+// handle table slot states
+enum { SLOT_FREE, SLOT_STRONG, SLOT_WEAK };
+
+typedef struct {
+    uint32_t    gen;   // the generation, bumped when the slot is freed
+    uint32_t    next;  // the next free slot, or the next weak handle to the
+                       // same object, or 0
+    int         kind;  // the slot state
+    const void *obj;   // the object of a weak handle, to check list entries
+} handle_slot;
+
+// per-state handle table. objects are kept in a strong and a weak table at the
+// index of their slot, and the weak handles to each object are linked through
+// their slots from an entry in the owners table.
+typedef struct classlib_handles {
+    classlib_state *st;      // the state data, to detach from on close
+    handle_slot    *slots;   // slot 0 is never used, so no handle is 0
+    uint32_t        cap;     // the size of the slot array
+    uint32_t        used;    // the highest slot used so far
+    uint32_t        free;    // the first free slot, or 0
+    size_t          nweak;   // the number of live weak handles
+    int             strong;  // registry references of the strong table,
+    int             weak;    // the weak table,
+    int             owners;  // and the owners table
+} classlib_handles;
+
+static int handles_gc(lua_State *L) {
+    classlib_handles *h = lua_touserdata(L, 1);
+    if (h->st) h->st->handles = NULL;
+    free(h->slots);
+    h->slots = NULL;
+    return 0;
+}
+
+// pushes a new table with the given weak mode and returns a reference to it
+static int new_handle_table(lua_State *L, const char *mode) {
+    lua_newtable(L);
+    if (mode) {
+        lua_createtable(L, 0, 1);
+        lua_pushstring(L, mode);
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+    }
+    return luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+// gets the handle table of the given state, creating it if necessary
+static classlib_handles *get_handles(lua_State *L) {
+    classlib_state *st = get_state(L);
+
+    if (!st->handles) {
+        classlib_handles *h = lua_newuserdatauv(L, sizeof(classlib_handles), 0);
+        memset(h, 0, sizeof(classlib_handles));
+        h->st     = st;
+        h->strong = new_handle_table(L, NULL);
+        h->weak   = new_handle_table(L, "v");
+        h->owners = new_handle_table(L, "k");
+        lua_createtable(L, 0, 1);
+        lua_pushcfunction(L, handles_gc);
+        lua_setfield(L, -2, "__gc");
+        lua_setmetatable(L, -2);
+        lua_setfield(L, LUA_REGISTRYINDEX, CLASSLIB_HANDLES_KEY);
+        st->handles = h;
+    }
+
+    return st->handles;
+}
+
+// gets the slot a handle refers to, or NULL if the handle is stale
+static handle_slot *get_slot(classlib_handles *h, luaC_Handle handle) {
+    uint32_t i = (uint32_t)handle;
+    if (!h || i == 0 || i > h->used) return NULL;
+
+    handle_slot *s = &h->slots[i];
+    if (s->kind == SLOT_FREE || s->gen != (uint32_t)(handle >> 32)) return NULL;
+    return s;
+}
+
+static void free_slot(classlib_handles *h, uint32_t i) {
+    handle_slot *s = &h->slots[i];
+    s->kind        = SLOT_FREE;
+    if (++s->gen == 0) s->gen = 1;  // generation 0 is never handed out
+    s->next = h->free;
+    h->free = i;
+}
+
+// unlinks the weak handle in slot *i* from the handles of the object at the
+// top of the stack
+static void unlink_weak(lua_State *L, classlib_handles *h, uint32_t i) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, h->owners);
+    lua_pushvalue(L, -2);
+    lua_rawget(L, -2);
+    uint32_t first = (uint32_t)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+
+    if (first == i) {
+        lua_pushvalue(L, -2);
+        if (h->slots[i].next) lua_pushinteger(L, h->slots[i].next);
+        else lua_pushnil(L);
+        lua_rawset(L, -3);
+    } else
+        for (uint32_t j = first; j; j = h->slots[j].next)
+            if (h->slots[j].next == i) {
+                h->slots[j].next = h->slots[i].next;
+                break;
+            }
+
+    lua_pop(L, 1);  // pop owners table
+}
+
+// releases the weak handles to the object at index 1, which is being
+// finalized. the collector has already cleared it from the weak table, so
+// handles to it may have been released and their slots reused since, which
+// ends the list early.
+static void release_weak_handles(lua_State *L, classlib_handles *h) {
+    const void *obj = lua_topointer(L, 1);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, h->owners);
+    lua_pushvalue(L, 1);
+
+    if (lua_rawget(L, -2) == LUA_TNUMBER) {
+        uint32_t next;
+        for (uint32_t i = (uint32_t)lua_tointeger(L, -1); i; i = next) {
+            if (h->slots[i].kind != SLOT_WEAK || h->slots[i].obj != obj) break;
+            next = h->slots[i].next;
+            free_slot(h, i);
+            h->nweak--;
+        }
+        lua_pushvalue(L, 1);
+        lua_pushnil(L);
+        lua_rawset(L, -4);
+    }
+
+    lua_pop(L, 2);  // pop slot and owners table
+}
+
+luaC_Handle luaC_newhandle(lua_State *L, int idx, int weak) {
+    if (!luaC_isobject(L, idx)) return LUAC_NOHANDLE;
+    idx = lua_absindex(L, idx);
+
+    classlib_handles *h = get_handles(L);
+    uint32_t          i;
+
+    if (h->free) {
+        i       = h->free;
+        h->free = h->slots[i].next;
+    } else {
+        if (h->used + 1 >= h->cap) {
+            if (h->cap > UINT32_MAX / 2) luaL_error(L, "too many handles");
+            uint32_t     cap   = h->cap ? h->cap * 2 : 64;
+            handle_slot *slots = realloc(h->slots, cap * sizeof(handle_slot));
+            if (!slots) luaL_error(L, "not enough memory");
+            h->slots = slots;
+            h->cap   = cap;
+        }
+        i               = ++h->used;
+        h->slots[i].gen = 1;
+    }
+
+    handle_slot *s = &h->slots[i];
+    s->kind        = weak ? SLOT_WEAK : SLOT_STRONG;
+    s->next        = 0;
+    s->obj         = lua_topointer(L, idx);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, weak ? h->weak : h->strong);
+    lua_pushvalue(L, idx);
+    lua_rawseti(L, -2, i);
+    lua_pop(L, 1);
+
+    if (weak) {  // put the handle first in the list of the object
+        lua_rawgeti(L, LUA_REGISTRYINDEX, h->owners);
+        lua_pushvalue(L, idx);
+        if (lua_rawget(L, -2) == LUA_TNUMBER)
+            s->next = (uint32_t)lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        lua_pushvalue(L, idx);
+        lua_pushinteger(L, i);
+        lua_rawset(L, -3);
+        lua_pop(L, 1);
+        h->nweak++;
+    }
+
+    return (luaC_Handle)s->gen << 32 | i;
+}
+
+int luaC_pushhandle(lua_State *L, luaC_Handle handle) {
+    classlib_handles *h = get_state(L)->handles;
+    handle_slot      *s = get_slot(h, handle);
+
+    if (!s) {
+        lua_pushnil(L);
+        return LUA_TNIL;
+    }
+
+    lua_rawgeti(
+        L,
+        LUA_REGISTRYINDEX,
+        s->kind == SLOT_WEAK ? h->weak : h->strong);
+    int type = lua_rawgeti(L, -1, (uint32_t)handle);
+    lua_remove(L, -2);  // remove object table
+    return type;
+}
+
+int luaC_releasehandle(lua_State *L, luaC_Handle handle) {
+    classlib_handles *h = get_state(L)->handles;
+    handle_slot      *s = get_slot(h, handle);
+    uint32_t          i = (uint32_t)handle;
+
+    if (!s) return 0;
+
+    lua_rawgeti(
+        L,
+        LUA_REGISTRYINDEX,
+        s->kind == SLOT_WEAK ? h->weak : h->strong);
+
+    if (s->kind == SLOT_WEAK) {
+        // if the object is gone, so is its list
+        if (lua_rawgeti(L, -1, i) != LUA_TNIL) unlink_weak(L, h, i);
+        lua_pop(L, 1);
+        h->nweak--;
+    }
+
+    lua_pushnil(L);
+    lua_rawseti(L, -2, i);
+    lua_pop(L, 1);  // pop object table
+    free_slot(h, i);
+    return 1;
+}
+
+// user data class __gc. upvalues are the class info and the state data.
+static int default_udata_gc(lua_State *L) {
+    class_info     *info = lua_touserdata(L, lua_upvalueindex(1));
+    classlib_state *st   = lua_touserdata(L, lua_upvalueindex(2));
+
+    if (lua_type(L, 1) != LUA_TUSERDATA) return 0;
+
+    if (st->closing) {
+        // the state is going away, so there is no need to mark the object
+        call_destructors(L, st, info, lua_touserdata(L, 1), LUAC_SKIPONCLOSE);
+        return 0;
+    }
+
+    if (st->handles && st->handles->nweak) release_weak_handles(L, st->handles);
+    call_destructors(L, st, info, lua_touserdata(L, 1), 0);
+    mark_dead(L, 1);  // clear the metatable
+    return 0;
+}
+
+// calls the destructors of the object at the given index, if it has any
+static void run_destructors(lua_State *L, int idx, int skip) {
+    idx = lua_absindex(L, idx);
+
+    if (luaL_getmetafield(L, idx, "__gc") != LUA_TNIL) {
+        if (lua_tocfunction(L, -1) == default_udata_gc &&
+            lua_getupvalue(L, -1, 1)) {
+            call_destructors(
+                L,
+                get_state(L),
+                lua_touserdata(L, -1),
+                lua_touserdata(L, idx),
+                skip);
+            lua_pop(L, 1);  // pop class info
+        }
+        lua_pop(L, 1);  // pop __gc
+    }
+}
+
+// replaces the class info at the top of the stack with a __gc metamethod that
+// calls its destructors, or nil if there are none and the class is not tracked
+static void push_udata_gc(lua_State *L) {
+    class_info *info = lua_touserdata(L, -1);
+
+    if (info->dtor || info->metrics) {
+        lua_pushlightuserdata(L, get_state(L));
+        lua_pushcclosure(L, default_udata_gc, 2);
+    } else {
+        lua_pop(L, 1);
+        lua_pushnil(L);
+    }
+}
+
+static int default_class_inherited(lua_State *L);
+
+static int class_inherited(lua_State *L) {
+    // get derived class __call metamethod
+    lua_getmetatable(L, 2);
+    lua_pushstring(L, "__base");
+    lua_rawget(L, 2);
+    int base = lua_gettop(L), class_mt = base - 1;
+    lua_pushstring(L, "__call");
+    lua_rawget(L, class_mt);  // get derived constructor
+
+    // if there's an allocator in the heirarcy and the derived class
+    // __call metamethod is not a C function, then we have a Moonscript
+    // class derived from a userdata class
     if (get_alloc(L, 1) && !lua_isnil(L, -1) && !lua_iscfunction(L, -1)) {
         // check if the parent is a userdata class with its lua
         // constructor disabled
@@ -418,196 +2198,1493 @@ static int default_class_inherited(lua_State *L) {
         lua_pushcclosure(L, default_class_inherited, 1);  // wrap it in closure
         lua_rawset(L, 2);
 
-        // set new derived constructor
-        lua_pushstring(L, "__call");
+        // set new derived constructor
+        lua_pushstring(L, "__call");
+        lua_pushcfunction(L, default_class_call);
+        lua_rawset(L, class_mt);
+
+        // set derived class __index
+        lua_pushstring(L, "__index");
+        lua_pushvalue(L, base);  // copy of derived base for closure
+        lua_pushcclosure(L, default_class_index, 1);
+        lua_rawset(L, class_mt);
+
+        // set derived instance __index
+        lua_pushstring(L, "__index");
+        lua_pushvalue(L, base);  // copy of derived base for closure
+        lua_pushcclosure(L, default_udata_index, 1);
+        lua_rawset(L, base);
+
+        // set derived instance __newindex
+        lua_pushstring(L, "__newindex");
+        lua_pushcfunction(
+            L,
+            get_info(L, 1)->dirty ? classlib_dirtyset : classlib_rawset);
+        lua_rawset(L, base);
+
+        // set __class metafield
+        // NOTE: we really shouldn't have to do this, it should be done by
+        // moonscript?
+        lua_pushstring(L, "__class");
+        lua_pushvalue(L, 2);
+        lua_rawset(L, base);
+
+        // set derived instance __gc, overwriting any copied from the parent
+        lua_pushstring(L, "__gc");
+        new_info(L, 2, NULL);
+        push_udata_gc(L);
+        lua_rawset(L, base);
+    }
+
+    lua_settop(L, 2);  // clean up
+
+    // call encapsulated __inherited method
+    lua_pushvalue(L, lua_upvalueindex(1));
+    if (lua_isfunction(L, -1)) {
+        lua_insert(L, 1);
+        lua_call(L, 2, LUA_MULTRET);
+        return lua_gettop(L);
+    }
+
+    return 0;
+}
+
+static int default_class_inherited(lua_State *L) {
+    int span = trace_beginclass(L, 2, "inherited");
+    if (span < 0) return class_inherited(L);
+
+    // call in protected mode, so that errors do not leave the span open
+    int nargs = lua_gettop(L);
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_pushcclosure(L, class_inherited, 1);
+    lua_insert(L, 1);
+    int status = lua_pcall(L, nargs, LUA_MULTRET, 0);
+    luaC_traceend(L, span);
+    if (status != LUA_OK) lua_error(L);
+    return lua_gettop(L);
+}
+
+// state-independent data derived from a descriptor. computed once per process
+// and shared by every state that registers the descriptor.
+typedef struct {
+    const luaL_Reg *source;    // the methods the data was computed from
+    const char     *pname;     // the parent name it was computed from
+    lua_CFunction   init;      // the "new" method, or the default __init
+    const luaL_Reg *methods;   // the methods to set on the base
+    int             filtered;  // whether "new" is left out of *methods*
+    int             nmethods;  // the number of methods, not counting "new"
+    _Atomic(const luaC_Class *) parent;  // the descriptor the parent name last
+                                         // resolved to, if any
+    luaL_Reg list[];  // the methods without "new", when published
+} descriptor_meta;
+
+static descriptor_map descriptors;
+
+// computes the metadata of *c*, copying its methods other than "new" to *list*
+// if it is not NULL
+static void
+meta_compute(const luaC_Class *c, descriptor_meta *meta, luaL_Reg *list) {
+    meta->source   = c->methods;
+    meta->pname    = c->parent;
+    meta->init     = default_init;
+    meta->methods  = list ? list : c->methods;
+    meta->filtered = list != NULL;
+    meta->nmethods = 0;
+    atomic_init(&meta->parent, NULL);
+
+    for (const luaL_Reg *l = c->methods; l && l->name; l++) {
+        if (strcmp(l->name, "new") == 0) {
+            if (l->func) meta->init = l->func;
+        } else if (list) list[meta->nmethods++] = *l;
+        else meta->nmethods++;
+    }
+
+    if (list) list[meta->nmethods] = (luaL_Reg){NULL, NULL};
+}
+
+static void *meta_new(const luaC_Class *c) {
+    size_t n = 1;  // room for the sentinel
+    for (const luaL_Reg *l = c->methods; l && l->name; l++) n++;
+
+    descriptor_meta *meta =
+        malloc(sizeof(descriptor_meta) + n * sizeof(luaL_Reg));
+    if (meta) meta_compute(c, meta, meta->list);
+    return meta;
+}
+
+// gets the metadata of a descriptor, computing it into *local* if it is not
+// to be published, if it cannot be, or if the published data is stale because
+// the descriptor's memory was reused
+static descriptor_meta *
+get_meta(const luaC_Class *c, int publish, descriptor_meta *local) {
+    descriptor_meta *meta =
+        publish ? descriptor_find(&descriptors, c, meta_new) : NULL;
+    if (meta && meta->source == c->methods && meta->pname == c->parent)
+        return meta;
+    meta_compute(c, local, NULL);
+    return local;
+}
+
+// sets the methods of a descriptor on the base at the given index, counting
+// their calls in *r* if it is not NULL
+static void set_methods(
+    lua_State             *L,
+    int                    base,
+    const descriptor_meta *meta,
+    metrics_record        *r) {
+    for (const luaL_Reg *l = meta->methods; l && l->name; l++) {
+        if (!meta->filtered && strcmp(l->name, "new") == 0)
+            continue;  // "new" becomes __init
+
+        if (!l->func) lua_pushboolean(L, 0);  // placeholder, as luaL_setfuncs
+        else if (r) {
+            lua_pushcfunction(L, l->func);
+            lua_pushlightuserdata(L, r);
+            lua_pushcclosure(L, metered_method, 2);
+        } else lua_pushcfunction(L, l->func);
+
+        lua_setfield(L, base, l->name);
+    }
+}
+
+// pushes the parent class of *c*. the descriptor its name resolves to is kept
+// in *meta*, so that other states can find the parent by descriptor instead of
+// resolving its name again. only descriptors registered as light user data are
+// kept, as the others die with their state. names are always resolved while a
+// namespace is active, as they may resolve differently in it.
+static int
+push_parent(lua_State *L, const luaC_Class *c, descriptor_meta *meta) {
+    int ns = push_namespace(L);
+    lua_pop(L, 1);
+
+    if (!ns) {
+        const luaC_Class *p =
+            atomic_load_explicit(&meta->parent, memory_order_acquire);
+
+        if (p) {
+            lua_pushlightuserdata(L, (void *)p);
+            if (luaC_getreg(L) == LUA_TTABLE) return LUA_TTABLE;
+            lua_pop(L, 1);
+        }
+    }
+
+    if (luaC_pushclass(L, c->parent) != LUA_TTABLE) return LUA_TNIL;
+
+    if (!ns) {
+        lua_pushvalue(L, -1);
+        luaC_getreg(L);  // get parent descriptor
+
+        if (lua_islightuserdata(L, -1)) {
+            const luaC_Class *p = lua_touserdata(L, -1);
+            atomic_store_explicit(&meta->parent, p, memory_order_release);
+        }
+
+        lua_pop(L, 1);
+    }
+
+    return LUA_TTABLE;
+}
+
+// checks if the __inherited callback at the given index has nothing to do for
+// a class with a C constructor. that is the case for the default callback when
+// it wraps no other callback and its span is not traced.
+static int inherited_noop(lua_State *L, int idx) {
+    if (lua_tocfunction(L, idx) != default_class_inherited) return 0;
+
+    classlib_trace *tr = get_state(L)->trace;
+    if (tr && tr->active) return 0;
+
+    if (lua_getupvalue(L, idx, 1)) {  // wrapped callback
+        lua_pop(L, 1);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int classfromptr(lua_State *L) {
+    int         uclass = lua_gettop(L);
+    luaC_Class *c      = lua_touserdata(L, uclass);
+
+    if (!c || !c->name) return 0;
+
+    lua_pushvalue(L, uclass);
+
+    if (luaC_getreg(L) != LUA_TNIL) {  // already registered
+        lua_remove(L, uclass);
+        return 1;
+    }
+
+    lua_pop(L, 1);
+
+    // descriptors in full user data die with the state, so their metadata is
+    // not published
+    descriptor_meta  local;
+    descriptor_meta *meta =
+        get_meta(c, lua_islightuserdata(L, uclass), &local);
+
+    // base table, with room for the metafields set below
+    lua_createtable(L, 0, meta->nmethods + 4);
+    set_methods(
+        L, lua_gettop(L), meta, metrics.enabled ? metrics_find(c, 1) : NULL);
+    lua_createtable(L, 0, 5);  // class table
+    lua_createtable(L, 0, 2);  // class metatable
+    int class_mt = lua_gettop(L);
+    int class    = class_mt - 1;
+    int base     = class - 1;
+
+    lua_pushcfunction(L, meta->init);
+    lua_setfield(L, class, "__init");  // set class __init
+    lua_pushvalue(L, base);
+    lua_setfield(L, class, "__base");  // set class __base
+    lua_pushstring(L, c->name);
+    lua_setfield(L, class, "__name");  // set class __name
+    lua_pushcfunction(L, default_class_inherited);
+    lua_setfield(L, class, "__inherited");  // set class __inherited
+
+    lua_pushvalue(L, class);
+    lua_setfield(L, base, "__class");  // set base __class
+
+    // handle constructor
+    if (c->user_ctor) {
         lua_pushcfunction(L, default_class_call);
-        lua_rawset(L, class_mt);
+        lua_setfield(L, class_mt, "__call");  // set meta __call
+    }
 
-        // set derived class __index
-        lua_pushstring(L, "__index");
-        lua_pushvalue(L, base);  // copy of derived base for closure
-        lua_pushcclosure(L, default_class_index, 1);
-        lua_rawset(L, class_mt);
+    // handle inheritance
+    if (c->parent == NULL) {                   // no parent
+        lua_pushvalue(L, base);                // push base
+        lua_setfield(L, class_mt, "__index");  // set meta __index to base
+    } else if (push_parent(L, c, meta) == LUA_TTABLE) {  // get parent
+        lua_pushvalue(L, base);                           // push base
+        lua_pushcclosure(L, default_class_index, 1);  // wrap it in a closure
+        lua_setfield(L, class_mt, "__index");         // set meta __index
+        lua_getfield(L, -1, "__base");                // get parent __base
+        lua_setmetatable(L, base);  // set base metatable to parent base
+        lua_setfield(L, class, "__parent");  // set class __parent to parent
+    } else {                                 // else parent not registered
+        lua_pop(L, 4);                       // clean up and return
+        lua_remove(L, uclass);
+        return 0;
+    }
 
-        // set derived instance __index
-        lua_pushstring(L, "__index");
-        lua_pushvalue(L, base);  // copy of derived base for closure
+    lua_setmetatable(L, class);  // set class metatable
+
+    // user data classes may inherit their allocator
+    class_info *info = new_info(L, class, c);
+    if (info->dirty && !info->alloc) {
+        // fields of table instances are written without __newindex once they
+        // exist, so writes to them cannot be tracked
+        lua_settop(L, uclass - 1);
+        return 0;
+    }
+
+    if (info->alloc) {
+        lua_pushvalue(L, base);
         lua_pushcclosure(L, default_udata_index, 1);
-        lua_rawset(L, base);
+        lua_setfield(L, base, "__index");  // set base __index
+        lua_pushcfunction(L, info->dirty ? classlib_dirtyset : classlib_rawset);
+        lua_setfield(L, base, "__newindex");  // set base __newindex
+        push_udata_gc(L);
+        lua_setfield(L, base, "__gc");  // set base __gc, if needed
+    } else {
+        lua_pop(L, 1);  // pop class info
+        lua_pushvalue(L, base);
+        lua_setfield(L, base, "__index");  // set base __index to self
+    }
+
+    if (luaC_getparent(L, class)) {
+        if (lua_getfield(L, -1, "__inherited") != LUA_TNIL &&
+            !inherited_noop(L, -1)) {
+            lua_insert(L, -2);        // put inherited behind parent
+            lua_pushvalue(L, class);  // push our (derived) class
+            lua_call(L, 2, 0);        // call inherited
+        } else lua_pop(L, 2);         // else pop nil and parent
+    } else lua_pop(L, 1);             // else pop nil
+
+    lua_pushvalue(L, class);
+    lua_pushvalue(L, uclass);
+    luaC_setreg(L);  // reg[class] = uclass
+    lua_pushvalue(L, uclass);
+    lua_pushvalue(L, class);
+    luaC_setreg(L);  // reg[uclass] = class
+
+    lua_remove(L, base);    // remove base from stack
+    lua_remove(L, uclass);  // remove uclass from stack
+    return 1;
+}
+
+int luaC_classfromptr(lua_State *L) {
+    luaC_Class *c    = lua_touserdata(L, -1);
+    int         span = c && c->name ? luaC_tracebegin(L, "register", c->name)
+                                    : -1;
+    if (span < 0) return classfromptr(L);
+
+    // register in a protected call, with only the descriptor on its stack
+    int top = lua_gettop(L);
+    lua_pushcfunction(L, classfromptr);
+    lua_insert(L, -2);
+    int status = lua_pcall(L, 1, LUA_MULTRET, 0);
+    luaC_traceend(L, span);
+    if (status != LUA_OK) lua_error(L);
+    return lua_gettop(L) - top + 1;
+}
+
+void luaC_register(lua_State *L, const char *name) {
+    // store in the active namespace, or with the loaded modules
+    if (!push_namespace(L)) {
+        lua_pop(L, 1);  // pop nil
+        lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    }
+    lua_insert(L, -2);  // put table behind class
+
+    const char *pos = strrchr(name, '.');
+
+    if (pos && strlen(pos + 1) > 0) {
+        lua_pushlstring(L, name, pos - name);
+        luaL_getsubtable(L, -3, lua_tostring(L, -1));  // get module table
+        lua_replace(L, -2);            // replace module name
+        lua_insert(L, -2);             // put module table behind class
+        lua_setfield(L, -2, pos + 1);  // t.module[name] = class
+        lua_pop(L, 1);                 // pop module table
+    } else lua_setfield(L, -2, name);  // t[name] = class
+
+    lua_pop(L, 1);  // pop namespace or package.loaded
+}
+
+// removes *name* from the table at the given index, both as a key and as a
+// field of the module table stored under its module name
+static void remove_name(lua_State *L, int idx, const char *name) {
+    idx = lua_absindex(L, idx);
+    lua_pushnil(L);
+    lua_setfield(L, idx, name);  // t[module?.name] = nil
+
+    // check for module table
+    const char *pos = strrchr(name, '.');
+
+    if (pos && strlen(pos + 1) > 0) {
+        lua_pushlstring(L, name, pos - name);
+
+        if (lua_gettable(L, idx) == LUA_TTABLE) {  // get module table
+            lua_pushnil(L);
+            lua_setfield(L, -2, pos + 1);  // t.module[name] = nil
+        }
+
+        lua_pop(L, 1);  // pop module table
+    }
+}
+
+void luaC_unregister(lua_State *L, const char *name) {
+    // within a namespace, only the namespace's own classes can be removed
+    int ns = push_namespace(L);
+    lua_pop(L, 1);
+
+    if (ns ? !push_nsclass(L, name)
+           : luaC_pushclass(L, name) != LUA_TTABLE) {
+        if (!ns) lua_pop(L, 1);  // pop nil
+        return;
+    }
+
+    lua_pushvalue(L, -1);
+
+    if (luaC_getreg(L) == LUA_TUSERDATA) {
+        lua_pushnil(L);
+        luaC_setreg(L);  // reg[uclass] = nil
+    } else lua_pop(L, 1);
+
+    lua_pushnil(L);
+    luaC_setreg(L);  // reg[class] = nil
+
+    if (ns) {
+        push_namespace(L);
+        remove_name(L, -1, name);
+    } else {
+        lua_pushnil(L);
+        luaC_setregfield(L, name);  // reg[module?.name] = nil
+        lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+        remove_name(L, -1, name);  // package.loaded[module?.name] = nil
+    }
+
+    lua_pop(L, 1);  // pop namespace or package.loaded
+}
+
+void luaC_pushnamespace(lua_State *L, const char *name) {
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, CLASSLIB_NS_KEY);
+    luaL_getsubtable(L, -1, name);
+    lua_remove(L, -2);  // remove namespace list
+}
+
+void luaC_setnamespace(lua_State *L, int idx) {
+    idx = lua_absindex(L, idx);
+    push_namespace(L);  // push previous namespace
+    if (lua_istable(L, idx)) lua_pushvalue(L, idx);
+    else lua_pushnil(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, CLASSLIB_ACTIVENS_KEY);
+}
+
+int luaC_beginscope(lua_State *L) {
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, CLASSLIB_SCOPES_KEY);
+    int depth = (int)lua_rawlen(L, -1) + 1;
+    lua_newtable(L);              // scope list
+    lua_rawseti(L, -2, depth);    // push it onto the scope stack
+    lua_pop(L, 1);                // pop scope stack
+    return depth;
+}
+
+int luaC_endscope(lua_State *L, int escaped) {
+    int top = lua_gettop(L), list = top + 2, ret = 0;
+    int depth = 0;
+
+    if (lua_getfield(L, LUA_REGISTRYINDEX, CLASSLIB_SCOPES_KEY) == LUA_TTABLE)
+        depth = (int)lua_rawlen(L, -1);
+
+    if (depth == 0) {
+        lua_settop(L, top);
+        if (escaped) lua_newtable(L);
+        return 0;
+    }
+
+    lua_rawgeti(L, -1, depth);  // get scope list
+    lua_pushnil(L);
+    lua_rawseti(L, -3, depth);  // pop it off the scope stack
+
+    // release objects in reverse order of construction
+    int n = (int)lua_rawlen(L, list);
+    for (int i = n; i > 0; i--) {
+        lua_rawgeti(L, list, i);
+        run_destructors(L, -1, 0);
+        mark_dead(L, -1);
+        lua_pop(L, 1);
+    }
+
+    if (escaped) {
+        // move the objects into a weak table and see what survives a cycle
+        lua_createtable(L, n, 0);
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "v");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+
+        for (int i = 1; i <= n; i++) {
+            lua_rawgeti(L, list, i);
+            lua_rawseti(L, -2, i);
+        }
+
+        lua_replace(L, list);  // drop the strong list
+        lua_gc(L, LUA_GCCOLLECT);
+        lua_newtable(L);  // escaped objects
+
+        for (int i = 1; i <= n; i++) {
+            if (lua_rawgeti(L, list, i) != LUA_TNIL)
+                lua_rawseti(L, -2, ++ret);
+            else lua_pop(L, 1);
+        }
+
+        lua_replace(L, top + 1);
+    }
+
+    lua_settop(L, escaped ? top + 1 : top);
+    return ret;
+}
+
+void luaC_fastclose(lua_State *L) {
+    get_state(L)->closing = 1;
+    lua_close(L);
+}
+
+void luaC_profilefinalizers(
+    lua_State         *L,
+    int                enable,
+    unsigned long long threshold,
+    luaC_SlowFinalizer slow,
+    void              *ud) {
+    classlib_state *st = get_state(L);
+    st->fin.enabled    = enable != 0;
+    st->fin.threshold  = threshold;
+    st->fin.slow       = slow;
+    st->fin.ud         = ud;
+}
+
+int luaC_getfinalizerstats(
+    lua_State           *L,
+    const luaC_Class    *c,
+    luaC_FinalizerStats *s) {
+    int top = lua_gettop(L), ret = 0;
+
+    if (lua_getfield(L, LUA_REGISTRYINDEX, CLASSLIB_FIN_KEY) == LUA_TTABLE &&
+        lua_rawgetp(L, -1, c) == LUA_TUSERDATA) {
+        memcpy(s, lua_touserdata(L, -1), sizeof(luaC_FinalizerStats));
+        ret = 1;
+    }
+
+    lua_settop(L, top);
+    return ret;
+}
+
+size_t
+luaC_snapshotfinalizers(lua_State *L, luaC_FinalizerStats *buf, size_t n) {
+    int    top = lua_gettop(L);
+    size_t ret = 0;
+
+    if (lua_getfield(L, LUA_REGISTRYINDEX, CLASSLIB_FIN_KEY) == LUA_TTABLE) {
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            if (ret < n)
+                memcpy(
+                    &buf[ret],
+                    lua_touserdata(L, -1),
+                    sizeof(luaC_FinalizerStats));
+            ret++;
+            lua_pop(L, 1);  // pop stats, keep key
+        }
+    }
+
+    lua_settop(L, top);
+    return ret;
+}
+
+// nesting limit when encoding and decoding JSON, which also catches cycles
+#define JSON_MAXDEPTH 200
+
+// a growable output buffer, freed by its __gc if encoding raises an error
+typedef struct {
+    char  *b;
+    size_t n, cap;
+} json_buffer;
+
+static int json_buffer_gc(lua_State *L) {
+    json_buffer *buf = lua_touserdata(L, 1);
+    free(buf->b);
+    buf->b = NULL;
+    return 0;
+}
+
+// pushes a new, empty buffer
+static json_buffer *json_newbuffer(lua_State *L) {
+    json_buffer *buf = lua_newuserdatauv(L, sizeof(json_buffer), 0);
+    memset(buf, 0, sizeof(json_buffer));
+
+    if (luaL_newmetatable(L, CLASSLIB_JSONBUF_KEY)) {
+        lua_pushcfunction(L, json_buffer_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+
+    lua_setmetatable(L, -2);
+    return buf;
+}
+
+// makes room for *n* more bytes and returns where they go
+static char *json_reserve(lua_State *L, json_buffer *buf, size_t n) {
+    if (buf->cap - buf->n < n) {
+        size_t cap = buf->cap ? buf->cap : 256;
+        while (cap - buf->n < n)
+            cap *= 2;
+
+        char *b = realloc(buf->b, cap);
+        if (!b) luaL_error(L, "not enough memory");
+        buf->b   = b;
+        buf->cap = cap;
+    }
+
+    return buf->b + buf->n;
+}
+
+static void json_add(lua_State *L, json_buffer *buf, const char *s, size_t n) {
+    memcpy(json_reserve(L, buf, n), s, n);
+    buf->n += n;
+}
+
+#define json_addliteral(L, buf, s) json_add((L), (buf), "" s, sizeof(s) - 1)
+
+typedef struct {
+    lua_State   *L;
+    json_buffer *buf;
+    const void  *mt;    // the metatable of the last object encoded
+    class_info  *info;  // and the library data of its class
+} json_encoder;
+
+static void json_addstring(json_encoder *e, const char *s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    char             *p     = json_reserve(e->L, e->buf, len * 6 + 2);
+
+    *p++ = '"';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            *p++ = (char)c;
+            continue;
+        }
+
+        *p++ = '\\';
+        switch (c) {
+            case '"':
+            case '\\':
+                *p++ = (char)c;
+                break;
+            case '\b':
+                *p++ = 'b';
+                break;
+            case '\f':
+                *p++ = 'f';
+                break;
+            case '\n':
+                *p++ = 'n';
+                break;
+            case '\r':
+                *p++ = 'r';
+                break;
+            case '\t':
+                *p++ = 't';
+                break;
+            default:
+                memcpy(p, "u00", 3);
+                p[3] = hex[c >> 4];
+                p[4] = hex[c & 15];
+                p += 5;
+        }
+    }
+    *p++ = '"';
+
+    e->buf->n = (size_t)(p - e->buf->b);
+}
+
+static void json_addnumber(json_encoder *e, lua_Number n) {
+    char s[40];
+    int  len;
+
+    if (isnan(n) || isinf(n)) luaL_error(e->L, "cannot encode %f", n);
+
+    // use the shortest precision that reads back the same
+    len = snprintf(s, sizeof(s), "%.15g", (double)n);
+    if (strtod(s, NULL) != n) len = snprintf(s, sizeof(s), "%.17g", (double)n);
+    if (!strpbrk(s, ".e")) len += snprintf(s + len, sizeof(s) - len, ".0");
+
+    json_add(e->L, e->buf, s, (size_t)len);
+}
+
+static void json_addinteger(json_encoder *e, lua_Integer i) {
+    char s[32];
+    int  len = snprintf(s, sizeof(s), "%lld", (long long)i);
+    json_add(e->L, e->buf, s, (size_t)len);
+}
+
+// adds a separator if needed, then the key
+static void
+json_addkey(json_encoder *e, const char *k, size_t len, int *first) {
+    if (!*first) json_addliteral(e->L, e->buf, ",");
+    *first = 0;
+    json_addstring(e, k, len);
+    json_addliteral(e->L, e->buf, ":");
+}
+
+static void json_encode(json_encoder *e, int idx, int depth);
+
+// adds the string keyed entries of the table at index *t*
+static void json_encode_pairs(json_encoder *e, int t, int *first, int depth) {
+    lua_State *L = e->L;
+    size_t     len;
+
+    lua_pushnil(L);
+    while (lua_next(L, t)) {
+        if (lua_type(L, -2) != LUA_TSTRING)
+            luaL_error(L, "cannot encode key of type %s", luaL_typename(L, -2));
+
+        const char *k = lua_tolstring(L, -2, &len);
+        json_addkey(e, k, len, first);
+        json_encode(e, lua_gettop(L), depth + 1);
+        lua_pop(L, 1);  // pop value
+    }
+}
+
+// adds the declared fields of the user data *p* at index *idx*, for the
+// classes starting from *layout*, base first
+static void json_encode_fields(
+    json_encoder *e,
+    int           idx,
+    const char   *p,
+    class_info   *layout,
+    int          *first,
+    int           depth) {
+    lua_State *L = e->L;
+    if (!layout) return;
+
+    json_encode_fields(e, idx, p, layout->lnext, first, depth);
+
+    for (const luaC_Field *f = layout->uclass->fields; f->name; f++) {
+        int uv = f->type == LUAC_FIELD_STRING || f->type == LUAC_FIELD_VALUE;
+
+        if (uv && lua_getiuservalue(L, idx, (int)f->offset) == LUA_TNIL) {
+            lua_pop(L, 1);
+            continue;  // nil fields are left out, like nil table entries
+        }
+
+        json_addkey(e, f->name, strlen(f->name), first);
+
+        switch (f->type) {
+            case LUAC_FIELD_NUMBER:
+                json_addnumber(e, *(const lua_Number *)(p + f->offset));
+                break;
+            case LUAC_FIELD_INTEGER:
+                json_addinteger(e, *(const lua_Integer *)(p + f->offset));
+                break;
+            case LUAC_FIELD_BOOLEAN:
+                if (*(const int *)(p + f->offset))
+                    json_addliteral(L, e->buf, "true");
+                else json_addliteral(L, e->buf, "false");
+                break;
+            default:
+                json_encode(e, lua_gettop(L), depth + 1);
+                lua_pop(L, 1);  // pop user value
+        }
+    }
+}
+
+// gets the library data of the class of the object at the given index, or
+// NULL. sets *object* to whether the value is an object.
+static class_info *json_classinfo(json_encoder *e, int idx, int *object) {
+    lua_State *L = e->L;
+    *object      = 0;
+
+    if (!lua_getmetatable(L, idx)) return NULL;
+
+    const void *mt = lua_topointer(L, -1);
+    if (mt == e->mt) {
+        lua_pop(L, 1);
+        *object = 1;
+        return e->info;
+    }
+
+    // objects have their class base as their metatable
+    lua_pushliteral(L, "__class");
+    if (lua_rawget(L, -2) == LUA_TTABLE) {
+        *object = 1;
+        e->mt   = mt;
+        e->info = get_info(L, -1);
+    }
+
+    lua_pop(L, 2);  // pop class and metatable
+    return *object ? e->info : NULL;
+}
+
+static void json_encode_object(
+    json_encoder *e,
+    int           idx,
+    class_info   *info,
+    int           depth) {
+    lua_State *L     = e->L;
+    int        first = 1;
+
+    json_addliteral(L, e->buf, "{");
+
+    if (lua_type(L, idx) == LUA_TUSERDATA) {
+        if (info && info->layout)
+            json_encode_fields(
+                e,
+                idx,
+                lua_touserdata(L, idx),
+                info->layout,
+                &first,
+                depth);
+        lua_getiuservalue(L, idx, 1);
+    } else lua_pushvalue(L, idx);
+
+    if (lua_istable(L, -1)) json_encode_pairs(e, lua_gettop(L), &first, depth);
+    lua_pop(L, 1);  // pop user value table
+
+    json_addliteral(L, e->buf, "}");
+}
+
+// whether the keys of the table at index *t* are exactly 1 to *n*
+static int json_isarray(lua_State *L, int t, lua_Unsigned n) {
+    lua_Unsigned count = 0;
+
+    lua_pushnil(L);
+    while (lua_next(L, t)) {
+        lua_pop(L, 1);  // pop value
+        lua_Integer k = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 0;
+        if (k < 1 || (lua_Unsigned)k > n) {
+            lua_pop(L, 1);  // pop key
+            return 0;
+        }
+        count++;
+    }
+
+    return count == n;
+}
+
+static void json_encode_table(json_encoder *e, int t, int depth) {
+    lua_State   *L = e->L;
+    lua_Unsigned n = lua_rawlen(L, t);
+
+    if (n > 0 && json_isarray(L, t, n)) {
+        json_addliteral(L, e->buf, "[");
+        for (lua_Unsigned i = 1; i <= n; i++) {
+            if (i > 1) json_addliteral(L, e->buf, ",");
+            lua_rawgeti(L, t, (lua_Integer)i);
+            json_encode(e, lua_gettop(L), depth + 1);
+            lua_pop(L, 1);
+        }
+        json_addliteral(L, e->buf, "]");
+    } else {
+        int first = 1;
+        json_addliteral(L, e->buf, "{");
+        json_encode_pairs(e, t, &first, depth);
+        json_addliteral(L, e->buf, "}");
+    }
+}
+
+static void json_encode(json_encoder *e, int idx, int depth) {
+    lua_State  *L = e->L;
+    class_info *info;
+    int         object;
+    size_t      len;
+
+    if (depth > JSON_MAXDEPTH)
+        luaL_error(L, "cannot encode more than %d levels", JSON_MAXDEPTH);
+    luaL_checkstack(L, 4, "too many nested values");
+
+    switch (lua_type(L, idx)) {
+        case LUA_TNIL:
+            json_addliteral(L, e->buf, "null");
+            break;
+        case LUA_TBOOLEAN:
+            if (lua_toboolean(L, idx)) json_addliteral(L, e->buf, "true");
+            else json_addliteral(L, e->buf, "false");
+            break;
+        case LUA_TNUMBER:
+            if (lua_isinteger(L, idx)) json_addinteger(e, lua_tointeger(L, idx));
+            else json_addnumber(e, lua_tonumber(L, idx));
+            break;
+        case LUA_TSTRING: {
+            const char *s = lua_tolstring(L, idx, &len);
+            json_addstring(e, s, len);
+            break;
+        }
+        case LUA_TTABLE:
+            info = json_classinfo(e, idx, &object);
+            if (object) json_encode_object(e, idx, info, depth);
+            else json_encode_table(e, idx, depth);
+            break;
+        case LUA_TUSERDATA:
+            info = json_classinfo(e, idx, &object);
+            if (object) {
+                json_encode_object(e, idx, info, depth);
+                break;
+            }
+            // fall through
+        default:
+            luaL_error(L, "cannot encode %s", luaL_typename(L, idx));
+    }
+}
+
+void luaC_tojson(lua_State *L, int idx) {
+    json_encoder e = {L, NULL, NULL, NULL};
+    idx            = lua_absindex(L, idx);
+    e.buf          = json_newbuffer(L);
+
+    json_encode(&e, idx, 0);
+    lua_pushlstring(L, e.buf->b, e.buf->n);
+    lua_remove(L, -2);  // remove buffer
+}
+
+typedef struct {
+    lua_State   *L;
+    const char  *s, *p, *end;  // the document, the position, and the end
+    const char  *err;          // what went wrong, if anything
+    int          cls;          // the index of the class to construct, or 0
+    class_info  *info;         // the library data of the class
+    int          depth;
+} json_decoder;
+
+// sets the error and returns 0
+static int json_fail(json_decoder *d, const char *err) {
+    d->err = err;
+    return 0;
+}
+
+static void json_skipspace(json_decoder *d) {
+    while (d->p < d->end &&
+           (*d->p == ' ' || *d->p == '\t' || *d->p == '\n' || *d->p == '\r'))
+        d->p++;
+}
+
+static int json_hex4(const char *p, unsigned *cp) {
+    *cp = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        *cp <<= 4;
+        if (c >= '0' && c <= '9') *cp |= (unsigned)(c - '0');
+        else if (c >= 'a' && c <= 'f') *cp |= (unsigned)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') *cp |= (unsigned)(c - 'A' + 10);
+        else return 0;
+    }
+    return 1;
+}
+
+// decodes the escape sequence after a backslash into the buffer
+static int json_escape(json_decoder *d, luaL_Buffer *b) {
+    unsigned cp, lo;
+    char     u[4];
+    int      n;
+
+    if (d->p >= d->end) return json_fail(d, "unterminated string");
+
+    switch (*d->p++) {
+        case '"':
+            luaL_addchar(b, '"');
+            return 1;
+        case '\\':
+            luaL_addchar(b, '\\');
+            return 1;
+        case '/':
+            luaL_addchar(b, '/');
+            return 1;
+        case 'b':
+            luaL_addchar(b, '\b');
+            return 1;
+        case 'f':
+            luaL_addchar(b, '\f');
+            return 1;
+        case 'n':
+            luaL_addchar(b, '\n');
+            return 1;
+        case 'r':
+            luaL_addchar(b, '\r');
+            return 1;
+        case 't':
+            luaL_addchar(b, '\t');
+            return 1;
+        case 'u':
+            break;
+        default:
+            return json_fail(d, "invalid escape");
+    }
+
+    if (d->end - d->p < 4 || !json_hex4(d->p, &cp))
+        return json_fail(d, "invalid unicode escape");
+    d->p += 4;
+
+    if (cp >= 0xd800 && cp <= 0xdbff) {  // high surrogate, expect a low one
+        if (d->end - d->p >= 6 && d->p[0] == '\\' && d->p[1] == 'u' &&
+            json_hex4(d->p + 2, &lo) && lo >= 0xdc00 && lo <= 0xdfff) {
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            d->p += 6;
+        } else cp = 0xfffd;
+    } else if (cp >= 0xdc00 && cp <= 0xdfff) cp = 0xfffd;
+
+    if (cp < 0x80) {
+        u[0] = (char)cp;
+        n    = 1;
+    } else if (cp < 0x800) {
+        u[0] = (char)(0xc0 | (cp >> 6));
+        u[1] = (char)(0x80 | (cp & 0x3f));
+        n    = 2;
+    } else if (cp < 0x10000) {
+        u[0] = (char)(0xe0 | (cp >> 12));
+        u[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        u[2] = (char)(0x80 | (cp & 0x3f));
+        n    = 3;
+    } else {
+        u[0] = (char)(0xf0 | (cp >> 18));
+        u[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+        u[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        u[3] = (char)(0x80 | (cp & 0x3f));
+        n    = 4;
+    }
+
+    luaL_addlstring(b, u, (size_t)n);
+    return 1;
+}
 
-        // set derived instance __newindex
-        lua_pushstring(L, "__newindex");
-        lua_pushcfunction(L, classlib_rawset);
-        lua_rawset(L, base);
+// parses the string at the current position. if it has no escapes, points *s*
+// at its bytes in the document and pushes nothing. otherwise pushes the
+// decoded string, points *s* at it, and sets *pushed*.
+static int
+json_string(json_decoder *d, const char **s, size_t *len, int *pushed) {
+    const char *start = ++d->p;
+    luaL_Buffer b;
+
+    *pushed = 0;
+    while (d->p < d->end && *d->p != '"' && *d->p != '\\') {
+        if ((unsigned char)*d->p < 0x20)
+            return json_fail(d, "control character in string");
+        d->p++;
+    }
 
-        // set __class metafield
-        // NOTE: we really shouldn't have to do this, it should be done by
-        // moonscript?
-        lua_pushstring(L, "__class");
-        lua_pushvalue(L, 2);
-        lua_rawset(L, base);
+    if (d->p >= d->end) return json_fail(d, "unterminated string");
 
-        // set derived instance __gc
-        lua_pushstring(L, "__gc");
-        lua_pushcfunction(L, default_udata_gc);
-        lua_rawset(L, base);
+    if (*d->p == '"') {
+        *s   = start;
+        *len = (size_t)(d->p++ - start);
+        return 1;
     }
 
-    lua_settop(L, 2);  // clean up
+    luaL_buffinit(d->L, &b);
+    luaL_addlstring(&b, start, (size_t)(d->p - start));
 
-    // call encapsulated __inherited method
-    lua_pushvalue(L, lua_upvalueindex(1));
-    if (lua_isfunction(L, -1)) {
-        lua_insert(L, 1);
-        lua_call(L, 2, LUA_MULTRET);
-        return lua_gettop(L);
+    while (d->p < d->end && *d->p != '"') {
+        if (*d->p == '\\') {
+            d->p++;
+            if (!json_escape(d, &b)) return 0;
+        } else if ((unsigned char)*d->p < 0x20)
+            return json_fail(d, "control character in string");
+        else luaL_addchar(&b, *d->p++);
     }
 
-    return 0;
+    if (d->p >= d->end) return json_fail(d, "unterminated string");
+    d->p++;
+
+    luaL_pushresult(&b);
+    *s      = lua_tolstring(d->L, -1, len);
+    *pushed = 1;
+    return 1;
 }
 
-int luaC_classfromptr(lua_State *L) {
-    int         uclass = lua_gettop(L);
-    luaC_Class *c      = lua_touserdata(L, uclass);
+static int json_number(json_decoder *d) {
+    const char *start = d->p;
+    char        s[64];
+
+    if (*d->p == '-') d->p++;
+    if (d->p >= d->end || *d->p < '0' || *d->p > '9')
+        return json_fail(d, "invalid value");
+
+    if (*d->p == '0') d->p++;
+    else
+        while (d->p < d->end && *d->p >= '0' && *d->p <= '9')
+            d->p++;
+
+    if (d->p < d->end && *d->p == '.') {
+        d->p++;
+        if (d->p >= d->end || *d->p < '0' || *d->p > '9')
+            return json_fail(d, "invalid number");
+        while (d->p < d->end && *d->p >= '0' && *d->p <= '9')
+            d->p++;
+    }
 
-    if (!c || !c->name) return 0;
+    if (d->p < d->end && (*d->p == 'e' || *d->p == 'E')) {
+        d->p++;
+        if (d->p < d->end && (*d->p == '+' || *d->p == '-')) d->p++;
+        if (d->p >= d->end || *d->p < '0' || *d->p > '9')
+            return json_fail(d, "invalid number");
+        while (d->p < d->end && *d->p >= '0' && *d->p <= '9')
+            d->p++;
+    }
 
-    lua_pushvalue(L, uclass);
+    size_t len = (size_t)(d->p - start);
+    if (len >= sizeof(s)) return json_fail(d, "number too long");
+    memcpy(s, start, len);
+    s[len] = '\0';
 
-    if (luaC_getreg(L) != LUA_TNIL) {
-        lua_pop(L, 1);
-        return 1;
+    // integers that do not fit become floats, as in Lua
+    if (!lua_stringtonumber(d->L, s)) return json_fail(d, "invalid number");
+    return 1;
+}
+
+static int json_literal(json_decoder *d, const char *lit, size_t len) {
+    if ((size_t)(d->end - d->p) < len || memcmp(d->p, lit, len) != 0)
+        return json_fail(d, "invalid value");
+    d->p += len;
+    return 1;
+}
+
+static int json_value(json_decoder *d, int instance);
+
+// finds the declared field named by the *len* bytes at *k*, in the classes
+// starting from *layout*
+static const luaC_Field *
+json_findfield(class_info *layout, const char *k, size_t len) {
+    for (; layout; layout = layout->lnext)
+        for (const luaC_Field *f = layout->uclass->fields; f->name; f++)
+            if (strncmp(f->name, k, len) == 0 && f->name[len] == '\0')
+                return f;
+    return NULL;
+}
+
+// stores the value at the top of the stack in the declared field *f* of the
+// user data at index *idx*, and pops it
+static int json_setfield(json_decoder *d, int idx, const luaC_Field *f) {
+    lua_State *L = d->L;
+    char      *p = lua_touserdata(L, idx);
+
+    switch (f->type) {
+        case LUAC_FIELD_NUMBER:
+            if (lua_type(L, -1) != LUA_TNUMBER)
+                return json_fail(d, "number field expects a number");
+            *(lua_Number *)(p + f->offset) = lua_tonumber(L, -1);
+            break;
+        case LUAC_FIELD_INTEGER:
+            if (!lua_isinteger(L, -1))
+                return json_fail(d, "integer field expects an integer");
+            *(lua_Integer *)(p + f->offset) = lua_tointeger(L, -1);
+            break;
+        case LUAC_FIELD_BOOLEAN:
+            if (lua_type(L, -1) != LUA_TBOOLEAN)
+                return json_fail(d, "boolean field expects a boolean");
+            *(int *)(p + f->offset) = lua_toboolean(L, -1);
+            break;
+        case LUAC_FIELD_STRING:
+            if (lua_type(L, -1) != LUA_TSTRING && !lua_isnil(L, -1))
+                return json_fail(d, "string field expects a string");
+            // fall through
+        default:
+            lua_setiuservalue(L, idx, (int)f->offset);
+            return 1;
     }
 
     lua_pop(L, 1);
+    return 1;
+}
 
-    lua_newtable(L);                  // base table
-    luaL_setfuncs(L, c->methods, 0);  // load in methods
-    lua_newtable(L);                  // class table
-    lua_newtable(L);                  // class metatable
-    int class_mt       = lua_gettop(L);
-    int class          = class_mt - 1;
-    int base           = class - 1;
+static int json_object(json_decoder *d, int instance) {
+    lua_State  *L      = d->L;
+    class_info *layout = NULL;
+    int         obj, target;
+
+    if (instance) {
+        if (!new_instance(L, d->cls, d->info))
+            return json_fail(d, "class has no base");
+        count_construction(d->info);
+        obj = lua_gettop(L);
+
+        if (lua_type(L, obj) == LUA_TUSERDATA) {
+            layout = d->info ? d->info->layout : NULL;
+            lua_getiuservalue(L, obj, 1);
+        } else lua_pushvalue(L, obj);
+    } else {
+        lua_newtable(L);
+        obj = lua_gettop(L);
+        lua_pushvalue(L, obj);
+    }
+    target = lua_gettop(L);
 
-    // find init function
-    lua_CFunction init = default_init;
-    lua_pushnil(L);  // first key
+    d->p++;
+    json_skipspace(d);
+    if (d->p < d->end && *d->p == '}') {
+        d->p++;
+        lua_settop(L, obj);
+        return 1;
+    }
 
-    while (lua_next(L, base) != 0) {  // push next key/value pair in base
-        if ((strcmp(lua_tostring(L, -2), "new") == 0) &&
-            lua_iscfunction(L, -1)) {       // compare key to "new"
-            init = lua_tocfunction(L, -1);  // grab the value as a func
-            lua_pop(L, 1);                  // pop the value
-            lua_pushnil(L);                 // push nil
-            lua_rawset(L, base);            // (un)set "new" on base
-            break;                          // and break
+    for (;;) {
+        const char       *k;
+        size_t            len;
+        int               pushed;
+        const luaC_Field *f;
+
+        if (d->p >= d->end || *d->p != '"') return json_fail(d, "expected key");
+        if (!json_string(d, &k, &len, &pushed)) return 0;
+
+        json_skipspace(d);
+        if (d->p >= d->end || *d->p != ':') return json_fail(d, "expected ':'");
+        d->p++;
+        json_skipspace(d);
+
+        if (layout && (f = json_findfield(layout, k, len))) {
+            if (pushed) lua_pop(L, 1);  // the key is not needed
+            if (!json_value(d, 0) || !json_setfield(d, obj, f)) return 0;
+        } else {
+            if (!pushed) lua_pushlstring(L, k, len);
+            if (!json_value(d, 0)) return 0;
+            lua_rawset(L, target);
         }
-        lua_pop(L, 1);  // otherwise pop the value, leaving the key
+
+        json_skipspace(d);
+        if (d->p < d->end && *d->p == ',') {
+            d->p++;
+            json_skipspace(d);
+        } else if (d->p < d->end && *d->p == '}') {
+            d->p++;
+            break;
+        } else return json_fail(d, "expected ',' or '}'");
     }
 
-    lua_pushcfunction(L, init);
-    lua_setfield(L, class, "__init");  // set class __init
-    lua_pushvalue(L, base);
-    lua_setfield(L, class, "__base");  // set class __base
-    lua_pushstring(L, c->name);
-    lua_setfield(L, class, "__name");  // set class __name
-    lua_pushcfunction(L, default_class_inherited);
-    lua_setfield(L, class, "__inherited");  // set class __inherited
+    lua_settop(L, obj);
+    return 1;
+}
 
-    lua_pushvalue(L, class);
-    lua_setfield(L, base, "__class");  // set base __class
+static int json_array(json_decoder *d, int instances) {
+    lua_State  *L = d->L;
+    lua_Integer n = 0;
 
-    if (c->alloc) {
-        lua_pushvalue(L, base);
-        lua_pushcclosure(L, default_udata_index, 1);
-        lua_setfield(L, base, "__index");  // set base __index
-        lua_pushcfunction(L, classlib_rawset);
-        lua_setfield(L, base, "__newindex");  // set base __newindex
-        lua_pushcfunction(L, default_udata_gc);
-        lua_setfield(L, base, "__gc");  // set base __gc
-    } else {
-        lua_pushvalue(L, base);
-        lua_setfield(L, base, "__index");  // set base __index to self
+    lua_newtable(L);
+    d->p++;
+    json_skipspace(d);
+    if (d->p < d->end && *d->p == ']') {
+        d->p++;
+        return 1;
     }
 
-    // handle constructor
-    if (c->user_ctor) {
-        lua_pushcfunction(L, default_class_call);
-        lua_setfield(L, class_mt, "__call");  // set meta __call
+    for (;;) {
+        if (!json_value(d, instances)) return 0;
+        lua_rawseti(L, -2, ++n);
+
+        json_skipspace(d);
+        if (d->p < d->end && *d->p == ',') {
+            d->p++;
+            json_skipspace(d);
+        } else if (d->p < d->end && *d->p == ']') {
+            d->p++;
+            return 1;
+        } else return json_fail(d, "expected ',' or ']'");
     }
+}
 
-    // handle inheritance
-    if (c->parent == NULL) {                   // no parent
-        lua_pushvalue(L, base);                // push base
-        lua_setfield(L, class_mt, "__index");  // set meta __index to base
-    } else if (luaC_pushclass(L, c->parent) == LUA_TTABLE) {  // get parent
-        lua_pushvalue(L, base);                               // push base
-        lua_pushcclosure(L, default_class_index, 1);  // wrap it in a closure
-        lua_setfield(L, class_mt, "__index");         // set meta __index
-        lua_getfield(L, -1, "__base");                // get parent __base
-        lua_setmetatable(L, base);  // set base metatable to parent base
-        lua_setfield(L, class, "__parent");  // set class __parent to parent
-    } else {                                 // else parent not registered
-        lua_pop(L, 4);                       // clean up and return
-        lua_remove(L, uclass);
-        return 0;
+// decodes the value at the current position and pushes it. objects are made
+// instances of the class if *instance* is set.
+static int json_value(json_decoder *d, int instance) {
+    const char *s;
+    size_t      len;
+    int         pushed, ok;
+
+    if (d->p >= d->end) return json_fail(d, "unexpected end of input");
+    if (!lua_checkstack(d->L, 4)) return json_fail(d, "too many nested values");
+
+    switch (*d->p) {
+        case '{':
+        case '[':
+            if (++d->depth > JSON_MAXDEPTH) return json_fail(d, "nested too deep");
+            ok = *d->p == '{' ? json_object(d, instance) : json_array(d, 0);
+            d->depth--;
+            return ok;
+        case '"':
+            if (!json_string(d, &s, &len, &pushed)) return 0;
+            if (!pushed) lua_pushlstring(d->L, s, len);
+            return 1;
+        case 't':
+            lua_pushboolean(d->L, 1);
+            return json_literal(d, "true", 4);
+        case 'f':
+            lua_pushboolean(d->L, 0);
+            return json_literal(d, "false", 5);
+        case 'n':
+            lua_pushnil(d->L);
+            return json_literal(d, "null", 4);
+        default:
+            return json_number(d);
     }
+}
 
-    lua_setmetatable(L, class);  // set class metatable
+int luaC_fromjson(
+    lua_State  *L,
+    const char *json,
+    size_t      len,
+    const char *name) {
+    json_decoder d   = {L, json, json, json + len, NULL, 0, NULL, 0};
+    int          top = lua_gettop(L), ok;
+
+    if (name) {
+        if (luaC_pushclass(L, name) != LUA_TTABLE) {
+            lua_settop(L, top);
+            lua_pushfstring(L, "Class %s is not registered.", name);
+            return 0;
+        }
+        d.cls  = top + 1;
+        d.info = get_info(L, d.cls);
+    }
 
-    if (luaC_getparent(L, class)) {
-        if (lua_getfield(L, -1, "__inherited") != LUA_TNIL) {
-            lua_insert(L, -2);        // put inherited behind parent
-            lua_pushvalue(L, class);  // push our (derived) class
-            lua_call(L, 2, 0);        // call inherited
-        } else lua_pop(L, 2);         // else pop nil and parent
-    } else lua_pop(L, 1);             // else pop nil
+    json_skipspace(&d);
 
-    lua_pushvalue(L, class);
-    lua_pushvalue(L, uclass);
-    luaC_setreg(L);  // reg[class] = uclass
-    lua_pushvalue(L, uclass);
-    lua_pushvalue(L, class);
-    luaC_setreg(L);  // reg[uclass] = class
+    // the class applies to the objects in a top level array
+    if (name && d.p < d.end && *d.p == '[') {
+        d.depth = 1;
+        ok      = json_array(&d, 1);
+    } else ok = json_value(&d, name != NULL);
 
-    lua_remove(L, base);    // remove base from stack
-    lua_remove(L, uclass);  // remove uclass from stack
+    if (ok) {
+        json_skipspace(&d);
+        if (d.p < d.end) ok = json_fail(&d, "unexpected data after value");
+    }
+
+    if (!ok) {
+        lua_settop(L, top);
+        lua_pushfstring(L, "%s at byte %d", d.err, (int)(d.p - d.s) + 1);
+        return 0;
+    }
+
+    if (name) lua_remove(L, d.cls);
     return 1;
 }
 
-void luaC_unregister(lua_State *L, const char *name) {
-    if (luaC_pushclass(L, name) == LUA_TTABLE) {
-        lua_pushvalue(L, -1);
+// the deferred call queue holds the keys in the order they were queued at
+// index 1, and maps each key to its pending call at index 2. a pending call is
+// a table holding the function and its arguments, with field `n` set to their
+// count, and field `acc` set if it accumulates.
+void luaC_defer(lua_State *L, int nargs, int mode) {
+    int func = lua_absindex(L, -(nargs + 1)), key = func + 1;
+
+    if (nargs < 1 || lua_isnil(L, key))
+        luaL_error(L, "Deferred call has no key.");
+
+    if (!luaL_getsubtable(L, LUA_REGISTRYINDEX, CLASSLIB_DEFER_KEY)) {
+        lua_newtable(L);
+        lua_rawseti(L, -2, 1);
+        lua_newtable(L);
+        lua_rawseti(L, -2, 2);
+    }
+
+    int queue = lua_gettop(L), pending = queue + 1;
+    lua_rawgeti(L, queue, 2);
+    lua_pushvalue(L, key);
+
+    if (lua_rawget(L, pending) == LUA_TNIL) {  // first call with this key
+        lua_rawgeti(L, queue, 1);
+        lua_pushvalue(L, key);
+        lua_rawseti(L, -2, (lua_Integer)lua_rawlen(L, -2) + 1);
+        lua_pop(L, 1);  // pop key list
+    } else if (mode == LUAC_DEFER_ACCUMULATE) {
+        int acc = lua_getfield(L, -1, "acc") != LUA_TNIL;
+        lua_pop(L, 1);
 
-        if (luaC_getreg(L) == LUA_TUSERDATA) {
+        if (!acc) {  // replace a last-wins call with a new list
+            lua_pop(L, 1);
             lua_pushnil(L);
-            luaC_setreg(L);  // reg[uclass] = nil
         }
+    }
 
-        lua_pushnil(L);
-        luaC_setreg(L);  // reg[class] = nil
-        lua_pushnil(L);
-        luaC_setregfield(L, name);  // reg[module?.name] = nil
-        lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
-        lua_pushnil(L);
-        lua_setfield(L, -2, name);  // package.loaded[module?.name] = nil
+    if (mode == LUAC_DEFER_ACCUMULATE) {
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            lua_createtable(L, 3, 2);
+            lua_pushvalue(L, func);
+            lua_rawseti(L, -2, 1);
+            lua_pushvalue(L, key);
+            lua_rawseti(L, -2, 2);
+            lua_newtable(L);
+            lua_rawseti(L, -2, 3);
+            lua_pushinteger(L, 3);
+            lua_setfield(L, -2, "n");
+            lua_pushboolean(L, 1);
+            lua_setfield(L, -2, "acc");
+            lua_pushvalue(L, key);
+            lua_pushvalue(L, -2);
+            lua_rawset(L, pending);  // pending[key] = call
+        }
 
-        // check for module table
-        const char *pos = strrchr(name, '.');
+        // append the arguments to the list
+        lua_rawgeti(L, -1, 3);
+        lua_createtable(L, nargs - 1, 1);
+        for (int i = 1; i < nargs; i++) {
+            lua_pushvalue(L, key + i);
+            lua_rawseti(L, -2, i);
+        }
+        lua_pushinteger(L, nargs - 1);
+        lua_setfield(L, -2, "n");
+        lua_rawseti(L, -2, (lua_Integer)lua_rawlen(L, -2) + 1);
+    } else {
+        lua_createtable(L, nargs + 1, 1);
+        for (int i = 0; i <= nargs; i++) {
+            lua_pushvalue(L, func + i);
+            lua_rawseti(L, -2, i + 1);
+        }
+        lua_pushinteger(L, nargs + 1);
+        lua_setfield(L, -2, "n");
+        lua_pushvalue(L, key);
+        lua_insert(L, -2);
+        lua_rawset(L, pending);  // pending[key] = call
+    }
 
-        if (pos && strlen(pos + 1) > 0) {
-            lua_pushlstring(L, name, pos - name);
+    lua_settop(L, func - 1);
+}
 
-            if (lua_gettable(L, -2) == LUA_TTABLE) {  // get module table
-                lua_pushnil(L);
-                // package.loaded.module[name] = nil
-                lua_setfield(L, -2, pos + 1);
-            }
+int luaC_flush(lua_State *L) {
+    int top = lua_gettop(L), queue = top + 1, keys = top + 2, ret = 0;
+
+    if (lua_getfield(L, LUA_REGISTRYINDEX, CLASSLIB_DEFER_KEY) != LUA_TTABLE) {
+        lua_settop(L, top);
+        return 0;
+    }
+
+    // calls queued from here on go to a new queue
+    lua_pushnil(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, CLASSLIB_DEFER_KEY);
+    lua_rawgeti(L, queue, 1);
+    lua_rawgeti(L, queue, 2);
+    lua_Integer len = (lua_Integer)lua_rawlen(L, keys);
+
+    for (lua_Integer i = 1; i <= len; i++) {
+        lua_rawgeti(L, keys, i);
+        lua_rawget(L, keys + 1);  // get the pending call
+        lua_getfield(L, -1, "n");
+        int n = (int)lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        luaL_checkstack(L, n, "too many deferred arguments");
+        for (int j = 1; j <= n; j++)
+            lua_rawgeti(L, -j, j);
+        lua_call(L, n - 1, 0);
+        lua_pop(L, 1);  // pop the pending call
+        ret++;
+    }
+
+    lua_settop(L, top);
+    return ret;
+}
+
+// the dirty set holds the dirty objects in the order they were marked at index
+// 1, and maps each of them to true at index 2.
+void luaC_markdirty(lua_State *L, int idx) {
+    idx = lua_absindex(L, idx);
+
+    if (!luaL_getsubtable(L, LUA_REGISTRYINDEX, CLASSLIB_DIRTY_KEY)) {
+        lua_newtable(L);
+        lua_rawseti(L, -2, 1);
+        lua_newtable(L);
+        lua_rawseti(L, -2, 2);
+    }
 
-            lua_pop(L, 1);  // pop module table
+    lua_rawgeti(L, -1, 2);
+    lua_pushvalue(L, idx);
+    if (lua_rawget(L, -2) == LUA_TNIL) {  // not yet dirty
+        lua_pushvalue(L, idx);
+        lua_pushboolean(L, 1);
+        lua_rawset(L, -4);  // set[obj] = true
+        lua_rawgeti(L, -3, 1);
+        lua_pushvalue(L, idx);
+        lua_rawseti(L, -2, (lua_Integer)lua_rawlen(L, -2) + 1);
+        lua_pop(L, 1);  // pop list
+    }
+    lua_pop(L, 3);
+}
+
+int luaC_isdirty(lua_State *L, int idx) {
+    int ret = 0;
+    idx     = lua_absindex(L, idx);
+
+    if (lua_getfield(L, LUA_REGISTRYINDEX, CLASSLIB_DIRTY_KEY) == LUA_TTABLE) {
+        lua_rawgeti(L, -1, 2);
+        lua_pushvalue(L, idx);
+        ret = lua_rawget(L, -2) != LUA_TNIL;
+        lua_pop(L, 2);
+    }
+
+    lua_pop(L, 1);
+    return ret;
+}
+
+int luaC_pushdirty(lua_State *L, int clear) {
+    if (lua_getfield(L, LUA_REGISTRYINDEX, CLASSLIB_DIRTY_KEY) != LUA_TTABLE) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        return 0;
+    }
+
+    lua_rawgeti(L, -1, 1);
+    int len = (int)lua_rawlen(L, -1);
+
+    if (clear) {  // hand over the list and start a new set
+        lua_pushnil(L);
+        lua_setfield(L, LUA_REGISTRYINDEX, CLASSLIB_DIRTY_KEY);
+    } else {  // copy the list
+        lua_createtable(L, len, 0);
+        for (int i = 1; i <= len; i++) {
+            lua_rawgeti(L, -2, i);
+            lua_rawseti(L, -2, i);
         }
+        lua_remove(L, -2);
     }
-    lua_pop(L, 1);  // pop nil or package.loaded
+
+    lua_remove(L, -2);
+    return len;
 }
 
 void luaC_setinheritcb(lua_State *L, int idx, lua_CFunction cb) {
@@ -631,16 +3708,229 @@ int luaC_newclass(
     cls->alloc      = NULL;
     cls->gc         = NULL;
     cls->methods    = methods;
+    cls->flags      = 0;
+    cls->size       = 0;
+    cls->nuv        = 0;
+    cls->fields     = NULL;
     return luaC_classfromptr(L);
 }
 
+static int classlib_beginscope(lua_State *L) {
+    lua_pushinteger(L, luaC_beginscope(L));
+    return 1;
+}
+
+static int classlib_startupreport(lua_State *L) {
+    static const char *const formats[] = {"text", "json", NULL};
+    luaC_startupreport(L, luaL_checkoption(L, 1, "text", formats));
+    return 1;
+}
+
+static int classlib_markdirty(lua_State *L) {
+    luaL_checkany(L, 1);
+    luaC_markdirty(L, 1);
+    return 0;
+}
+
+static int classlib_dirty(lua_State *L) {
+    luaC_pushdirty(L, lua_toboolean(L, 1));
+    return 1;
+}
+
+static int classlib_namespace(lua_State *L) {
+    luaC_pushnamespace(L, luaL_checkstring(L, 1));
+    return 1;
+}
+
+static int classlib_usenamespace(lua_State *L) {
+    if (!lua_isnoneornil(L, 1)) luaL_checktype(L, 1, LUA_TTABLE);
+    luaC_setnamespace(L, 1);
+    return 1;
+}
+
+// slow finalizer callback for lcl.profilefinalizers. calls the Lua callback
+// with the class name and duration, ignoring errors since it runs during
+// garbage collection.
+static void slow_finalizer_lua(
+    lua_State         *L,
+    const luaC_Class  *c,
+    unsigned long long ns,
+    void              *ud) {
+    UNUSED(ud);
+    int top = lua_gettop(L);
+
+    if (lua_getfield(L, LUA_REGISTRYINDEX, CLASSLIB_SLOWFIN_KEY) ==
+        LUA_TFUNCTION) {
+        lua_pushstring(L, c->name);
+        lua_pushinteger(L, (lua_Integer)ns);
+        lua_pcall(L, 2, 0, 0);
+    }
+
+    lua_settop(L, top);
+}
+
+static int classlib_profilefinalizers(lua_State *L) {
+    int         enable    = lua_toboolean(L, 1);
+    lua_Integer threshold = luaL_optinteger(L, 2, 0);
+    int         slow      = !lua_isnoneornil(L, 3);
+
+    if (slow) luaL_checktype(L, 3, LUA_TFUNCTION);
+    lua_settop(L, 3);
+    lua_setfield(L, LUA_REGISTRYINDEX, CLASSLIB_SLOWFIN_KEY);
+    luaC_profilefinalizers(
+        L,
+        enable,
+        threshold > 0 ? (unsigned long long)threshold : 0,
+        slow ? slow_finalizer_lua : NULL,
+        NULL);
+    return 0;
+}
+
+static int classlib_finalizerstats(lua_State *L) {
+    size_t               n   = luaC_snapshotfinalizers(L, NULL, 0);
+    luaC_FinalizerStats *buf = malloc(n * sizeof(luaC_FinalizerStats) + 1);
+
+    if (!buf) return luaL_error(L, "out of memory");
+    n = luaC_snapshotfinalizers(L, buf, n);
+    lua_createtable(L, 0, (int)n);
+
+    for (size_t i = 0; i < n; i++) {
+        luaC_FinalizerStats *s = &buf[i];
+        lua_createtable(L, 0, 5);
+        lua_pushinteger(L, (lua_Integer)s->calls);
+        lua_setfield(L, -2, "calls");
+        lua_pushinteger(L, (lua_Integer)s->total_ns);
+        lua_setfield(L, -2, "total_ns");
+        lua_pushinteger(L, (lua_Integer)s->max_ns);
+        lua_setfield(L, -2, "max_ns");
+        lua_pushinteger(L, (lua_Integer)s->slow);
+        lua_setfield(L, -2, "slow");
+        lua_createtable(L, LUAC_FINALIZER_BUCKETS, 0);
+        for (int b = 0; b < LUAC_FINALIZER_BUCKETS; b++) {
+            lua_pushinteger(L, (lua_Integer)s->histogram[b]);
+            lua_rawseti(L, -2, b + 1);
+        }
+        lua_setfield(L, -2, "histogram");
+        lua_setfield(L, -2, s->uclass->name);
+    }
+
+    free(buf);
+    return 1;
+}
+
+static int classlib_callchain(lua_State *L) {
+    static const char *const orders[] = {"base", "derived", NULL};
+    const char              *method   = luaL_checkstring(L, 2);
+    int                      order    = luaL_checkoption(L, 3, NULL, orders);
+    int                      nargs    = lua_gettop(L) - 3;
+    lua_pushinteger(L, luaC_callchain(L, 1, method, order, nargs));
+    return 1;
+}
+
+static int classlib_clearchains(lua_State *L) {
+    luaC_clearchains(L);
+    return 0;
+}
+
+static int classlib_bind(lua_State *L) {
+    const char *method = luaL_checkstring(L, 2);
+    luaL_checkany(L, 1);
+    if (!luaC_bind(L, 1, method))
+        return luaL_error(L, "Object has no method %s.", method);
+    return 1;
+}
+
+static int classlib_setbudget(lua_State *L) {
+    int budget = (int)luaL_checkinteger(L, 1);
+    if (lua_isnoneornil(L, 2)) luaC_setbudget(L, budget);
+    else {
+        luaL_argcheck(L, luaC_isclass(L, 2), 2, "class expected");
+        luaC_setclassbudget(L, 2, budget);
+    }
+    return 0;
+}
+
+static int classlib_preemptions(lua_State *L) {
+    luaC_pushpreemptions(L);
+    return 1;
+}
+
+static int classlib_generic(lua_State *L) {
+    int arity = (int)luaL_checkinteger(L, 1);
+    luaC_newgeneric(L, luaL_optstring(L, 2, NULL), arity);
+    return 1;
+}
+
+static int classlib_defmethod(lua_State *L) {
+    generic *g = luaL_checkudata(L, 1, CLASSLIB_GENERIC_KEY);
+    luaL_checktype(L, g->arity + 2, LUA_TFUNCTION);
+    lua_settop(L, g->arity + 2);
+    luaC_defmethod(L, 1);
+    return 0;
+}
+
+static int classlib_findmethod(lua_State *L) {
+    luaL_checkudata(L, 1, CLASSLIB_GENERIC_KEY);
+    luaC_pushmethod(L, 1, lua_gettop(L) - 1);
+    return 1;
+}
+
+static int classlib_flush(lua_State *L) {
+    lua_pushinteger(L, luaC_flush(L));
+    return 1;
+}
+
+static int classlib_endscope(lua_State *L) {
+    int escaped = lua_toboolean(L, 1);
+    lua_settop(L, 0);
+    lua_pushinteger(L, luaC_endscope(L, escaped));
+    if (escaped) lua_insert(L, 1);  // put count before escaped objects
+    return lua_gettop(L);
+}
+
+static int classlib_tojson(lua_State *L) {
+    luaL_checkany(L, 1);
+    luaC_tojson(L, 1);
+    return 1;
+}
+
+static int classlib_fromjson(lua_State *L) {
+    size_t      len;
+    const char *json = luaL_checklstring(L, 1, &len);
+
+    if (luaC_fromjson(L, json, len, luaL_optstring(L, 2, NULL))) return 1;
+    lua_pushnil(L);
+    lua_insert(L, -2);  // insert nil before message
+    return 2;
+}
+
 int luaopen_lcl(lua_State *L) {
     static const luaL_Reg classlib_funcs[] = {
-        {"uvget",  classlib_uvget },
-        {"uvset",  classlib_uvset },
-        {"rawget", classlib_rawget},
-        {"rawset", classlib_rawset},
-        {NULL,     NULL           }
+        {"uvget",             classlib_uvget            },
+        {"uvset",             classlib_uvset            },
+        {"rawget",            classlib_rawget           },
+        {"rawset",            classlib_rawset           },
+        {"beginscope",        classlib_beginscope       },
+        {"endscope",          classlib_endscope         },
+        {"flush",             classlib_flush            },
+        {"markdirty",         classlib_markdirty        },
+        {"dirty",             classlib_dirty            },
+        {"namespace",         classlib_namespace        },
+        {"usenamespace",      classlib_usenamespace     },
+        {"profilefinalizers", classlib_profilefinalizers},
+        {"finalizerstats",    classlib_finalizerstats   },
+        {"callchain",         classlib_callchain        },
+        {"clearchains",       classlib_clearchains      },
+        {"bind",              classlib_bind             },
+        {"setbudget",         classlib_setbudget        },
+        {"preemptions",       classlib_preemptions      },
+        {"generic",           classlib_generic          },
+        {"defmethod",         classlib_defmethod        },
+        {"findmethod",        classlib_findmethod       },
+        {"tojson",            classlib_tojson           },
+        {"fromjson",          classlib_fromjson         },
+        {"startupreport",     classlib_startupreport    },
+        {NULL,                NULL                      }
     };
     luaL_newlib(L, classlib_funcs);
     return 1;
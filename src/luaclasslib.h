@@ -8,7 +8,8 @@
 
 /**
  * @brief A user data class constructor. Implementations of this function should
- * push one value onto the stack, a userdata with at least one user value.
+ * push one value onto the stack, a userdata with at least one user value. Not
+ * needed if the class declares the `size` of its user data instead.
  *
  * @param L The Lua state.
  */
@@ -24,27 +25,156 @@ typedef void (*luaC_Constructor)(lua_State *L);
  */
 typedef void (*luaC_Destructor)(lua_State *L, void *p);
 
+/// The class destructor only releases resources that are reclaimed when the
+/// process exits, and may be skipped by @rstref{luaC_fastclose}.
+#define LUAC_SKIPONCLOSE 0x1
+
+/// User data allocated by LCL is filled with zeros before initialization.
+#define LUAC_ZEROINIT 0x2
+
+/// Writes to instances of the class through `__newindex` mark them as dirty
+/// (see @rstref{luaC_markdirty}). Only for user data classes, as table
+/// instances are written to directly once a field exists. Registering a table
+/// class with this flag fails.
+#define LUAC_TRACKDIRTY 0x4
+
+/// Deferred calls with the same key replace each other, so only the arguments
+/// of the last one are delivered.
+#define LUAC_DEFER_LAST 0
+
+/// Deferred calls with the same key are delivered together as an array of
+/// argument tables.
+#define LUAC_DEFER_ACCUMULATE 1
+
+/// Chained methods are called starting from the base of the heirarchy.
+#define LUAC_CHAIN_BASEFIRST 0
+
+/// Chained methods are called starting from the most derived class.
+#define LUAC_CHAIN_DERIVEDFIRST 1
+
+/// The largest number of arguments a generic function can dispatch on.
+#define LUAC_DISPATCH_MAX 4
+
+/// A payload field holding a `lua_Number`.
+#define LUAC_FIELD_NUMBER 1
+
+/// A payload field holding a `lua_Integer`.
+#define LUAC_FIELD_INTEGER 2
+
+/// A payload field holding a boolean as an `int`.
+#define LUAC_FIELD_BOOLEAN 3
+
+/// A field holding a string or nil in a user value.
+#define LUAC_FIELD_STRING 4
+
+/// A field holding any value in a user value.
+#define LUAC_FIELD_VALUE 5
+
+/// Describes a field of user data instances that is not stored in the user
+/// value table, so that it can be read and written without calling Lua code.
+typedef struct {
+    /** The name of the field. */
+    const char *name;
+    /** The type of the field, one of the `LUAC_FIELD_*` constants. */
+    int         type;
+    /** The offset of the field in the user data, or for strings and values,
+     * the index of the user value holding it. */
+    size_t      offset;
+} luaC_Field;
+
 /// Header for luaC_Class objects.
 #define LUAC_CLASS_HEADER                \
     /** The name of the class. */        \
-    const char      *name;               \
+    const char       *name;              \
     /** The name of the parent. */       \
-    const char      *parent;             \
+    const char       *parent;            \
     /** Whether to allow construction */ \
     /** by calling the class object. */  \
-    int              user_ctor;          \
+    int               user_ctor;         \
     /** The class allocator. */          \
-    luaC_Constructor alloc;              \
+    luaC_Constructor  alloc;             \
     /** The class garbage collector. */  \
-    luaC_Destructor  gc;                 \
+    luaC_Destructor   gc;                \
     /** The class methods. */            \
-    const luaL_Reg  *methods;
+    const luaL_Reg   *methods;           \
+    /** Class option flags. */           \
+    int               flags;             \
+    /** The size of the user data. If */ \
+    /** there is no allocator, LCL */    \
+    /** allocates instances itself. */   \
+    size_t            size;              \
+    /** The number of user values to */  \
+    /** allocate, at least 1. */         \
+    int               nuv;               \
+    /** Fields declared by the class, */ \
+    /** ending with an entry with a */   \
+    /** null name. Can be null. */       \
+    const luaC_Field *fields;
 
 /// Contains information about a user data class.
 typedef struct {
     LUAC_CLASS_HEADER
 } luaC_Class;
 
+/// A snapshot of the process-wide metrics of a class descriptor.
+typedef struct {
+    /** The class descriptor. */
+    const luaC_Class *uclass;
+    /** The number of objects constructed. */
+    long long         constructions;
+    /** The number of user data objects finalized. */
+    long long         finalizations;
+    /** The number of user data objects constructed and not yet finalized. */
+    long long         live;
+    /** The number of method calls. */
+    long long         calls;
+} luaC_Metrics;
+
+/// The number of buckets in a finalizer latency histogram.
+#define LUAC_FINALIZER_BUCKETS 32
+
+/// Finalizer timings of a class descriptor in one state.
+typedef struct {
+    /** The class descriptor. */
+    const luaC_Class  *uclass;
+    /** The number of timed destructor calls. */
+    unsigned long long calls;
+    /** The total time spent in the destructor, in nanoseconds. */
+    unsigned long long total_ns;
+    /** The longest single call, in nanoseconds. */
+    unsigned long long max_ns;
+    /** The number of calls that exceeded the slow finalizer threshold. */
+    unsigned long long slow;
+    /** Calls by duration. Bucket `i` counts calls that took less than `2^i`
+     * nanoseconds and at least `2^(i-1)`, except the last, which counts all
+     * longer calls as well. */
+    unsigned long long histogram[LUAC_FINALIZER_BUCKETS];
+} luaC_FinalizerStats;
+
+/**
+ * @brief Called when a destructor takes longer than the slow finalizer
+ * threshold (see @rstref{luaC_profilefinalizers}). Called right after the
+ * destructor returns, so it must not raise errors.
+ *
+ * @param L The Lua state.
+ * @param c The class descriptor whose destructor was slow.
+ * @param ns How long the destructor took, in nanoseconds.
+ * @param ud The user data given to @rstref{luaC_profilefinalizers}.
+ */
+typedef void (*luaC_SlowFinalizer)(
+    lua_State         *L,
+    const luaC_Class  *c,
+    unsigned long long ns,
+    void              *ud);
+
+/// A reference to an object held by C code (see @rstref{luaC_newhandle}). The
+/// low 32 bits are a slot in the handle table of the state, and the high 32
+/// bits the generation of that slot.
+typedef unsigned long long luaC_Handle;
+
+/// A handle that never refers to an object.
+#define LUAC_NOHANDLE 0
+
 /**
  * @brief Pushes onto the stack the value `t[k]` where `t` is the table stored
  * in the given user value of the userdata at the given index, and `k` is the
@@ -356,6 +486,135 @@ static inline int luaC_pmcall(
     return lua_pcall(L, nargs + 1, nresults, msgh);
 }
 
+/**
+ * @brief Pushes onto the stack a function that calls the method *method* of the
+ * object at the given index, passing the object as the first argument, like
+ * `function(...) return obj:method(...) end`. The method is looked up on each
+ * call, so it follows methods replaced later.
+ *
+ * Bound methods are cached per object and method, so binding the same method
+ * of the same object again pushes the identical function for as long as it is
+ * in use, and callbacks can be disconnected by identity. The cache does not
+ * keep the objects or the functions alive.
+ *
+ * @param L The Lua state.
+ * @param idx The index of the object.
+ * @param method The name of the method.
+ *
+ * @return 1 if the method was bound, and 0 if the object has no such method,
+ * in which case nil is pushed.
+ */
+int luaC_bind(lua_State *L, int idx, const char *method);
+
+/**
+ * @brief Sets the default instruction budget of calls started with
+ * @rstref{luaC_mstart} and @rstref{luaC_cstart}. A call that runs for more
+ * than *budget* virtual machine instructions without finishing or yielding is
+ * preempted: its coroutine yields, so the scheduler can run other work, and
+ * continues with a fresh budget when resumed with @rstref{luaC_resumecall}.
+ *
+ * A call is only preempted while its coroutine can yield. Inside C functions
+ * called without a continuation, such as those using @rstref{luaC_mcall}, it
+ * keeps running until the next slice ends in Lua code.
+ *
+ * @param L The Lua state.
+ * @param budget The number of instructions in each slice, or 0 to disable
+ * preemption.
+ */
+void luaC_setbudget(lua_State *L, int budget);
+
+/**
+ * @brief Sets the instruction budget of calls to methods of instances of the
+ * class at the given index and its subclasses, overriding the default set with
+ * @rstref{luaC_setbudget}.
+ *
+ * @param L The Lua state.
+ * @param idx The index of the class.
+ * @param budget The number of instructions in each slice, or 0 to use the
+ * budget of the parent class.
+ */
+void luaC_setclassbudget(lua_State *L, int idx, int budget);
+
+/**
+ * @brief Starts a method call on the coroutine *co* under the instruction
+ * budget of the object's class. The object and *nargs* arguments are taken
+ * from the top of the stack of *co*, as with @rstref{luaC_mcall}, and the call
+ * runs as if by `lua_resume`.
+ *
+ * @param co The coroutine to run the call on. Must be a fresh thread, or one
+ * whose previous call has finished.
+ * @param from The coroutine resuming *co*, or NULL.
+ * @param method The name of the method to call.
+ * @param nargs The number of arguments.
+ * @param nresults Set to the number of values on top of the stack of *co*:
+ * the results if the call finished, or the yielded values.
+ *
+ * @return `LUA_OK` if the call finished, `LUA_YIELD` if it was preempted or
+ * yielded, or an error code, with the error object on top of the stack of
+ * *co*.
+ */
+int luaC_mstart(
+    lua_State  *co,
+    lua_State  *from,
+    const char *method,
+    int         nargs,
+    int        *nresults);
+
+/**
+ * @brief Starts constructing an instance of the class *name* on the coroutine
+ * *co* under the instruction budget of the class. Works like
+ * @rstref{luaC_mstart}, taking *nargs* constructor arguments from the top of
+ * the stack of *co*, and leaving the new object on it when it finishes.
+ *
+ * @param co The coroutine to run the constructor on.
+ * @param from The coroutine resuming *co*, or NULL.
+ * @param nargs The number of arguments.
+ * @param name The fully qualified name of the class.
+ * @param nresults Set to the number of values on top of the stack of *co*.
+ *
+ * @return As for @rstref{luaC_mstart}. If the class is not registered, the
+ * arguments are popped and `LUA_ERRRUN` is returned with an error message.
+ */
+int luaC_cstart(
+    lua_State  *co,
+    lua_State  *from,
+    int         nargs,
+    const char *name,
+    int        *nresults);
+
+/**
+ * @brief Resumes a call started with @rstref{luaC_mstart} or
+ * @rstref{luaC_cstart} that was preempted or yielded, with a fresh instruction
+ * budget. A preempted call should be resumed with no arguments.
+ *
+ * @param co The coroutine running the call.
+ * @param from The coroutine resuming *co*, or NULL.
+ * @param nargs The number of values to pass to the resumed call.
+ * @param nresults Set to the number of values on top of the stack of *co*.
+ *
+ * @return As for @rstref{luaC_mstart}.
+ */
+int luaC_resumecall(lua_State *co, lua_State *from, int nargs, int *nresults);
+
+/**
+ * @brief Checks if the call running on the given coroutine was preempted the
+ * last time it yielded, rather than yielding by itself.
+ *
+ * @param co The coroutine.
+ *
+ * @return 1 if the call was preempted, and 0 otherwise.
+ */
+int luaC_preempted(lua_State *co);
+
+/**
+ * @brief Pushes onto the stack a new table mapping the calls that have been
+ * preempted, named `Class.method` (or `Class.new` for constructors), to the
+ * number of times they were preempted.
+ *
+ * @param L The Lua state.
+ */
+void luaC_pushpreemptions(lua_State *L);
+
 /**
  * @brief Checks if the value at the given index is an instance of a class.
  *
@@ -402,6 +661,11 @@ void *luaC_checkuclass(lua_State *L, int arg, const char *name);
 
 /**
  * @brief Pushes onto the stack the class registered under the given *name*.
+ * If a namespace is active (see @rstref{luaC_setnamespace}), it is searched
+ * first. Classes not yet known to LCL are looked up in `package.loaded`, either
+ * as modules themselves or as fields of their module table, before falling back
+ * to `require`. Classes found this way are cached in the active namespace, if
+ * there is one, and shared otherwise.
  *
  * @param L The Lua state.
  * @param name The fully qualified (with module prefix) class name.
@@ -494,10 +758,99 @@ int luaC_getparentfield(lua_State *L, int idx, int depth, const char *name);
  */
 void luaC_super(lua_State *L, const char *name, int nargs, int nresults);
 
+/**
+ * @brief Calls the method *method* as defined at each level of the heirarchy of
+ * the object at the given index, skipping levels that do not define it, with
+ * the top *nargs* values on the stack as arguments. Pops the arguments, and
+ * discards the results.
+ *
+ * The list of functions to call is resolved the first time a method is chained
+ * on a class, and cached. Methods replaced with @rstref{luaC_injectmethod} are
+ * picked up automatically, but after modifying a class `__base` directly, call
+ * @rstref{luaC_clearchains}.
+ *
+ * @param L The Lua state.
+ * @param idx The index of the object.
+ * @param method The name of the method.
+ * @param order @rstref{LUAC_CHAIN_BASEFIRST} or
+ * @rstref{LUAC_CHAIN_DERIVEDFIRST}.
+ * @param nargs The number of arguments.
+ *
+ * @return The number of functions called.
+ */
+int luaC_callchain(
+    lua_State  *L,
+    int         idx,
+    const char *method,
+    int         order,
+    int         nargs);
+
+/**
+ * @brief Clears the function lists cached by @rstref{luaC_callchain}.
+ *
+ * @param L The Lua state.
+ */
+void luaC_clearchains(lua_State *L);
+
+/**
+ * @brief Pushes onto the stack a new generic function, which dispatches on the
+ * classes of its first *arity* arguments. Calling it calls the most specific
+ * method defined for them (see @rstref{luaC_defmethod}) with all of its
+ * arguments, and raises an error if no method applies.
+ *
+ * The method selected for each combination of argument classes is cached, so
+ * repeated calls with the same classes cost a single hash table probe. The
+ * cache is cleared when methods are defined or classes are created.
+ *
+ * @param L The Lua state.
+ * @param name The name of the generic function, used in error messages. Can be
+ * NULL.
+ * @param arity The number of arguments to dispatch on, from 1 to
+ * @rstref{LUAC_DISPATCH_MAX}.
+ */
+void luaC_newgeneric(lua_State *L, const char *name, int arity);
+
+/**
+ * @brief Defines a method of the generic function at the given index. The
+ * method is the function at the top of the stack, and it applies to arguments
+ * that are instances of the classes in the *arity* values below it, in order.
+ * Each of those is a class, the fully qualified name of one, or nil to match
+ * any value. Replaces the method previously defined for the same classes, if
+ * any. Pops the classes and the method.
+ *
+ * Of the methods that apply to a call, the most specific is the one whose
+ * first class is nearest to the class of the first argument in its heirarchy,
+ * with ties broken by the following arguments in turn. Nil matches any value,
+ * and is less specific than any class.
+ *
+ * @param L The Lua state.
+ * @param idx The index of the generic function.
+ */
+void luaC_defmethod(lua_State *L, int idx);
+
+/**
+ * @brief Pushes onto the stack the method the generic function at the given
+ * index would call for the top *nargs* values on the stack, without calling it.
+ * Pushes nil if no method applies.
+ *
+ * @param L The Lua state.
+ * @param idx The index of the generic function.
+ * @param nargs The number of arguments.
+ *
+ * @return 1 if a method applies, and 0 otherwise.
+ */
+int luaC_pushmethod(lua_State *L, int idx, int nargs);
+
 /**
  * @brief Obtains the Lua class table associated with the `luaC_Class` at the
  * top of the stack. If the class table does not exist, it will be created.
  *
+ * Data derived from the descriptor alone, such as its constructor and method
+ * list, is computed the first time it is registered in any state, and shared
+ * with every state that registers it after that. The descriptor that the
+ * parent name resolved to is shared too, so other states find the parent by
+ * descriptor while no namespace is active, without resolving its name.
+ *
  * @param L The Lua state.
  *
  * @return 1 if the class was successfully registered, and 0 otherwise.
@@ -505,7 +858,20 @@ void luaC_super(lua_State *L, const char *name, int nargs, int nresults);
 int luaC_classfromptr(lua_State *L);
 
 /**
- * @brief Removes the class with the given name from the class registry.
+ * @brief Registers the class at the top of the stack under the given fully
+ * qualified name, and pops it. If a namespace is active, the class is added to
+ * it, and is only visible while it is active. Otherwise it is added to
+ * `package.loaded`, either directly or as a field of its module table.
+ *
+ * @param L The Lua state.
+ * @param name The fully qualified (with module prefix) class name.
+ */
+void luaC_register(lua_State *L, const char *name);
+
+/**
+ * @brief Removes the class with the given name from the class registry. If a
+ * namespace is active, the class is only removed if it was found in that
+ * namespace, so shared classes are left alone.
  *
  * @param L The Lua state.
  * @param name The name of the class to unregister.
@@ -543,6 +909,345 @@ int luaC_newclass(
     const char *parent,
     luaL_Reg   *methods);
 
+/**
+ * @brief Pushes onto the stack the namespace with the given name, creating it
+ * if it does not exist. A namespace is a table mapping class names to classes,
+ * or module names to module tables containing classes, in the same way as
+ * `package.loaded`. Classes are added to a namespace with
+ * @rstref{luaC_register} while it is active, or by storing them in it.
+ *
+ * @param L The Lua state.
+ * @param name The name of the namespace.
+ */
+void luaC_pushnamespace(lua_State *L, const char *name);
+
+/**
+ * @brief Makes the namespace at the given index the active namespace, and
+ * pushes the previously active one onto the stack (or nil if there was none)
+ * so that it can be restored. While a namespace is active, classes are looked
+ * up by name in it before the shared classes, which are used by every
+ * namespace. This affects every function that takes a class name, such as
+ * @rstref{luaC_construct}, @rstref{luaC_isinstance} and the parent lookup of
+ * @rstref{luaC_classfromptr}.
+ *
+ * @param L The Lua state.
+ * @param idx The index of the namespace, or of nil to make only the shared
+ * classes visible.
+ */
+void luaC_setnamespace(lua_State *L, int idx);
+
+/**
+ * @brief Begins a new object scope. Objects constructed while a scope is active
+ * (through @rstref{luaC_construct} or by calling a class) are tracked by the
+ * innermost scope and released together when it ends. Scopes can be nested.
+ *
+ * @param L The Lua state.
+ *
+ * @return The depth of the new scope.
+ */
+int luaC_beginscope(lua_State *L);
+
+/**
+ * @brief Ends the innermost object scope. The finalizers of every object
+ * tracked by the scope are called, in reverse order of construction, and the
+ * objects are marked as dead so that further access raises an error and the
+ * garbage collector does not finalize them again. If *escaped* is nonzero, a
+ * full garbage collection cycle is then run, and a table containing the
+ * objects that are still reachable is pushed onto the stack.
+ *
+ * @param L The Lua state.
+ * @param escaped Whether to detect objects that escaped the scope.
+ *
+ * @return The number of objects that escaped the scope, or 0 if *escaped* is 0
+ * or no scope was active.
+ */
+int luaC_endscope(lua_State *L, int escaped);
+
+/**
+ * @brief Closes the Lua state without running unnecessary finalizers. Only the
+ * destructors of classes without the `LUAC_SKIPONCLOSE` flag are called, and
+ * finalized objects are not marked as dead. Intended for use when the process
+ * is about to exit.
+ *
+ * @param L The Lua state.
+ */
+void luaC_fastclose(lua_State *L);
+
+/**
+ * @brief Creates a handle to the object at the given index. A handle is a plain
+ * integer that can be stored in C data structures in place of a registry
+ * reference. Once released, or once a weak handle's object dies, the handle
+ * is stale and pushes nil, even if its slot is reused.
+ *
+ * @param L The Lua state.
+ * @param idx The index of the object.
+ * @param weak Whether the handle lets the object be collected. Weak handles
+ * to user data with destructors are released when the object is finalized.
+ *
+ * @return The handle, or @rstref{LUAC_NOHANDLE} if the value is not an object.
+ */
+luaC_Handle luaC_newhandle(lua_State *L, int idx, int weak);
+
+/**
+ * @brief Pushes the object referred to by a handle onto the stack, or nil if
+ * the handle is stale.
+ *
+ * @param L The Lua state.
+ * @param h The handle.
+ *
+ * @return The type of the pushed value.
+ */
+int luaC_pushhandle(lua_State *L, luaC_Handle h);
+
+/**
+ * @brief Releases a handle, freeing its slot for reuse. Releasing a stale
+ * handle does nothing, so weak handles can always be released.
+ *
+ * @param L The Lua state.
+ * @param h The handle.
+ *
+ * @return 1 if the handle was released, and 0 if it was stale.
+ */
+int luaC_releasehandle(lua_State *L, luaC_Handle h);
+
+/**
+ * @brief Queues a call to the function below the top *nargs* values on the
+ * stack, to be made by the next @rstref{luaC_flush}. Pops the function and its
+ * arguments. The first argument is the key under which pending calls are
+ * coalesced, usually the object the call is made on, and must not be nil.
+ *
+ * With @rstref{LUAC_DEFER_LAST}, a call replaces the pending call with the same
+ * key. With @rstref{LUAC_DEFER_ACCUMULATE}, the remaining arguments of each
+ * call are packed into a table (with field `n` set to their count) and
+ * appended to a list, and the function is called with the key and the list.
+ * Either way, the function is called once per key and flush, in the order the
+ * keys were first queued.
+ *
+ * @param L The Lua state.
+ * @param nargs The number of arguments, including the key.
+ * @param mode How calls with the same key are coalesced.
+ */
+void luaC_defer(lua_State *L, int nargs, int mode);
+
+/**
+ * @brief Makes the calls queued by @rstref{luaC_defer}. Calls queued while
+ * flushing are left for the next flush. If a call raises an error, the calls
+ * after it are dropped.
+ *
+ * @param L The Lua state.
+ *
+ * @return The number of calls made.
+ */
+int luaC_flush(lua_State *L);
+
+/**
+ * @brief Marks the object at the given index as dirty, adding it to the list of
+ * objects changed since the list was last cleared. Does nothing if it is
+ * already dirty. Instances of classes with the `LUAC_TRACKDIRTY` flag are
+ * marked by writes through their `__newindex` metamethod, and C code that
+ * modifies object data directly can mark them with this function.
+ *
+ * @param L The Lua state.
+ * @param idx The index of the object on the stack.
+ */
+void luaC_markdirty(lua_State *L, int idx);
+
+/**
+ * @brief Checks if the object at the given index is dirty.
+ *
+ * @param L The Lua state.
+ * @param idx The index of the object on the stack.
+ *
+ * @return 1 if the object is dirty, 0 otherwise.
+ */
+int luaC_isdirty(lua_State *L, int idx);
+
+/**
+ * @brief Pushes a list of the dirty objects onto the stack, in the order they
+ * were first marked. If *clear* is nonzero, all objects are then marked clean.
+ * The list keeps the objects alive until it is cleared.
+ *
+ * @param L The Lua state.
+ * @param clear Whether to clear the dirty list.
+ *
+ * @return The number of dirty objects.
+ */
+int luaC_pushdirty(lua_State *L, int clear);
+
+/**
+ * @brief Enables or disables process-wide metrics. Classes registered while
+ * metrics are enabled are tracked by their descriptor in every state and
+ * thread, along with their subclasses that have no descriptor of their own.
+ * User data classes that are tracked always get a `__gc` metamethod, and their
+ * methods are wrapped to count calls. Tracked descriptors are expected to live
+ * as long as the process, like static ones.
+ *
+ * @param enable Whether to enable metrics.
+ */
+void luaC_enablemetrics(int enable);
+
+/**
+ * @brief Gets the metrics of a class descriptor. Safe to call from any thread
+ * without a Lua state.
+ *
+ * @param c The class descriptor.
+ * @param m The snapshot to fill.
+ *
+ * @return 1 if the descriptor is tracked, and 0 otherwise.
+ */
+int luaC_getmetrics(const luaC_Class *c, luaC_Metrics *m);
+
+/**
+ * @brief Gets the metrics of every tracked class descriptor. Safe to call from
+ * any thread without a Lua state.
+ *
+ * @param buf The array to fill.
+ * @param n The length of the array.
+ *
+ * @return The number of tracked descriptors, which may be more than *n*.
+ */
+size_t luaC_snapshotmetrics(luaC_Metrics *buf, size_t n);
+
+/**
+ * @brief Formats the metrics of every tracked class descriptor as text in the
+ * Prometheus exposition format. Safe to call from any thread without a Lua
+ * state. Like `snprintf`, the output is truncated to fit the buffer and always
+ * terminated, unless *size* is 0.
+ *
+ * @param buf The buffer to write to.
+ * @param size The size of the buffer.
+ *
+ * @return The length of the full text, not counting the terminator.
+ */
+size_t luaC_formatmetrics(char *buf, size_t size);
+
+/**
+ * @brief Starts or stops tracing startup work in the given state. While
+ * tracing, class registrations, `require` calls made to resolve classes,
+ * `__inherited` callbacks and Moonscript compilation through
+ * @rstref{moonL_loadfile} are recorded with their wall time and allocations,
+ * nested by dependency. Starting a trace discards the previous one.
+ *
+ * @param L The Lua state.
+ * @param enable Whether to trace.
+ */
+void luaC_tracestartup(lua_State *L, int enable);
+
+/**
+ * @brief Begins a span of startup work, if tracing. Spans that begin before
+ * this one ends are nested within it, so it must be ended even if the work
+ * raises an error.
+ *
+ * @param L The Lua state.
+ * @param kind The kind of work. Must be a static string.
+ * @param name What the work is done for.
+ *
+ * @return The span, to be passed to @rstref{luaC_traceend}, or -1 if not
+ * tracing.
+ */
+int luaC_tracebegin(lua_State *L, const char *kind, const char *name);
+
+/**
+ * @brief Ends a span of startup work. Also closes any spans nested within it
+ * that were left open, e.g. by an error. Spans that already ended are left
+ * alone.
+ *
+ * @param L The Lua state.
+ * @param span The span returned by @rstref{luaC_tracebegin}.
+ */
+void luaC_traceend(lua_State *L, int span);
+
+/**
+ * @brief Pushes a report of the startup trace as a string. The report lists
+ * each span with its total and self time and allocations, nested by
+ * dependency, with the longest spans first.
+ *
+ * @param L The Lua state.
+ * @param json Whether to format the report as JSON instead of a text table.
+ */
+void luaC_startupreport(lua_State *L, int json);
+
+/**
+ * @brief Starts or stops timing destructor calls in the given state. While
+ * enabled, each call of a class's `gc` function is timed and added to the
+ * finalizer stats of that class, and calls that take longer than *threshold*
+ * are passed to *slow*. Stats are kept when timing stops.
+ *
+ * @param L The Lua state.
+ * @param enable Whether to time destructors.
+ * @param threshold The slow finalizer threshold in nanoseconds, or 0 for none.
+ * @param slow The slow finalizer callback. Can be null.
+ * @param ud User data passed to *slow*.
+ */
+void luaC_profilefinalizers(
+    lua_State         *L,
+    int                enable,
+    unsigned long long threshold,
+    luaC_SlowFinalizer slow,
+    void              *ud);
+
+/**
+ * @brief Gets the finalizer stats of a class descriptor in the given state.
+ *
+ * @param L The Lua state.
+ * @param c The class descriptor.
+ * @param s The stats to fill.
+ *
+ * @return 1 if any destructor calls of the class were timed, and 0 otherwise.
+ */
+int luaC_getfinalizerstats(
+    lua_State           *L,
+    const luaC_Class    *c,
+    luaC_FinalizerStats *s);
+
+/**
+ * @brief Gets the finalizer stats of every class with timed destructor calls in
+ * the given state.
+ *
+ * @param L The Lua state.
+ * @param buf The array to fill.
+ * @param n The length of the array.
+ *
+ * @return The number of classes with stats, which may be more than *n*.
+ */
+size_t
+luaC_snapshotfinalizers(lua_State *L, luaC_FinalizerStats *buf, size_t n);
+
+/**
+ * @brief Encodes the value at the given index as JSON and pushes the result.
+ * Objects are encoded from their fields without calling Lua code: the
+ * `fields` declared by the descriptors in their heirarchy, followed by the
+ * contents of their user value table (or the instance table itself). Methods
+ * and other class members are not encoded. Tables are encoded as arrays if
+ * their keys are 1 to n, and as objects otherwise. Raises an error if a value
+ * cannot be encoded.
+ *
+ * @param L The Lua state.
+ * @param idx The index of the value.
+ */
+void luaC_tojson(lua_State *L, int idx);
+
+/**
+ * @brief Decodes a JSON document and pushes the result. If *name* is given,
+ * the top level object, or each object in the top level array, is made an
+ * instance of that class. Instances are allocated as by the class's
+ * constructor, but its `__init` is not called. Declared fields are written
+ * directly, and other keys are stored raw in the user value table (or the
+ * instance table).
+ *
+ * @param L The Lua state.
+ * @param json The document.
+ * @param len The length of the document.
+ * @param name The fully qualified name of the class, or null.
+ *
+ * @return 1 if successful. Otherwise, pushes an error message and returns 0.
+ */
+int luaC_fromjson(
+    lua_State  *L,
+    const char *json,
+    size_t      len,
+    const char *name);
+
 /**
  * @brief Pushes the Lua class library onto the stack.
  *
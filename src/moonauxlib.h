@@ -2,6 +2,7 @@
 #define MOONAUXLIB_H
 
 #include <lauxlib.h>
+#include <luaclasslib.h>
 
 /**
  * @brief Loads a Moonscript string as a Lua chunk.
@@ -29,12 +30,15 @@ static inline int moonL_loadstring(lua_State *L, const char *str) {
  * @return The Lua pcall status code.
  */
 static inline int moonL_loadfile(lua_State *L, const char *name) {
+    int span = luaC_tracebegin(L, "compile", name);
     luaL_loadstring(L, "return require('moonscript')");
     lua_pcall(L, 0, 1, 0);
     lua_getfield(L, -1, "loadfile");
     lua_remove(L, -2);
     lua_pushstring(L, name);
-    return lua_pcall(L, 1, 1, 0);
+    int ret = lua_pcall(L, 1, 1, 0);
+    luaC_traceend(L, span);
+    return ret;
 }
 
 /**
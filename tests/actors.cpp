@@ -0,0 +1,176 @@
+#include "tests.hpp"
+extern "C" {
+#include "classes/actor.h"
+}
+
+TEST_SUITE("Actors") {
+    TEST_CASE("Actors") {
+        LCL_TEST_BEGIN
+
+        lua_pushlightuserdata(L, &luaC_actorclass);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        lua_pushlightuserdata(L, &luaC_schedulerclass);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        lua_pushlightuserdata(L, &accumulator_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        luaL_dostring(
+            L,
+            "local lcltests = require('lcltests')\n"
+            "Actor = lcltests.Actor\n"
+            "Scheduler = lcltests.Scheduler\n"
+            "Accumulator = lcltests.Accumulator\n"
+            "sched = Scheduler(4)\n"
+            "-- a Lua subclass, as moonc would compile it\n"
+            "function subclass(parent, name, base)\n"
+            "  for k, v in pairs(parent.__base) do\n"
+            "    if base[k] == nil and k:match('^__') and\n"
+            "       not (k == '__index' and v == parent.__base) then\n"
+            "      base[k] = v\n"
+            "    end\n"
+            "  end\n"
+            "  base.__index = base\n"
+            "  setmetatable(base, parent.__base)\n"
+            "  local cls = setmetatable({\n"
+            "    __init = function(self, ...) parent.__init(self, ...) end,\n"
+            "    __base = base,\n"
+            "    __name = name,\n"
+            "    __parent = parent\n"
+            "  }, {\n"
+            "    __index = function(cls, k)\n"
+            "      local v = rawget(base, k)\n"
+            "      if v == nil then return parent[k] end\n"
+            "      return v\n"
+            "    end,\n"
+            "    __call = function(cls, ...)\n"
+            "      local self = setmetatable({}, base)\n"
+            "      cls.__init(self, ...)\n"
+            "      return self\n"
+            "    end\n"
+            "  })\n"
+            "  base.__class = cls\n"
+            "  parent.__inherited(parent, cls)\n"
+            "  return cls\n"
+            "end\n");
+        LCL_CHECKSTACK(0);
+
+        SUBCASE("Messages") {
+            // scalars are stored inline, other values in a user value
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local got = {}\n"
+                        "local Echo = subclass(Actor, 'Echo', {\n"
+                        "  receive = function(self, msg)\n"
+                        "    got[#got + 1] = msg == nil and 'nil' or msg\n"
+                        "  end\n"
+                        "})\n"
+                        "local e = Echo(sched)\n"
+                        "local t = {}\n"
+                        "for _, v in ipairs({1, 2.5, true, 'four', t}) do\n"
+                        "  assert(e:send(v))\n"
+                        "end\n"
+                        "assert(e:send(nil))\n"
+                        "assert(e:pending() == 6 and sched:runnable() == 1)\n"
+                        "assert(sched:run() == 6)\n"
+                        "assert(got[1] == 1 and math.type(got[1]) == "
+                        "'integer')\n"
+                        "assert(got[2] == 2.5 and got[3] == true)\n"
+                        "assert(got[4] == 'four' and got[5] == t)\n"
+                        "assert(got[6] == 'nil')\n"
+                        "assert(e:pending() == 0 and sched:runnable() == 0)") ==
+                    LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Full Mailbox") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local a = Accumulator(sched)\n"
+                        "for i = 1, 64 do assert(a:send(i)) end\n"
+                        "assert(not a:send(65))\n"
+                        "sched:run()\n"
+                        "assert(a:sum() == 64 * 65 / 2)\n"
+                        "assert(a:send(1) and a:pending() == 1)") == LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Fairness") {
+            // each actor handles at most 4 messages per turn
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local order = {}\n"
+                        "local Tagged = subclass(Actor, 'Tagged', {\n"
+                        "  receive = function(self, msg)\n"
+                        "    order[#order + 1] = msg\n"
+                        "  end\n"
+                        "})\n"
+                        "local a, b = Tagged(sched), Tagged(sched)\n"
+                        "for i = 1, 10 do a:send('a') end\n"
+                        "for i = 1, 2 do b:send('b') end\n"
+                        "assert(sched:run(1) == 6)\n"
+                        "assert(table.concat(order) == 'aaaabb')\n"
+                        "assert(sched:runnable() == 1)\n"
+                        "assert(sched:run() == 6)\n"
+                        "assert(table.concat(order) == 'aaaabbaaaaaa')") ==
+                    LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Yielding") {
+            // an actor that yields in the middle of a message is resumed on
+            // the next turn, and sends from receive are delivered
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local Relay = subclass(Actor, 'Relay', {\n"
+                        "  receive = function(self, msg)\n"
+                        "    coroutine.yield()\n"
+                        "    self.target:send(msg * 2)\n"
+                        "  end\n"
+                        "})\n"
+                        "local acc = Accumulator(sched)\n"
+                        "local r = Relay(sched)\n"
+                        "r.target = acc\n"
+                        "r:send(1)\n"
+                        "r:send(2)\n"
+                        "sched:run(1)\n"
+                        "assert(acc:pending() == 0 and sched:runnable() == 1)\n"
+                        "sched:run()\n"
+                        "assert(acc:sum() == 6)") == LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Errors") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local a = Accumulator(sched)\n"
+                        "a:send(1)\n"
+                        "a:send('x')\n"
+                        "a:send(2)\n"
+                        "local ok, err = pcall(sched.run, sched)\n"
+                        "assert(not ok and err:find('number expected'))\n"
+                        "assert(sched:run() == 1 and a:sum() == 3)\n"
+                        "local b = Actor(sched)\n"
+                        "b:send(1)\n"
+                        "assert(not pcall(sched.run, sched))") == LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Moonscript Subclass") {
+            lua_pushstring(L, "world");
+            lua_setglobal(L, "name");
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local Greeter = require('Greeter')\n"
+                        "local g = Greeter(sched)\n"
+                        "assert(g:send(name) and g:send(42))\n"
+                        "sched:run()\n"
+                        "assert(g.greeted[1] == 'hello world')\n"
+                        "assert(g.greeted[2] == 'hello 42')") == LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        LCL_TEST_END
+    }
+}
@@ -29,6 +29,15 @@ static int uservalue_newindex(lua_State *L) {
     lua_rawset(L, 1);
     return 0;
 }
+
+// names must outlive the classes registered with them. an int takes at most
+// 11 characters, with its sign.
+#define DEEP_CLASSES 1000
+static char     deep_names[DEEP_CLASSES][sizeof("Deep") + 11];
+static char     deep_paths[DEEP_CLASSES][sizeof("lcltests.Deep") + 11];
+static luaL_Reg deep_methods[] = {
+    {NULL, NULL}
+};
 }
 
 TEST_SUITE("Basic Functionality") {
@@ -67,6 +76,38 @@ TEST_SUITE("Basic Functionality") {
             lua_pop(L, 1);
         }
 
+        SUBCASE("Deep Heirarchies") {
+            for (int i = 0; i < DEEP_CLASSES; i++) {
+                snprintf(deep_names[i], sizeof(deep_names[i]), "Deep%d", i);
+                snprintf(
+                    deep_paths[i], sizeof(deep_paths[i]), "lcltests.Deep%d", i);
+                REQUIRE(luaC_newclass(
+                    L,
+                    deep_names[i],
+                    i ? deep_paths[i - 1] : NULL,
+                    deep_methods));
+                register_lcl_class(L);
+                LCL_CHECKSTACK(0);
+            }
+
+            luaC_construct(L, 0, deep_paths[DEEP_CLASSES - 1]);
+            LCL_CHECKSTACK(1);
+            REQUIRE(luaC_isinstance(L, -1, "lcltests.Deep0"));
+            REQUIRE(luaC_isinstance(L, -1, deep_paths[DEEP_CLASSES / 2]));
+            REQUIRE_FALSE(luaC_isinstance(L, -1, "lcltests.SimpleBase"));
+            LCL_CHECKSTACK(1);
+            lua_pop(L, 1);
+
+            // classes can be registered again after unregistration
+            luaC_unregister(L, "lcltests.Deep1");
+            REQUIRE(luaC_pushclass(L, "lcltests.Deep1") == LUA_TNIL);
+            lua_pop(L, 1);
+            REQUIRE(luaC_newclass(L, "Deep1", "lcltests.Deep0", deep_methods));
+            register_lcl_class(L);
+            REQUIRE(luaC_pushclass(L, "lcltests.Deep1") == LUA_TTABLE);
+            LCL_CHECKSTACK(1);
+        }
+
         LCL_TEST_END
     }
 
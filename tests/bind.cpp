@@ -0,0 +1,114 @@
+#include "tests.hpp"
+extern "C" {
+#include "classes/signal.h"
+
+static luaL_Reg counter_methods[] = {
+    {NULL, NULL}
+};
+
+static int add_twice(lua_State *L) {
+    lua_getfield(L, 1, "count");
+    lua_pushinteger(L, lua_tointeger(L, -1) + 2 * luaL_checkinteger(L, 2));
+    lua_setfield(L, 1, "count");
+    lua_getfield(L, 1, "count");
+    return 1;
+}
+}
+
+TEST_SUITE("Bound Methods") {
+    TEST_CASE("Bound Methods") {
+        LCL_TEST_BEGIN
+
+        REQUIRE(luaC_newclass(L, "Counter", NULL, counter_methods));
+        register_lcl_class(L);
+        lua_pushlightuserdata(L, &signal_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        REQUIRE(luaL_dostring(
+                    L,
+                    "local lcltests = require('lcltests')\n"
+                    "lcltests.Counter.__base.add = function(self, n)\n"
+                    "  self.count = (self.count or 0) + n\n"
+                    "  return self.count, n\n"
+                    "end\n"
+                    "counter = lcltests.Counter()\n") == LUA_OK);
+        LCL_CHECKSTACK(0);
+
+        SUBCASE("Identity") {
+            lua_getglobal(L, "counter");
+            REQUIRE(luaC_bind(L, 1, "add"));
+            REQUIRE(luaC_bind(L, 1, "add"));
+            CHECK(lua_rawequal(L, -1, -2));
+            REQUIRE(lua_isfunction(L, -1));
+
+            lua_pushinteger(L, 5);
+            lua_call(L, 1, 2);
+            CHECK(lua_tointeger(L, -2) == 5);
+            CHECK(lua_tointeger(L, -1) == 5);
+            lua_pop(L, 3);
+
+            // a missing method is not bound
+            CHECK_FALSE(luaC_bind(L, 1, "missing"));
+            CHECK(lua_isnil(L, -1));
+            lua_pop(L, 2);
+            LCL_CHECKSTACK(0);
+
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local lcl = require('lcl')\n"
+                        "local other = require('lcltests').Counter()\n"
+                        "assert(lcl.bind(counter, 'add') == "
+                        "lcl.bind(counter, 'add'))\n"
+                        "assert(lcl.bind(other, 'add') ~= "
+                        "lcl.bind(counter, 'add'))\n"
+                        "assert(not pcall(lcl.bind, counter, 'missing'))") ==
+                    LUA_OK);
+        }
+
+        SUBCASE("Method Lookup") {
+            // the method is looked up on each call
+            lua_getglobal(L, "counter");
+            REQUIRE(luaC_bind(L, 1, "add"));
+            lua_setglobal(L, "add");
+            luaC_getclass(L, 1);
+            REQUIRE(luaC_injectmethod(L, -1, "add", add_twice));
+            lua_pop(L, 2);
+            REQUIRE(luaL_dostring(
+                        L,
+                        "assert(add(3) == 6)\n"
+                        "assert(counter.count == 6)") == LUA_OK);
+        }
+
+        SUBCASE("Signals") {
+            // bound methods can be disconnected by identity
+            luaC_construct(L, 0, "lcltests.Signal");
+            lua_setglobal(L, "sig");
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local lcl = require('lcl')\n"
+                        "sig:connect(lcl.bind(counter, 'add'))\n"
+                        "sig(2)\n"
+                        "sig:disconnect(lcl.bind(counter, 'add'))\n"
+                        "sig(100)\n"
+                        "assert(counter.count == 2)") == LUA_OK);
+        }
+
+        SUBCASE("Collection") {
+            // the cache keeps neither objects nor bound methods alive
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local lcl = require('lcl')\n"
+                        "probe = setmetatable({}, {__mode = 'k'})\n"
+                        "local obj = require('lcltests').Counter()\n"
+                        "probe[obj] = true\n"
+                        "probe[lcl.bind(obj, 'add')] = true\n"
+                        "probe[lcl.bind(counter, 'add')] = true\n"
+                        "obj = nil\n"
+                        "collectgarbage()\n"
+                        "collectgarbage()\n"
+                        "assert(next(probe) == nil)") == LUA_OK);
+        }
+
+        LCL_TEST_END
+    }
+}
@@ -0,0 +1,114 @@
+#include "tests.hpp"
+extern "C" {
+// appends *name* and the first argument to the global log
+static int log_call(lua_State *L, const char *name) {
+    lua_pushfstring(L, "%s%s", name, luaL_optstring(L, 2, ""));
+    lua_getglobal(L, "log");
+    lua_insert(L, -2);
+    lua_rawseti(L, -2, luaL_len(L, -2) + 1);
+    return 0;
+}
+
+static int reset_a(lua_State *L) {
+    return log_call(L, "A");
+}
+
+static int reset_c(lua_State *L) {
+    return log_call(L, "C");
+}
+
+static int reset_injected(lua_State *L) {
+    return log_call(L, "I");
+}
+
+static luaL_Reg chain_a_methods[] = {
+    {"reset", reset_a},
+    {NULL,    NULL   }
+};
+
+static luaL_Reg chain_b_methods[] = {
+    {NULL, NULL}
+};
+
+static luaL_Reg chain_c_methods[] = {
+    {"reset", reset_c},
+    {NULL,    NULL   }
+};
+}
+
+TEST_SUITE("Method Chains") {
+    TEST_CASE("Call Chains") {
+        LCL_TEST_BEGIN
+
+        REQUIRE(luaC_newclass(L, "ChainA", NULL, chain_a_methods));
+        register_lcl_class(L);
+        REQUIRE(luaC_newclass(L, "ChainB", "lcltests.ChainA", chain_b_methods));
+        register_lcl_class(L);
+        REQUIRE(luaC_newclass(L, "ChainC", "lcltests.ChainB", chain_c_methods));
+        register_lcl_class(L);
+        lua_newtable(L);
+        lua_setglobal(L, "log");
+
+        REQUIRE(luaC_construct(L, 0, "lcltests.ChainC"));
+        LCL_CHECKSTACK(1);
+
+        SUBCASE("Order") {
+            lua_pushstring(L, "1");
+            CHECK(luaC_callchain(L, 1, "reset", LUAC_CHAIN_BASEFIRST, 1) == 2);
+            LCL_CHECKSTACK(1);
+            lua_pushstring(L, "2");
+            CHECK(luaC_callchain(L, 1, "reset", LUAC_CHAIN_DERIVEDFIRST, 1) == 2);
+            LCL_CHECKSTACK(1);
+            CHECK(luaC_callchain(L, 1, "missing", LUAC_CHAIN_BASEFIRST, 0) == 0);
+            REQUIRE(luaL_dostring(
+                        L,
+                        "assert(table.concat(log, ',') == 'A1,C1,C2,A2')") ==
+                    LUA_OK);
+
+            // anything that is not an object has no chain
+            lua_pushnumber(L, 3);
+            lua_pushstring(L, "x");
+            CHECK(luaC_callchain(L, -2, "reset", LUAC_CHAIN_BASEFIRST, 1) == 0);
+            LCL_CHECKSTACK(2);
+        }
+
+        SUBCASE("Invalidation") {
+            CHECK(luaC_callchain(L, 1, "reset", LUAC_CHAIN_BASEFIRST, 0) == 2);
+
+            // injecting a method clears the cached lists
+            luaC_pushclass(L, "lcltests.ChainB");
+            REQUIRE(luaC_injectmethod(L, -1, "reset", reset_injected));
+            lua_pop(L, 1);
+            CHECK(luaC_callchain(L, 1, "reset", LUAC_CHAIN_BASEFIRST, 0) == 3);
+
+            // direct changes need an explicit clear
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local A = require('lcltests').ChainA\n"
+                        "A.__base.reset = nil\n"
+                        "log = {}") == LUA_OK);
+            CHECK(luaC_callchain(L, 1, "reset", LUAC_CHAIN_BASEFIRST, 0) == 3);
+            luaC_clearchains(L);
+            CHECK(luaC_callchain(L, 1, "reset", LUAC_CHAIN_BASEFIRST, 0) == 2);
+            REQUIRE(luaL_dostring(
+                        L,
+                        "assert(table.concat(log, ',') == 'A,I,C,I,C')") ==
+                    LUA_OK);
+            LCL_CHECKSTACK(1);
+        }
+
+        SUBCASE("Lua") {
+            lua_setglobal(L, "obj");
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local lcl = require('lcl')\n"
+                        "assert(lcl.callchain(obj, 'reset', 'derived', 'x') == 2)\n"
+                        "assert(table.concat(log, ',') == 'Cx,Ax')\n"
+                        "assert(not pcall(lcl.callchain, obj, 'reset', 'up'))") ==
+                    LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        LCL_TEST_END
+    }
+}
@@ -0,0 +1,44 @@
+#include "actor.h"
+
+// C subclass that sums the numbers sent to it
+typedef struct {
+    LUAC_ACTOR_HEADER
+    lua_Number sum;
+} accumulator;
+
+static int accumulator_init(lua_State *L) {
+    luaC_superinit(L);
+    return 0;
+}
+
+static int accumulator_receive(lua_State *L) {
+    accumulator *acc =
+        (accumulator *)luaC_checkuclass(L, 1, "lcltests.Accumulator");
+    acc->sum += luaL_checknumber(L, 2);
+    return 0;
+}
+
+static int accumulator_sum(lua_State *L) {
+    accumulator *acc =
+        (accumulator *)luaC_checkuclass(L, 1, "lcltests.Accumulator");
+    lua_pushnumber(L, acc->sum);
+    return 1;
+}
+
+static luaL_Reg accumulator_methods[] = {
+    {"new",     accumulator_init   },
+    {"receive", accumulator_receive},
+    {"sum",     accumulator_sum    },
+    {NULL,      NULL               }
+};
+
+luaC_Class accumulator_class = {
+    .name      = "Accumulator",
+    .parent    = "lcltests.Actor",
+    .user_ctor = 1,
+    .alloc     = NULL,
+    .gc        = NULL,
+    .methods   = accumulator_methods,
+    .flags     = LUAC_ZEROINIT,
+    .size      = sizeof(accumulator),
+    .nuv       = LUAC_ACTOR_NUV};
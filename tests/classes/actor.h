@@ -0,0 +1,3 @@
+#include <luaclassactor.h>
+
+extern luaC_Class accumulator_class;
@@ -6,15 +6,6 @@ typedef struct {
     int blocked;
 } blocking_signal;
 
-static void blocking_signal_alloc(lua_State *L) {
-    blocking_signal *sig =
-        (blocking_signal *)lua_newuserdatauv(L, sizeof(blocking_signal), 2);
-    lua_newtable(L);
-    lua_setiuservalue(L, -2, 2);
-    reflist_init(&sig->slots);
-    sig->blocked = 0;
-}
-
 static int blocking_signal_block(lua_State *L) {
     blocking_signal *sig =
         (blocking_signal *)luaC_checkuclass(L, 1, "lcltests.BlockingSignal");
@@ -47,6 +38,9 @@ luaC_Class blocking_signal_class = {
     .name      = "BlockingSignal",
     .parent    = "lcltests.Signal",
     .user_ctor = 0,
-    .alloc     = blocking_signal_alloc,
+    .alloc     = NULL,
     .gc        = NULL,
-    .methods   = blocking_signal_methods};
+    .methods   = blocking_signal_methods,
+    .flags     = LUAC_ZEROINIT,
+    .size      = sizeof(blocking_signal),
+    .nuv       = 3};
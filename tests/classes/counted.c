@@ -0,0 +1,136 @@
+#include "counted.h"
+#include <time.h>
+
+#define UNUSED(...) (void)(__VA_ARGS__)
+
+// classes for checking when and how often destructors run
+int counted_finalized, skipped_finalized;
+
+static void counted_alloc(lua_State *L) {
+    lua_newuserdatauv(L, sizeof(int), 1);
+}
+
+static void counted_gc(lua_State *L, void *p) {
+    UNUSED(L);
+    UNUSED(p);
+    counted_finalized++;
+}
+
+static void skipped_gc(lua_State *L, void *p) {
+    UNUSED(L);
+    UNUSED(p);
+    skipped_finalized++;
+}
+
+// busy waits for SLOW_GC_NS
+static void slow_gc(lua_State *L, void *p) {
+    struct timespec start, now;
+    UNUSED(L);
+    UNUSED(p);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do clock_gettime(CLOCK_MONOTONIC, &now);
+    while ((now.tv_sec - start.tv_sec) * 1000000000ll +
+               (now.tv_nsec - start.tv_nsec) <
+           SLOW_GC_NS);
+}
+
+static int metered_ping(lua_State *L) {
+    lua_pushliteral(L, "pong");
+    return 1;
+}
+
+static luaL_Reg no_methods[] = {
+    {NULL, NULL}
+};
+
+static luaL_Reg metered_methods[] = {
+    {"ping", metered_ping},
+    {NULL,   NULL        }
+};
+
+luaC_Class counted_class = {
+    .name      = "Counted",
+    .parent    = NULL,
+    .user_ctor = 1,
+    .alloc     = counted_alloc,
+    .gc        = counted_gc,
+    .methods   = no_methods};
+
+// destructor that may be skipped by luaC_fastclose
+luaC_Class skipped_class = {
+    .name      = "Skipped",
+    .parent    = "lcltests.Counted",
+    .user_ctor = 1,
+    .alloc     = counted_alloc,
+    .gc        = skipped_gc,
+    .methods   = no_methods,
+    .flags     = LUAC_SKIPONCLOSE};
+
+// user data class without a destructor
+luaC_Class plain_class = {
+    .name      = "Plain",
+    .parent    = NULL,
+    .user_ctor = 1,
+    .alloc     = counted_alloc,
+    .gc        = NULL,
+    .methods   = no_methods};
+
+// adds a destructor, inherits the allocator
+luaC_Class plain_derived_class = {
+    .name      = "PlainDerived",
+    .parent    = "lcltests.Plain",
+    .user_ctor = 1,
+    .alloc     = NULL,
+    .gc        = counted_gc,
+    .methods   = no_methods};
+
+// allocated by LCL
+luaC_Class managed_class = {
+    .name      = "Managed",
+    .parent    = NULL,
+    .user_ctor = 1,
+    .alloc     = NULL,
+    .gc        = NULL,
+    .methods   = no_methods,
+    .flags     = LUAC_ZEROINIT,
+    .size      = 4 * sizeof(int),
+    .nuv       = 3};
+
+// registered with metrics enabled
+luaC_Class metered_class = {
+    .name      = "Metered",
+    .parent    = NULL,
+    .user_ctor = 1,
+    .alloc     = counted_alloc,
+    .gc        = NULL,
+    .methods   = metered_methods};
+
+// writes to instances mark them dirty
+luaC_Class tracked_class = {
+    .name      = "Tracked",
+    .parent    = NULL,
+    .user_ctor = 1,
+    .alloc     = NULL,
+    .gc        = NULL,
+    .methods   = no_methods,
+    .flags     = LUAC_ZEROINIT | LUAC_TRACKDIRTY,
+    .size      = sizeof(int)};
+
+// table class asking for dirty tracking, which cannot be registered
+luaC_Class tracked_table_class = {
+    .name      = "TrackedTable",
+    .parent    = NULL,
+    .user_ctor = 1,
+    .alloc     = NULL,
+    .gc        = NULL,
+    .methods   = no_methods,
+    .flags     = LUAC_TRACKDIRTY};
+
+// destructor that takes a while
+luaC_Class slow_class = {
+    .name      = "Slow",
+    .parent    = NULL,
+    .user_ctor = 1,
+    .alloc     = counted_alloc,
+    .gc        = slow_gc,
+    .methods   = no_methods};
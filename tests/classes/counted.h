@@ -0,0 +1,16 @@
+#include <luaclasslib.h>
+
+extern int counted_finalized, skipped_finalized;
+
+// how long destructors of Slow take, in nanoseconds
+#define SLOW_GC_NS 200000
+
+extern luaC_Class counted_class;
+extern luaC_Class skipped_class;
+extern luaC_Class plain_class;
+extern luaC_Class plain_derived_class;
+extern luaC_Class managed_class;
+extern luaC_Class metered_class;
+extern luaC_Class tracked_class;
+extern luaC_Class tracked_table_class;
+extern luaC_Class slow_class;
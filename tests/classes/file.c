@@ -7,12 +7,6 @@ typedef struct {
     char *name;
 } file_t;
 
-// allocator
-static void file_alloc(lua_State *L) {
-    // must have at least one user value
-    lua_newuserdatauv(L, sizeof(file_t), 1);
-}
-
 // garbage collector. free any resources used by the object here.
 // note that we do not free the pointer itself; it is a userdata and
 // will be freed by the lua garbage collector.
@@ -71,6 +65,9 @@ luaC_Class file_class = {
     .name      = "File",
     .parent    = NULL,
     .user_ctor = 1,
-    .alloc     = file_alloc,
+    .alloc     = NULL,
     .gc        = file_gc,
-    .methods   = file_methods};
+    .methods   = file_methods,
+    .flags     = LUAC_ZEROINIT,   // gc is safe even if init never runs
+    .size      = sizeof(file_t),  // let LCL allocate the user data
+    .nuv       = 1};
@@ -0,0 +1,31 @@
+#include <math.h>
+#include "point.h"
+#include "point3.h"
+
+// methods of the generated Point and Point3 classes
+int point3_finalized;
+
+int point_length(lua_State *L, point *self) {
+    lua_pushnumber(L, sqrt(self->x * self->x + self->y * self->y));
+    return 1;
+}
+
+int point_scale(lua_State *L, point *self) {
+    lua_Number k = luaL_checknumber(L, 2);
+    self->x     *= k;
+    self->y     *= k;
+    self->hits++;
+    return 0;
+}
+
+int point3_length3(lua_State *L, point3 *self) {
+    point *p = &self->super;
+    lua_pushnumber(L, sqrt(p->x * p->x + p->y * p->y + self->z * self->z));
+    return 1;
+}
+
+void point3_gc(lua_State *L, point3 *self) {
+    (void)L;
+    (void)self;
+    point3_finalized++;
+}
@@ -0,0 +1,4 @@
+#include "point.h"
+#include "point3.h"
+
+extern int point3_finalized;
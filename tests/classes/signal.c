@@ -5,22 +5,96 @@ typedef struct {
     SIGNAL_HEADER
 } signal;
 
-static void signal_alloc(lua_State *L) {
-    signal *sig = (signal *)lua_newuserdatauv(L, sizeof(signal), 2);
-    lua_newtable(L);
-    lua_setiuservalue(L, -2, 2);
-    reflist_init(&sig->slots);
-}
-
 static void signal_gc(lua_State *L, void *p) {
     reflist_wipe(&((signal *)p)->slots);
 }
 
+// pushes the slot table, which maps slot pointers to the slots
+static void signal_getslots(lua_State *L) {
+    if (lua_getiuservalue(L, 1, 2) != LUA_TTABLE) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setiuservalue(L, 1, 2);
+    }
+}
+
+// pushes the weak slot table, which maps receivers to sets of method names.
+// the receivers are weak keys, so they are removed by the garbage collector.
+static void signal_getweakslots(lua_State *L) {
+    if (lua_getiuservalue(L, 1, 3) != LUA_TTABLE) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "k");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_pushvalue(L, -1);
+        lua_setiuservalue(L, 1, 3);
+    }
+}
+
+// connects the method named by argument 3 of the receiver at argument 2
+static int signal_connectweak(lua_State *L) {
+    luaL_checkany(L, 2);
+    luaL_checkstring(L, 3);
+    signal_getweakslots(L);
+    lua_pushvalue(L, 2);
+
+    if (lua_rawget(L, -2) != LUA_TTABLE) {  // get the receiver's methods
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, 2);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, -4);  // slots[receiver] = methods
+    }
+
+    lua_pushvalue(L, 3);
+    if (!lua_getmetatable(L, 2)) lua_pushboolean(L, 1);
+    lua_rawset(L, -3);  // methods[name] = metatable or true
+    return 0;
+}
+
+// checks that the receiver at the given index still has the metatable it was
+// connected with, which is on top of the stack. finalized objects stay in the
+// weak slot table until the next collection, but their metatables are gone.
+static int signal_islive(lua_State *L, int idx) {
+    if (!lua_istable(L, -1)) return 1;  // connected without a metatable
+    if (!lua_getmetatable(L, idx)) return 0;
+    int live = lua_rawequal(L, -1, -2);
+    lua_pop(L, 1);
+    return live;
+}
+
+static int signal_disconnectweak(lua_State *L) {
+    luaL_checkstring(L, 3);
+    signal_getweakslots(L);
+    lua_pushvalue(L, 2);
+
+    if (lua_rawget(L, -2) == LUA_TTABLE) {
+        lua_pushvalue(L, 3);
+        lua_pushnil(L);
+        lua_rawset(L, -3);  // methods[name] = nil
+        lua_pushnil(L);
+
+        if (lua_next(L, -2) == 0) {  // no methods left
+            lua_pushvalue(L, 2);
+            lua_pushnil(L);
+            lua_rawset(L, -4);  // slots[receiver] = nil
+        }
+    }
+
+    return 0;
+}
+
 static int signal_connect(lua_State *L) {
     signal     *sig = (signal *)luaC_checkuclass(L, 1, "lcltests.Signal");
+    if (lua_type(L, 3) == LUA_TSTRING) return signal_connectweak(L);
     const void *ref = lua_topointer(L, 2);
     if (ref != NULL) {
-        luaC_uvrawsetp(L, 1, 2, ref);
+        signal_getslots(L);
+        lua_pushvalue(L, 2);
+        lua_rawsetp(L, -2, ref);  // slots[ref] = slot
         reflist_insert(&sig->slots, ref);
     }
     return 0;
@@ -28,6 +102,7 @@ static int signal_connect(lua_State *L) {
 
 static int signal_disconnect(lua_State *L) {
     signal      *sig  = (signal *)luaC_checkuclass(L, 1, "lcltests.Signal");
+    if (lua_type(L, 3) == LUA_TSTRING) return signal_disconnectweak(L);
     const void  *ref  = lua_topointer(L, 2);
     const void **elem = reflist_lookup(&sig->slots, &ref);
     if (elem != NULL) {
@@ -38,10 +113,11 @@ static int signal_disconnect(lua_State *L) {
     return 0;
 }
 
-static int signal_call(lua_State *L) {
+// runs the slots, with the signal and arguments on the stack
+static int signal_emit(lua_State *L) {
     signal *sig   = (signal *)luaC_checkuclass(L, 1, "lcltests.Signal");
     int     nargs = lua_gettop(L) - 1;
-    lua_getiuservalue(L, 1, 2);
+    signal_getslots(L);
     lua_insert(L, 2);
     foreach (slot, sig->slots) {
         lua_rawgetp(L, 2, *slot);
@@ -49,12 +125,66 @@ static int signal_call(lua_State *L) {
             lua_pushvalue(L, i + 3);
         lua_call(L, nargs, 0);
     }
+
+    if (lua_getiuservalue(L, 1, 3) != LUA_TTABLE) return 0;
+
+    // collect the live weak slots on the stack first, so that slots may
+    // connect and disconnect while the signal is being emitted
+    int weak = lua_gettop(L), n = 0;
+    lua_pushnil(L);
+    while (lua_next(L, weak) != 0) {
+        lua_pushnil(L);
+        while (lua_next(L, -2) != 0) {
+            luaL_checkstack(L, 4, "too many weak slots");
+            int live = signal_islive(L, -4);
+            lua_pop(L, 1);  // pop the metatable
+            if (!live) continue;
+            lua_pushvalue(L, -3);  // push receiver
+            lua_pushvalue(L, -2);  // push method name
+            lua_rotate(L, -5, 2);  // move them below the iteration state
+            n++;
+        }
+        lua_pop(L, 1);  // pop methods
+    }
+
+    for (int i = 0; i < n; i++) {
+        int recv = weak + 2 * i + 1;
+        lua_pushvalue(L, recv + 1);
+        lua_gettable(L, recv);  // get the method from the receiver
+        lua_pushvalue(L, recv);
+        for (int j = 0; j < nargs; j++)
+            lua_pushvalue(L, j + 3);
+        lua_call(L, nargs + 1, 0);
+    }
+
+    return 0;
+}
+
+static int signal_call(lua_State *L) {
+    signal *sig = (signal *)luaC_checkuclass(L, 1, "lcltests.Signal");
+    if (!sig->deferred) return signal_emit(L);
+
+    // queue the emission until the next flush
+    lua_pushcfunction(L, signal_emit);
+    lua_insert(L, 1);
+    luaC_defer(L, lua_gettop(L) - 1, sig->deferred - 1);
+    return 0;
+}
+
+// sets how emissions are deferred: "last" delivers only the latest arguments,
+// "accumulate" delivers a list of all of them, and nil emits immediately
+static int signal_defer(lua_State *L) {
+    static const char *const modes[] = {"last", "accumulate", NULL};
+    signal *sig = (signal *)luaC_checkuclass(L, 1, "lcltests.Signal");
+    sig->deferred =
+        lua_isnoneornil(L, 2) ? 0 : luaL_checkoption(L, 2, NULL, modes) + 1;
     return 0;
 }
 
 static luaL_Reg signal_methods[] = {
     {"connect",    signal_connect   },
     {"disconnect", signal_disconnect},
+    {"defer",      signal_defer     },
     {"__call",     signal_call      },
     {NULL,         NULL             }
 };
@@ -63,6 +193,9 @@ luaC_Class signal_class = {
     .name      = "Signal",
     .parent    = NULL,
     .user_ctor = 0,
-    .alloc     = signal_alloc,
+    .alloc     = NULL,
     .gc        = signal_gc,
-    .methods   = signal_methods};
+    .methods   = signal_methods,
+    .flags     = LUAC_ZEROINIT,   // an empty slot list is all zeros
+    .size      = sizeof(signal),  // let LCL allocate the user data
+    .nuv       = 3};
@@ -11,6 +11,8 @@ static inline int ref_cmp(const void *a, const void *b) {
 
 binary_array_def(const void *, reflist, DO_NOTHING, ref_cmp);
 
-#define SIGNAL_HEADER reflist slots;
+#define SIGNAL_HEADER \
+    reflist slots;    \
+    int     deferred;  // 0 for immediate emission, otherwise defer mode + 1
 
 extern luaC_Class signal_class;
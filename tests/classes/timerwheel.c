@@ -0,0 +1,282 @@
+#include "timerwheel.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define UNUSED(...) (void)(__VA_ARGS__)
+
+// hierarchical timing wheel. level 0 has a slot per tick, and each slot of the
+// levels above is WHEEL_SLOTS times as wide as a slot of the level below. a
+// timer goes in the lowest level whose slots are narrower than its delay. when
+// time reaches the start of a higher level slot, its timers are cascaded down,
+// so every timer reaches level 0 by the time it fires.
+//
+// timers live in an array of nodes, linked into their slots by index, so
+// scheduling and cancelling take constant time and do not allocate unless the
+// array grows. the callables are kept in user value 2, at the node index + 1.
+#define WHEEL_BITS   8
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_MAX    ((1ull << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+typedef struct {
+    uint64_t expires;     // the tick the timer fires on
+    int      next, prev;  // neighbours in the slot, or -1. free nodes use next
+    int      slot;        // the slot holding the timer, or -1 if the node is free
+    uint32_t gen;         // incremented each time the node is freed
+} timer_node;
+
+typedef struct {
+    uint64_t    now;        // the current tick
+    timer_node *nodes;      // the node array
+    int         cap;        // the size of the node array
+    int         free;       // the first free node, or -1
+    int         pending;    // the number of scheduled timers
+    int         advancing;  // whether expired timers are being delivered
+    int         slots[WHEEL_LEVELS * WHEEL_SLOTS];  // the first node in each
+} timer_wheel;
+
+// delivers the expired timers of a tick, clearing the batch as it goes
+static const char *dispatch_chunk =
+    "local batch, n = ...\n"
+    "for i = 1, n do\n"
+    "  local t = batch[i]\n"
+    "  batch[i] = nil\n"
+    "  t()\n"
+    "end\n";
+
+static const char dispatch_key = 0;
+
+static void timer_wheel_alloc(lua_State *L) {
+    timer_wheel *w = (timer_wheel *)lua_newuserdatauv(L, sizeof(timer_wheel), 3);
+    w->now         = 0;
+    w->nodes       = NULL;
+    w->cap         = 0;
+    w->free        = -1;
+    w->pending     = 0;
+    w->advancing   = 0;
+    for (int i = 0; i < WHEEL_LEVELS * WHEEL_SLOTS; i++)
+        w->slots[i] = -1;
+    lua_newtable(L);
+    lua_setiuservalue(L, -2, 2);  // callables
+    lua_newtable(L);
+    lua_setiuservalue(L, -2, 3);  // batch of expired timers
+}
+
+static void timer_wheel_gc(lua_State *L, void *p) {
+    UNUSED(L);
+    free(((timer_wheel *)p)->nodes);
+}
+
+// puts node *i* in the slot for its expiry tick
+static void wheel_link(timer_wheel *w, int i) {
+    timer_node *n     = &w->nodes[i];
+    uint64_t    delta = n->expires - w->now, e = n->expires;
+    int         level = 0;
+
+    if (delta > WHEEL_MAX) {  // out of range, park it in the last slot
+        delta = WHEEL_MAX;
+        e     = w->now + WHEEL_MAX;
+    }
+
+    while (level < WHEEL_LEVELS - 1 &&
+           delta >= (1ull << (WHEEL_BITS * (level + 1))))
+        level++;
+
+    n->slot = level * WHEEL_SLOTS +
+              (int)((e >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    n->prev = -1;
+    n->next = w->slots[n->slot];
+    if (n->next >= 0) w->nodes[n->next].prev = i;
+    w->slots[n->slot] = i;
+}
+
+// takes node *i* out of its slot
+static void wheel_unlink(timer_wheel *w, int i) {
+    timer_node *n = &w->nodes[i];
+    if (n->prev >= 0) w->nodes[n->prev].next = n->next;
+    else w->slots[n->slot] = n->next;
+    if (n->next >= 0) w->nodes[n->next].prev = n->prev;
+}
+
+static int wheel_alloc_node(lua_State *L, timer_wheel *w) {
+    if (w->free < 0) {
+        int         cap   = w->cap ? w->cap * 2 : 64;
+        timer_node *nodes = realloc(w->nodes, cap * sizeof(timer_node));
+        if (!nodes) luaL_error(L, "Not enough memory for timers.");
+
+        for (int i = w->cap; i < cap; i++) {
+            nodes[i].slot = -1;
+            nodes[i].gen  = 0;
+            nodes[i].next = i + 1 < cap ? i + 1 : -1;
+        }
+
+        w->free  = w->cap;
+        w->nodes = nodes;
+        w->cap   = cap;
+    }
+
+    int i   = w->free;
+    w->free = w->nodes[i].next;
+    w->pending++;
+    return i;
+}
+
+static void wheel_free_node(timer_wheel *w, int i) {
+    timer_node *n = &w->nodes[i];
+    n->slot       = -1;
+    n->gen++;
+    n->next = w->free;
+    w->free = i;
+    w->pending--;
+}
+
+// advances the wheel by one tick, cascading higher level slots that start on
+// it. the callables of the expired timers are moved from the table at index
+// *targets* to the table at index *batch*, and their count is returned.
+static int wheel_tick(lua_State *L, timer_wheel *w, int targets, int batch) {
+    int top = 0, n = 0;
+    w->now++;
+
+    while (top < WHEEL_LEVELS - 1 &&
+           !(w->now & ((1ull << (WHEEL_BITS * (top + 1))) - 1)))
+        top++;
+
+    for (int level = top; level > 0; level--) {
+        int *slot = &w->slots
+                        [level * WHEEL_SLOTS +
+                         (int)((w->now >> (WHEEL_BITS * level)) & WHEEL_MASK)];
+        int  i    = *slot;
+        *slot     = -1;
+        while (i >= 0) {
+            int next = w->nodes[i].next;
+            wheel_link(w, i);
+            i = next;
+        }
+    }
+
+    int *slot = &w->slots[w->now & WHEEL_MASK];
+    int  i    = *slot;
+    *slot     = -1;
+    while (i >= 0) {
+        int next = w->nodes[i].next;
+        lua_rawgeti(L, targets, i + 1);
+        lua_rawseti(L, batch, ++n);
+        lua_pushnil(L);
+        lua_rawseti(L, targets, i + 1);
+        wheel_free_node(w, i);
+        i = next;
+    }
+
+    return n;
+}
+
+// schedules the callable in argument 3 to be called after argument 2 ticks,
+// and returns a handle for cancelling it. delays shorter than a tick are
+// rounded up to one.
+static int timer_wheel_schedule(lua_State *L) {
+    timer_wheel *w = (timer_wheel *)luaC_checkuclass(L, 1, "lcltests.TimerWheel");
+    lua_Integer delay = luaL_checkinteger(L, 2);
+    luaL_checkany(L, 3);
+    int i = wheel_alloc_node(L, w);
+
+    w->nodes[i].expires = w->now + (uint64_t)(delay < 1 ? 1 : delay);
+    wheel_link(w, i);
+    lua_getiuservalue(L, 1, 2);
+    lua_pushvalue(L, 3);
+    lua_rawseti(L, -2, i + 1);
+    lua_pushinteger(L, (lua_Integer)((uint64_t)w->nodes[i].gen << 32 | i));
+    return 1;
+}
+
+// cancels the timer with the handle in argument 2. returns false if it has
+// already fired or been cancelled.
+static int timer_wheel_cancel(lua_State *L) {
+    timer_wheel *w = (timer_wheel *)luaC_checkuclass(L, 1, "lcltests.TimerWheel");
+    lua_Integer id = luaL_checkinteger(L, 2);
+    lua_Integer i  = id & 0xffffffff;
+
+    if (i >= w->cap || w->nodes[i].slot < 0 ||
+        w->nodes[i].gen != (uint32_t)((lua_Unsigned)id >> 32)) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    wheel_unlink(w, (int)i);
+    wheel_free_node(w, (int)i);
+    lua_getiuservalue(L, 1, 2);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, i + 1);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// advances the wheel by argument 2 ticks (default 1). the timers expiring on
+// each tick are delivered with a single call into Lua. returns the number of
+// timers fired. if a timer raises an error, the rest of its tick is dropped.
+static int timer_wheel_advance(lua_State *L) {
+    timer_wheel *w = (timer_wheel *)luaC_checkuclass(L, 1, "lcltests.TimerWheel");
+    lua_Integer ticks = luaL_optinteger(L, 2, 1), fired = 0;
+
+    if (w->advancing) return luaL_error(L, "Timer wheel is already advancing.");
+
+    lua_settop(L, 1);
+    lua_getiuservalue(L, 1, 2);  // 2: callables
+    lua_getiuservalue(L, 1, 3);  // 3: batch
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &dispatch_key) != LUA_TFUNCTION) {
+        lua_pop(L, 1);
+        luaL_loadstring(L, dispatch_chunk);
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &dispatch_key);
+    }                            // 4: dispatcher
+
+    w->advancing = 1;
+    for (lua_Integer t = 0; t < ticks; t++) {
+        int n = wheel_tick(L, w, 2, 3);
+        if (n == 0) continue;
+
+        lua_pushvalue(L, 4);
+        lua_pushvalue(L, 3);
+        lua_pushinteger(L, n);
+        if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+            w->advancing = 0;
+            lua_newtable(L);  // the failed batch may still hold callables
+            lua_setiuservalue(L, 1, 3);
+            return lua_error(L);
+        }
+        fired += n;
+    }
+    w->advancing = 0;
+
+    lua_pushinteger(L, fired);
+    return 1;
+}
+
+static int timer_wheel_pending(lua_State *L) {
+    timer_wheel *w = (timer_wheel *)luaC_checkuclass(L, 1, "lcltests.TimerWheel");
+    lua_pushinteger(L, w->pending);
+    return 1;
+}
+
+static int timer_wheel_now(lua_State *L) {
+    timer_wheel *w = (timer_wheel *)luaC_checkuclass(L, 1, "lcltests.TimerWheel");
+    lua_pushinteger(L, (lua_Integer)w->now);
+    return 1;
+}
+
+static luaL_Reg timer_wheel_methods[] = {
+    {"schedule", timer_wheel_schedule},
+    {"cancel",   timer_wheel_cancel  },
+    {"advance",  timer_wheel_advance },
+    {"pending",  timer_wheel_pending },
+    {"now",      timer_wheel_now     },
+    {NULL,       NULL                }
+};
+
+luaC_Class timer_wheel_class = {
+    .name      = "TimerWheel",
+    .parent    = NULL,
+    .user_ctor = 1,
+    .alloc     = timer_wheel_alloc,
+    .gc        = timer_wheel_gc,
+    .methods   = timer_wheel_methods};
@@ -0,0 +1,3 @@
+#include <luaclasslib.h>
+
+extern luaC_Class timer_wheel_class;
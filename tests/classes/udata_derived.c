@@ -5,10 +5,6 @@ typedef struct {
     void *handle;
 } udata_derived;
 
-static void udata_derived_alloc(lua_State *L) {
-    lua_newuserdatauv(L, sizeof(udata_derived), 1);
-}
-
 static void udata_derived_gc(lua_State *L, void *p) {
     udata_derived *o = (udata_derived *)p;
     if (o->handle) {
@@ -53,6 +49,8 @@ luaC_Class udata_derived_class = {
     .name      = "UdataDerived",
     .parent    = "Base",
     .user_ctor = 0,
-    .alloc     = udata_derived_alloc,
+    .alloc     = NULL,
     .gc        = udata_derived_gc,
-    .methods   = udata_derived_methods};
+    .methods   = udata_derived_methods,
+    .flags     = LUAC_ZEROINIT,
+    .size      = sizeof(udata_derived)};
@@ -0,0 +1,421 @@
+#include "writer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define UNUSED(...) (void)(__VA_ARGS__)
+
+// buffered file writer. writes are copied into a large buffer, and a write
+// that does not fit is sent to the file together with the buffered bytes in a
+// single writev call, so many small strings cost one system call and are never
+// concatenated. optionally, a background thread writes out full buffers while
+// the Lua thread fills a second one, so writing only blocks when the disk falls
+// a whole buffer behind.
+#define WRITER_BUFSIZE (64 * 1024)
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+typedef struct {
+    int             fd;        // the file, or -1 once closed
+    char           *buf;       // the buffer being filled
+    size_t          cap;       // the size of each buffer
+    size_t          len;       // the number of bytes in the buffer
+    struct iovec   *iov;       // scratch vector for writev
+    int             iovcap;    // the size of the vector
+    int             error;     // the first write error, or 0
+    long long       bytes;     // the number of bytes written to the file
+    long long       syscalls;  // the number of write calls made
+    int             threaded;  // whether the background thread is running
+    pthread_t       thread;    // the background thread
+    pthread_mutex_t lock;      // guards the fields below, and the counters and
+                               // error while the thread is running
+    pthread_cond_t  work;      // signalled when a buffer is handed off
+    pthread_cond_t  idle;      // signalled when the thread finishes one
+    char           *pending;   // the buffer being written by the thread
+    size_t          plen;      // its length, or 0 when the thread is idle
+    char           *spare;     // the buffer to fill next
+    int             stop;      // tells the thread to exit
+} writer_t;
+
+// writes the whole vector to *fd*, retrying partial writes. returns 0 or an
+// error number, and adds to the byte and call counts.
+static int
+write_all(int fd, struct iovec *iov, int n, long long *bytes, long long *calls) {
+    while (n > 0) {
+        ssize_t w = writev(fd, iov, n < IOV_MAX ? n : IOV_MAX);
+        ++*calls;
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+
+        *bytes += w;
+        while (n > 0 && (size_t)w >= iov->iov_len) {
+            w -= (ssize_t)iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= (size_t)w;
+        }
+    }
+
+    return 0;
+}
+
+static void *writer_thread(void *p) {
+    writer_t *w = p;
+    pthread_mutex_lock(&w->lock);
+
+    for (;;) {
+        while (!w->plen && !w->stop)
+            pthread_cond_wait(&w->work, &w->lock);
+        if (!w->plen) break;  // stopped with nothing left to write
+
+        struct iovec iov = {w->pending, w->plen};
+        long long    bytes = 0, calls = 0;
+        pthread_mutex_unlock(&w->lock);
+        int err = write_all(w->fd, &iov, 1, &bytes, &calls);
+        pthread_mutex_lock(&w->lock);
+
+        if (err && !w->error) w->error = err;
+        w->bytes += bytes;
+        w->syscalls += calls;
+        w->spare   = w->pending;
+        w->pending = NULL;
+        w->plen    = 0;
+        pthread_cond_signal(&w->idle);
+    }
+
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+// waits for the background thread to finish the buffer it is writing
+static void writer_wait(writer_t *w) {
+    pthread_mutex_lock(&w->lock);
+    while (w->plen)
+        pthread_cond_wait(&w->idle, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// hands the buffer to the background thread and starts filling the spare
+static void writer_handoff(writer_t *w) {
+    if (!w->len) return;
+
+    pthread_mutex_lock(&w->lock);
+    while (w->plen)
+        pthread_cond_wait(&w->idle, &w->lock);
+    w->pending = w->buf;
+    w->plen    = w->len;
+    w->buf     = w->spare;
+    w->spare   = NULL;
+    w->len     = 0;
+    pthread_cond_signal(&w->work);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// writes out the buffer. returns 0 or an error number.
+static int writer_flush(writer_t *w) {
+    int err = 0;
+
+    if (w->threaded) {
+        writer_handoff(w);
+        writer_wait(w);
+        pthread_mutex_lock(&w->lock);
+        err = w->error;
+        pthread_mutex_unlock(&w->lock);
+    } else if (w->len) {
+        struct iovec iov = {w->buf, w->len};
+        err              = write_all(w->fd, &iov, 1, &w->bytes, &w->syscalls);
+        if (err && !w->error) w->error = err;
+        err = w->error;
+    } else err = w->error;
+
+    w->len = 0;
+    return err;
+}
+
+// writes the first *n* entries of the scratch vector, which together hold
+// *total* bytes. returns 0 or an error number.
+static int writer_put(writer_t *w, int n, size_t total) {
+    if (total <= w->cap - w->len) {  // it all fits in the buffer
+        for (int i = 0; i < n; i++) {
+            memcpy(w->buf + w->len, w->iov[i].iov_base, w->iov[i].iov_len);
+            w->len += w->iov[i].iov_len;
+        }
+        return 0;
+    }
+
+    if (w->threaded) {
+        // fill buffers for the thread, and write strings too large to buffer
+        // directly once it has caught up
+        for (int i = 0; i < n; i++) {
+            const char *s   = w->iov[i].iov_base;
+            size_t      len = w->iov[i].iov_len;
+
+            if (len > w->cap) {
+                writer_handoff(w);
+                writer_wait(w);
+                long long bytes = 0, calls = 0;
+                int err = write_all(w->fd, &w->iov[i], 1, &bytes, &calls);
+                pthread_mutex_lock(&w->lock);
+                if (err && !w->error) w->error = err;
+                w->bytes += bytes;
+                w->syscalls += calls;
+                pthread_mutex_unlock(&w->lock);
+                continue;
+            }
+
+            while (len > 0) {
+                size_t room = w->cap - w->len, k = len < room ? len : room;
+                memcpy(w->buf + w->len, s, k);
+                w->len += k;
+                s += k;
+                len -= k;
+                if (w->len == w->cap) writer_handoff(w);
+            }
+        }
+
+        pthread_mutex_lock(&w->lock);
+        int err = w->error;
+        pthread_mutex_unlock(&w->lock);
+        return err;
+    }
+
+    // send the buffer and the strings in one call. the buffer takes the slot
+    // reserved in front of the strings.
+    w->iov[-1].iov_base = w->buf;
+    w->iov[-1].iov_len  = w->len;
+    int err = write_all(w->fd, w->iov - 1, n + 1, &w->bytes, &w->syscalls);
+    w->len  = 0;
+    if (err && !w->error) w->error = err;
+    return err;
+}
+
+// makes room for *n* entries in the scratch vector, after a reserved one
+static void writer_reserve(lua_State *L, writer_t *w, int n) {
+    if (n + 1 <= w->iovcap) return;
+
+    int           cap = n + 1 < 64 ? 64 : n + 1;
+    struct iovec *iov = w->iov ? w->iov - 1 : NULL;
+    iov               = realloc(iov, cap * sizeof(struct iovec));
+    if (!iov) luaL_error(L, "not enough memory");
+    w->iov    = iov + 1;
+    w->iovcap = cap;
+}
+
+static writer_t *writer_check(lua_State *L) {
+    writer_t *w = (writer_t *)luaC_checkuclass(L, 1, "lcltests.Writer");
+    if (w->fd < 0) luaL_error(L, "Writer is closed.");
+    return w;
+}
+
+// returns the writer on success, or nil and the error message
+static int writer_result(lua_State *L, int err) {
+    if (err) {
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(err));
+        lua_pushinteger(L, err);
+        return 3;
+    }
+
+    lua_settop(L, 1);
+    return 1;
+}
+
+// stops the background thread, writing out everything buffered, and closes the
+// file. returns 0 or an error number.
+static int writer_close_file(writer_t *w) {
+    int err = writer_flush(w);
+
+    if (w->threaded) {
+        pthread_mutex_lock(&w->lock);
+        w->stop = 1;
+        pthread_cond_signal(&w->work);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->thread, NULL);
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->work);
+        pthread_cond_destroy(&w->idle);
+        w->threaded = 0;
+    }
+
+    if (close(w->fd) != 0 && !err) err = errno;
+    w->fd = -1;
+    return err;
+}
+
+// flushes the writer and frees its buffers. the user data is zeroed on
+// allocation, so this is safe even if init never ran.
+static void writer_gc(lua_State *L, void *p) {
+    UNUSED(L);
+    writer_t *w = (writer_t *)p;
+    if (w->buf && w->fd >= 0) writer_close_file(w);
+    free(w->buf);
+    free(w->spare);
+    free(w->iov ? w->iov - 1 : NULL);
+    w->buf   = NULL;
+    w->spare = NULL;
+    w->iov   = NULL;
+}
+
+// opens the file named by argument 2 for writing. argument 3 is an optional
+// table of options: `size`, the size of the buffer, `background`, whether to
+// write full buffers from a background thread, and `append`, whether to append
+// to the file instead of truncating it.
+static int writer_init(lua_State *L) {
+    writer_t   *w      = (writer_t *)luaC_checkuclass(L, 1, "lcltests.Writer");
+    const char *name   = luaL_checkstring(L, 2);
+    lua_Integer size   = WRITER_BUFSIZE;
+    int         append = 0, background = 0;
+
+    if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        lua_getfield(L, 3, "size");
+        size = luaL_optinteger(L, -1, WRITER_BUFSIZE);
+        lua_getfield(L, 3, "append");
+        append = lua_toboolean(L, -1);
+        lua_getfield(L, 3, "background");
+        background = lua_toboolean(L, -1);
+        lua_pop(L, 3);
+        luaL_argcheck(L, size > 0, 3, "buffer size must be positive");
+    }
+
+    w->fd    = -1;
+    w->cap   = (size_t)size;
+    w->buf   = malloc(w->cap);
+    w->spare = background ? malloc(w->cap) : NULL;
+    if (!w->buf || (background && !w->spare))
+        return luaL_error(L, "not enough memory");
+    writer_reserve(L, w, 1);
+
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+    if ((w->fd = open(name, flags, 0666)) < 0)
+        return luaL_error(L, "Cannot open %s: %s", name, strerror(errno));
+
+    if (background) {
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->work, NULL);
+        pthread_cond_init(&w->idle, NULL);
+        if (pthread_create(&w->thread, NULL, writer_thread, w) != 0) {
+            pthread_mutex_destroy(&w->lock);
+            pthread_cond_destroy(&w->work);
+            pthread_cond_destroy(&w->idle);
+            return luaL_error(L, "Cannot start writer thread.");
+        }
+        w->threaded = 1;
+    }
+
+    return 0;
+}
+
+// writes each argument, which must be a string or a number. returns the writer,
+// or nil and an error message.
+static int writer_write(lua_State *L) {
+    writer_t *w     = writer_check(L);
+    int       n     = lua_gettop(L) - 1;
+    size_t    total = 0;
+    writer_reserve(L, w, n);
+
+    for (int i = 0; i < n; i++) {
+        size_t len;
+        w->iov[i].iov_base = (void *)luaL_checklstring(L, i + 2, &len);
+        w->iov[i].iov_len  = len;
+        total += len;
+    }
+
+    return writer_result(L, writer_put(w, n, total));
+}
+
+// writes the strings in the list in argument 2, from index *i* (default 1) to
+// *j* (default the length of the list). returns the writer, or nil and an error
+// message.
+static int writer_writev(lua_State *L) {
+    writer_t   *w = writer_check(L);
+    lua_Integer i = luaL_optinteger(L, 3, 1);
+    lua_Integer j = luaL_opt(L, luaL_checkinteger, 4, luaL_len(L, 2));
+    size_t      total = 0;
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    if (i > j) return writer_result(L, 0);
+    luaL_argcheck(L, j - i < INT_MAX, 4, "too many strings");
+
+    int n = (int)(j - i + 1);
+    writer_reserve(L, w, n);
+
+    // the strings stay alive in the list, so their contents can be used after
+    // they are popped
+    for (int k = 0; k < n; k++) {
+        if (lua_rawgeti(L, 2, i + k) != LUA_TSTRING)
+            return luaL_error(
+                L,
+                "Value at index %d is not a string.",
+                (int)(i + k));
+        size_t len;
+        w->iov[k].iov_base = (void *)lua_tolstring(L, -1, &len);
+        w->iov[k].iov_len  = len;
+        total += len;
+        lua_pop(L, 1);
+    }
+
+    return writer_result(L, writer_put(w, n, total));
+}
+
+// writes out the buffer, waiting for the background thread if there is one.
+// returns the writer, or nil and an error message.
+static int writer_flush_method(lua_State *L) {
+    writer_t *w = writer_check(L);
+    return writer_result(L, writer_flush(w));
+}
+
+// flushes and closes the file. returns the writer, or nil and an error message.
+static int writer_close(lua_State *L) {
+    writer_t *w = writer_check(L);
+    return writer_result(L, writer_close_file(w));
+}
+
+// returns the number of bytes written to the file so far, and the number of
+// write calls it took. bytes still in the buffer are not counted.
+static int writer_stats(lua_State *L) {
+    writer_t *w = (writer_t *)luaC_checkuclass(L, 1, "lcltests.Writer");
+    long long bytes, calls;
+
+    if (w->threaded) pthread_mutex_lock(&w->lock);
+    bytes = w->bytes;
+    calls = w->syscalls;
+    if (w->threaded) pthread_mutex_unlock(&w->lock);
+
+    lua_pushinteger(L, (lua_Integer)bytes);
+    lua_pushinteger(L, (lua_Integer)calls);
+    return 2;
+}
+
+static luaL_Reg writer_methods[] = {
+    {"new",    writer_init        },
+    {"write",  writer_write       },
+    {"writev", writer_writev      },
+    {"flush",  writer_flush_method},
+    {"close",  writer_close       },
+    {"stats",  writer_stats       },
+    {NULL,     NULL               }
+};
+
+luaC_Class writer_class = {
+    .name      = "Writer",
+    .parent    = NULL,
+    .user_ctor = 1,
+    .alloc     = NULL,
+    .gc        = writer_gc,
+    .methods   = writer_methods,
+    .flags     = LUAC_ZEROINIT,     // gc is safe even if init never runs
+    .size      = sizeof(writer_t),  // let LCL allocate the user data
+    .nuv       = 1};
@@ -0,0 +1,82 @@
+#include "tests.hpp"
+extern "C" {
+#include "classes/points.h"
+}
+
+TEST_SUITE("Code Generation") {
+    TEST_CASE("Generated Classes") {
+        LCL_TEST_BEGIN
+
+        REQUIRE(point_register(L));
+        register_lcl_class(L);
+        REQUIRE(point3_register(L));
+        register_lcl_class(L);
+        LCL_CHECKSTACK(0);
+
+        SUBCASE("Fields") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local Point = require('lcltests').Point\n"
+                        "local p = Point{x = 3, y = 4, label = 'a'}\n"
+                        "assert(p.x == 3 and p.y == 4 and p.label == 'a')\n"
+                        "assert(p.hits == 0 and p.visible == false)\n"
+                        "assert(p:length() == 5)\n"
+                        "p:scale(2)\n"
+                        "assert(p.x == 6 and p.y == 8 and p.hits == 1)\n"
+                        "p.visible = true\n"
+                        "p.extra = 'e'\n"
+                        "assert(p.visible and p.extra == 'e')\n"
+                        "assert(not pcall(function() p.x = 'no' end))\n"
+                        "assert(not pcall(function() p.hits = 1.5 end))\n"
+                        "local t = p:totable()\n"
+                        "assert(t.x == 6 and t.label == 'a' and t.visible)\n"
+                        "assert(t.extra == nil)") == LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Inheritance") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local lcl = require('lcl')\n"
+                        "local Point3 = require('lcltests').Point3\n"
+                        "local tag = {}\n"
+                        "q = Point3{x = 1, y = 2, z = 2, label = 'l', tag = tag}\n"
+                        "assert(q:length3() == 3)\n"
+                        "assert(q:length() == math.sqrt(5))\n"
+                        "assert(q.x == 1 and q.label == 'l' and q.tag == tag)\n"
+                        "assert(#lcl.dirty() == 0)\n"
+                        "q.z = 5\n"
+                        "assert(lcl.dirty(true)[1] == q)\n"
+                        "local t = q:totable()\n"
+                        "assert(t.x == 1 and t.z == 5 and t.tag == tag)") ==
+                    LUA_OK);
+            LCL_CHECKSTACK(0);
+
+            lua_getglobal(L, "q");
+            point3 *q = point3_check(L, -1);
+            REQUIRE(q->z == 5);
+            REQUIRE(point_check(L, -1) == &q->super);
+            lua_pop(L, 1);
+
+            lua_pushnil(L);
+            lua_setglobal(L, "q");
+            lua_gc(L, LUA_GCCOLLECT);
+            REQUIRE(point3_finalized == 1);
+        }
+
+        SUBCASE("Self Check") {
+            luaC_construct(L, 0, "lcltests.Point");
+            REQUIRE(point_check(L, -1) == lua_touserdata(L, -1));
+            lua_pushcfunction(L, [](lua_State *L) -> int {
+                point3_check(L, 1);
+                return 0;
+            });
+            lua_insert(L, -2);
+            REQUIRE(lua_pcall(L, 1, 0, 0) != LUA_OK);
+            lua_pop(L, 1);
+            LCL_CHECKSTACK(0);
+        }
+
+        LCL_TEST_END
+    }
+}
@@ -0,0 +1,134 @@
+#include "tests.hpp"
+#include <luaclasscoro.hpp>
+#include <string>
+extern "C" {
+#include "classes/simple.h"
+}
+
+static lcl::task<int> wait_twice(lcl::loop &lp, lua_State *L, int n) {
+    lua_getglobal(L, "waiter");
+    lua_pushinteger(L, n);
+    int nres = co_await lcl::mcall(lp, L, "wait", 1, 1);
+    int ret  = (int)lua_tointeger(L, -1);
+    lua_pop(L, nres + 1);  // pop result and object
+
+    lua_getglobal(L, "waiter");
+    lua_pushinteger(L, n);
+    co_await lcl::mcall(lp, L, "wait", 1, 1);
+    ret += (int)lua_tointeger(L, -1);
+    lua_pop(L, 2);
+    co_return ret;
+}
+
+static lcl::task<> fail(lcl::loop &lp, lua_State *L, std::string &msg) {
+    lua_getglobal(L, "waiter");
+    try {
+        co_await lcl::mcall(lp, L, "fail", 0);
+    } catch (const lcl::lua_error &e) { msg = e.what(); }
+    lua_pop(L, 1);
+}
+
+static lcl::task<int> count_args(lcl::loop &lp, lua_State *L, int n) {
+    luaL_checkstack(L, n + 1, "too many arguments");
+    lua_getglobal(L, "count");
+    for (int i = 0; i < n; i++)
+        lua_pushinteger(L, i);
+    co_await lcl::call(lp, L, n, 1);
+    int ret = (int)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    co_return ret;
+}
+
+static lcl::task<int> construct_simple(lcl::loop &lp, lua_State *L) {
+    lua_pushnumber(L, 7);
+    co_await lcl::construct(lp, L, 1, "lcltests.SimpleBase");
+    lua_pushnumber(L, 3);
+    luaC_mcall(L, "foo", 1, 1);
+    int ret = (int)lua_tointeger(L, -1);
+    lua_pop(L, 2);
+    co_return ret;
+}
+
+TEST_SUITE("Coroutines") {
+    TEST_CASE("Awaiting Method Calls") {
+        LCL_TEST_BEGIN
+
+        luaL_dostring(
+            L,
+            "waiter = {turns = 0}\n"
+            "function waiter:wait(n)\n"
+            "  for i = 1, n do\n"
+            "    coroutine.yield()\n"
+            "    self.turns = self.turns + 1\n"
+            "  end\n"
+            "  return n * 10\n"
+            "end\n"
+            "function waiter:fail()\n"
+            "  coroutine.yield()\n"
+            "  error('oops', 0)\n"
+            "end\n"
+            "function count(...)\n"
+            "  coroutine.yield()\n"
+            "  return select('#', ...)\n"
+            "end");
+        LCL_CHECKSTACK(0);
+
+        lcl::loop lp;
+
+        SUBCASE("Concurrent Calls") {
+            auto a = wait_twice(lp, L, 3);
+            auto b = wait_twice(lp, L, 1);
+            auto c = wait_twice(lp, L, 0);  // finishes without yielding
+            REQUIRE(c.done());
+            REQUIRE(c.get() == 0);
+            REQUIRE(lp.pending() == 2);
+
+            int turns = 0;
+            while (lp.run_once())
+                turns++;
+            REQUIRE(turns == 5);
+            REQUIRE(a.done());
+            REQUIRE(b.done());
+            REQUIRE(a.get() == 60);
+            REQUIRE(b.get() == 20);
+            LCL_CHECKSTACK(0);
+
+            lua_getglobal(L, "waiter");
+            lua_getfield(L, -1, "turns");
+            REQUIRE(lua_tointeger(L, -1) == 8);
+            lua_pop(L, 2);
+        }
+
+        SUBCASE("Errors") {
+            std::string msg;
+            auto   t = fail(lp, L, msg);
+            REQUIRE_FALSE(t.done());
+            lp.run();
+            REQUIRE(t.done());
+            REQUIRE(msg == "oops");
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Many Arguments") {
+            // more arguments than a new thread has stack space for
+            auto t = count_args(lp, L, 4 * LUA_MINSTACK);
+            lp.run();
+            REQUIRE(t.done());
+            REQUIRE(t.get() == 4 * LUA_MINSTACK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Construction") {
+            luaC_newclass(L, "SimpleBase", NULL, simple_base_class_methods);
+            register_lcl_class(L);
+
+            auto t = construct_simple(lp, L);
+            lp.run();
+            REQUIRE(t.done());
+            REQUIRE(t.get() == 21);
+            LCL_CHECKSTACK(0);
+        }
+
+        LCL_TEST_END
+    }
+}
@@ -0,0 +1,100 @@
+#include "tests.hpp"
+extern "C" {
+#include "classes/counted.h"
+}
+
+TEST_SUITE("Dirty Tracking") {
+    TEST_CASE("Dirty Objects") {
+        LCL_TEST_BEGIN
+
+        lua_pushlightuserdata(L, &tracked_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        lua_pushlightuserdata(L, &plain_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+
+        luaL_dostring(
+            L,
+            "local lcltests = require('lcltests')\n"
+            "a = lcltests.Tracked()\n"
+            "b = lcltests.Tracked()\n"
+            "c = lcltests.Plain()\n"
+            "d = require('TrackedDerived')()");
+        LCL_CHECKSTACK(0);
+
+        SUBCASE("Writes") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local lcl = require('lcl')\n"
+                        "assert(#lcl.dirty() == 0)\n"
+                        "c.x = 1\n"
+                        "assert(#lcl.dirty() == 0)\n"
+                        "b.x = 1\n"
+                        "a.x = 1\n"
+                        "a.y = 2\n"
+                        "d.x = 1\n"
+                        "local dirty = lcl.dirty()\n"
+                        "assert(#dirty == 3)\n"
+                        "assert(dirty[1] == b and dirty[2] == a)\n"
+                        "assert(dirty[3] == d)\n"
+                        "assert(a.x == 1 and a.y == 2 and b.x == 1)\n"
+                        "lcl.dirty(true)\n"
+                        "d.x = 2\n"  // existing fields are tracked too
+                        "dirty = lcl.dirty()\n"
+                        "assert(#dirty == 1 and dirty[1] == d)") ==
+                    LUA_OK);
+            LCL_CHECKSTACK(0);
+
+            lua_getglobal(L, "d");
+            REQUIRE(luaC_isdirty(L, -1));
+            lua_getglobal(L, "c");
+            REQUIRE_FALSE(luaC_isdirty(L, -1));
+            lua_pop(L, 2);
+        }
+
+        SUBCASE("Table Classes") {
+            // table instances cannot track writes to existing fields
+            lua_pushlightuserdata(L, &tracked_table_class);
+            REQUIRE_FALSE(luaC_classfromptr(L));
+            LCL_CHECKSTACK(0);
+            REQUIRE(luaC_pushclass(L, "lcltests.TrackedTable") == LUA_TNIL);
+            lua_pop(L, 1);
+        }
+
+        SUBCASE("Marking From C") {
+            lua_getglobal(L, "c");
+            luaC_markdirty(L, -1);
+            luaC_markdirty(L, -1);
+            REQUIRE(luaC_isdirty(L, -1));
+            lua_pop(L, 1);
+            REQUIRE(luaC_pushdirty(L, 0) == 1);
+            lua_pop(L, 1);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Clearing") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local lcl = require('lcl')\n"
+                        "a.x = 1\n"
+                        "lcl.markdirty(c)\n"
+                        "local dirty = lcl.dirty(true)\n"
+                        "assert(#dirty == 2)\n"
+                        "assert(#lcl.dirty() == 0)\n"
+                        "a.x = 2\n"
+                        "dirty = lcl.dirty(true)\n"
+                        "assert(#dirty == 1 and dirty[1] == a)") ==
+                    LUA_OK);
+
+            lua_getglobal(L, "a");
+            REQUIRE_FALSE(luaC_isdirty(L, -1));
+            lua_pop(L, 1);
+            REQUIRE(luaC_pushdirty(L, 1) == 0);
+            lua_pop(L, 1);
+            LCL_CHECKSTACK(0);
+        }
+
+        LCL_TEST_END
+    }
+}
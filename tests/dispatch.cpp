@@ -0,0 +1,159 @@
+#include "tests.hpp"
+extern "C" {
+static luaL_Reg dispatch_methods[] = {
+    {NULL, NULL}
+};
+
+// a method returning *name* and its third argument, if any
+static void push_method(lua_State *L, const char *name) {
+    lua_pushfstring(L, "return function(a, b, x) return '%s', x end", name);
+    luaL_dostring(L, lua_tostring(L, -1));
+    lua_remove(L, -2);
+}
+}
+
+TEST_SUITE("Multiple Dispatch") {
+    TEST_CASE("Generic Functions") {
+        LCL_TEST_BEGIN
+
+        REQUIRE(luaC_newclass(L, "Entity", NULL, dispatch_methods));
+        register_lcl_class(L);
+        REQUIRE(luaC_newclass(L, "Ship", "lcltests.Entity", dispatch_methods));
+        register_lcl_class(L);
+        REQUIRE(luaC_newclass(L, "Station", "lcltests.Ship", dispatch_methods));
+        register_lcl_class(L);
+        REQUIRE(
+            luaC_newclass(L, "Asteroid", "lcltests.Entity", dispatch_methods));
+        register_lcl_class(L);
+
+        luaC_newgeneric(L, "collide", 2);
+        lua_pushstring(L, "lcltests.Entity");
+        lua_pushstring(L, "lcltests.Entity");
+        push_method(L, "entities");
+        luaC_defmethod(L, 1);
+        lua_pushstring(L, "lcltests.Ship");
+        lua_pushstring(L, "lcltests.Asteroid");
+        push_method(L, "ship-asteroid");
+        luaC_defmethod(L, 1);
+        luaC_pushclass(L, "lcltests.Asteroid");
+        lua_pushnil(L);
+        push_method(L, "asteroid-any");
+        luaC_defmethod(L, 1);
+        LCL_CHECKSTACK(1);
+        lua_pushvalue(L, 1);
+        lua_setglobal(L, "collide");
+
+        REQUIRE(luaL_dostring(
+                    L,
+                    "local lcltests = require('lcltests')\n"
+                    "ship = lcltests.Ship()\n"
+                    "station = lcltests.Station()\n"
+                    "asteroid = lcltests.Asteroid()\n") == LUA_OK);
+
+        SUBCASE("Selection") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "assert(collide(ship, asteroid) == 'ship-asteroid')\n"
+                        "assert(collide(station, asteroid) == 'ship-asteroid')\n"
+                        "assert(collide(ship, station) == 'entities')\n"
+                        "assert(collide(asteroid, ship) == 'asteroid-any')\n"
+                        "assert(collide(asteroid, 5) == 'asteroid-any')\n"
+                        "assert(select(2, collide(ship, asteroid, 'x')) == 'x')\n"
+                        "-- repeat calls are served from the cache\n"
+                        "for i = 1, 3 do\n"
+                        "  assert(collide(station, asteroid) == 'ship-asteroid')\n"
+                        "  assert(collide(asteroid, ship) == 'asteroid-any')\n"
+                        "end") == LUA_OK);
+
+            lua_getglobal(L, "ship");
+            lua_getglobal(L, "asteroid");
+            CHECK(luaC_pushmethod(L, 1, 2));
+            CHECK(lua_isfunction(L, -1));
+            lua_pop(L, 3);
+
+            // non-objects only match nil
+            lua_pushinteger(L, 1);
+            lua_pushstring(L, "x");
+            CHECK_FALSE(luaC_pushmethod(L, 1, 2));
+            CHECK(lua_isnil(L, -1));
+            lua_pop(L, 3);
+            LCL_CHECKSTACK(1);
+
+            CHECK(luaL_dostring(L, "collide(1, 'x')") != LUA_OK);
+            CHECK(
+                std::string(lua_tostring(L, -1)).find(
+                    "No method of collide applies to (number, string).") !=
+                std::string::npos);
+            lua_pop(L, 1);
+        }
+
+        SUBCASE("Invalidation") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "assert(collide(ship, station) == 'entities')") ==
+                    LUA_OK);
+
+            // defining a method clears the cache
+            lua_pushstring(L, "lcltests.Ship");
+            lua_pushstring(L, "lcltests.Ship");
+            push_method(L, "ships");
+            luaC_defmethod(L, 1);
+
+            // as does creating a class
+            REQUIRE(luaC_newclass(
+                L,
+                "Comet",
+                "lcltests.Asteroid",
+                dispatch_methods));
+            register_lcl_class(L);
+            LCL_CHECKSTACK(1);
+
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local lcltests = require('lcltests')\n"
+                        "local comet = lcltests.Comet()\n"
+                        "assert(collide(ship, station) == 'ships')\n"
+                        "assert(collide(station, comet) == 'ship-asteroid')\n"
+                        "assert(collide(comet, comet) == 'asteroid-any')") ==
+                    LUA_OK);
+
+            // redefining a method replaces it
+            lua_pushstring(L, "lcltests.Ship");
+            lua_pushstring(L, "lcltests.Ship");
+            push_method(L, "ships again");
+            luaC_defmethod(L, 1);
+            REQUIRE(luaL_dostring(
+                        L,
+                        "assert(collide(ship, station) == 'ships again')") ==
+                    LUA_OK);
+        }
+
+        SUBCASE("Lua API") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local lcl = require('lcl')\n"
+                        "local lcltests = require('lcltests')\n"
+                        "local describe = lcl.generic(1, 'describe')\n"
+                        "lcl.defmethod(describe, lcltests.Ship, function(s)\n"
+                        "  return 'ship'\n"
+                        "end)\n"
+                        "lcl.defmethod(describe, nil, function(v)\n"
+                        "  return type(v)\n"
+                        "end)\n"
+                        "assert(describe(station) == 'ship')\n"
+                        "assert(describe(asteroid) == 'table')\n"
+                        "assert(describe(5) == 'number')\n"
+                        "assert(lcl.findmethod(describe, station)(station) == "
+                        "'ship')\n"
+                        "assert(not pcall(lcl.generic, 0))\n"
+                        "assert(not pcall(lcl.defmethod, describe, 5, print))\n"
+                        "local g = lcl.generic(2)\n"
+                        "assert(lcl.findmethod(g, ship, ship) == nil)\n"
+                        "local ok, err = pcall(g, ship, ship)\n"
+                        "assert(err:find('No method applies to %(Ship, Ship%)'))") ==
+                    LUA_OK);
+        }
+
+        LCL_TEST_END
+    }
+}
@@ -0,0 +1,107 @@
+#include "tests.hpp"
+extern "C" {
+#include "classes/counted.h"
+
+static const luaC_Class *slow_reported;
+
+static void on_slow(
+    lua_State         *,
+    const luaC_Class  *c,
+    unsigned long long ns,
+    void              *ud) {
+    if (ns >= SLOW_GC_NS) (*(int *)ud)++;
+    slow_reported = c;
+}
+}
+
+static void make_objects(lua_State *L, const char *name, int n) {
+    for (int i = 0; i < n; i++) {
+        luaC_construct(L, 0, name);
+        lua_pop(L, 1);
+    }
+}
+
+TEST_SUITE("Finalizer Timing") {
+    TEST_CASE("Finalizer Stats") {
+        LCL_TEST_BEGIN
+
+        lua_pushlightuserdata(L, &counted_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        lua_pushlightuserdata(L, &slow_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        LCL_CHECKSTACK(0);
+
+        SUBCASE("C") {
+            luaC_FinalizerStats s;
+            int                 slow = 0;
+
+            // nothing is recorded until timing starts
+            make_objects(L, "lcltests.Counted", 4);
+            lua_gc(L, LUA_GCCOLLECT);
+            REQUIRE_FALSE(luaC_getfinalizerstats(L, &counted_class, &s));
+
+            luaC_profilefinalizers(L, 1, SLOW_GC_NS / 2, on_slow, &slow);
+            make_objects(L, "lcltests.Counted", 10);
+            make_objects(L, "lcltests.Slow", 3);
+            lua_gc(L, LUA_GCCOLLECT);
+            LCL_CHECKSTACK(0);
+
+            REQUIRE(luaC_getfinalizerstats(L, &counted_class, &s));
+            CHECK(s.uclass == &counted_class);
+            CHECK(s.calls == 10);
+            CHECK(s.slow == 0);
+
+            REQUIRE(luaC_getfinalizerstats(L, &slow_class, &s));
+            CHECK(s.calls == 3);
+            CHECK(s.slow == 3);
+            CHECK(s.max_ns >= SLOW_GC_NS);
+            CHECK(s.total_ns >= 3 * SLOW_GC_NS);
+            unsigned long long sum = 0;
+            for (int b = 0; b < LUAC_FINALIZER_BUCKETS; b++)
+                sum += s.histogram[b];
+            CHECK(sum == 3);
+            CHECK(s.histogram[0] == 0);
+            CHECK(slow == 3);
+            CHECK(slow_reported == &slow_class);
+
+            luaC_FinalizerStats all[4];
+            CHECK(luaC_snapshotfinalizers(L, all, 4) == 2);
+            CHECK(luaC_snapshotfinalizers(L, NULL, 0) == 2);
+
+            // stats are kept, but no longer updated, when timing stops
+            luaC_profilefinalizers(L, 0, 0, NULL, NULL);
+            make_objects(L, "lcltests.Slow", 2);
+            lua_gc(L, LUA_GCCOLLECT);
+            REQUIRE(luaC_getfinalizerstats(L, &slow_class, &s));
+            CHECK(s.calls == 3);
+            CHECK(slow == 3);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Lua") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local lcl = require('lcl')\n"
+                        "local Slow = require('lcltests').Slow\n"
+                        "local reports = {}\n"
+                        "lcl.profilefinalizers(true, 100000, function(name, ns)\n"
+                        "  reports[#reports + 1] = name\n"
+                        "  error('ignored')\n"
+                        "end)\n"
+                        "for i = 1, 2 do Slow() end\n"
+                        "collectgarbage()\n"
+                        "lcl.profilefinalizers(false)\n"
+                        "local s = lcl.finalizerstats().Slow\n"
+                        "assert(s.calls == 2 and s.slow == 2)\n"
+                        "assert(s.max_ns >= 200000)\n"
+                        "assert(#s.histogram == 32)\n"
+                        "assert(#reports == 2 and reports[1] == 'Slow')") ==
+                    LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        LCL_TEST_END
+    }
+}
@@ -0,0 +1,127 @@
+#include "tests.hpp"
+extern "C" {
+#include "classes/counted.h"
+}
+
+TEST_SUITE("Handles") {
+    TEST_CASE("Handles") {
+        LCL_TEST_BEGIN
+
+        lua_pushlightuserdata(L, &counted_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        lua_pushlightuserdata(L, &plain_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        LCL_CHECKSTACK(0);
+
+        SUBCASE("Strong") {
+            REQUIRE(luaC_construct(L, 0, "lcltests.Counted"));
+            luaC_Handle h = luaC_newhandle(L, -1, 0);
+            REQUIRE(h != LUAC_NOHANDLE);
+            lua_pop(L, 1);
+
+            // the handle keeps the object alive
+            int finalized = counted_finalized;
+            lua_gc(L, LUA_GCCOLLECT);
+            CHECK(counted_finalized == finalized);
+            REQUIRE(luaC_pushhandle(L, h) == LUA_TUSERDATA);
+            CHECK(luaC_isinstance(L, -1, "lcltests.Counted"));
+            lua_pop(L, 1);
+
+            CHECK(luaC_releasehandle(L, h));
+            CHECK_FALSE(luaC_releasehandle(L, h));
+            CHECK(luaC_pushhandle(L, h) == LUA_TNIL);
+            lua_pop(L, 1);
+            lua_gc(L, LUA_GCCOLLECT);
+            CHECK(counted_finalized == finalized + 1);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Stale") {
+            // a reused slot does not bring stale handles back to life
+            REQUIRE(luaC_construct(L, 0, "lcltests.Plain"));
+            luaC_Handle h1 = luaC_newhandle(L, 1, 0);
+            REQUIRE(luaC_releasehandle(L, h1));
+            luaC_Handle h2 = luaC_newhandle(L, 1, 0);
+            CHECK((h1 & 0xffffffff) == (h2 & 0xffffffff));
+            CHECK(h1 != h2);
+            CHECK(luaC_pushhandle(L, h1) == LUA_TNIL);
+            CHECK(luaC_pushhandle(L, h2) == LUA_TUSERDATA);
+            CHECK(lua_rawequal(L, 1, -1));
+            lua_pop(L, 2);
+            CHECK_FALSE(luaC_releasehandle(L, h1));
+            CHECK(luaC_pushhandle(L, h2) == LUA_TUSERDATA);
+            lua_pop(L, 1);
+
+            // handles that were never handed out are stale too
+            CHECK(luaC_pushhandle(L, h2 + 1) == LUA_TNIL);
+            CHECK(luaC_pushhandle(L, LUAC_NOHANDLE) == LUA_TNIL);
+            lua_pop(L, 2);
+            CHECK(luaC_releasehandle(L, h2));
+            LCL_CHECKSTACK(1);
+
+            lua_pushinteger(L, 1);
+            CHECK(luaC_newhandle(L, -1, 0) == LUAC_NOHANDLE);
+            lua_pop(L, 2);
+        }
+
+        SUBCASE("Weak") {
+            REQUIRE(luaC_construct(L, 0, "lcltests.Counted"));
+            luaC_Handle h1 = luaC_newhandle(L, 1, 1);
+            luaC_Handle h2 = luaC_newhandle(L, 1, 1);
+            luaC_Handle h3 = luaC_newhandle(L, 1, 1);
+            CHECK(luaC_pushhandle(L, h2) == LUA_TUSERDATA);
+            CHECK(lua_rawequal(L, 1, -1));
+            lua_pop(L, 1);
+            CHECK(luaC_releasehandle(L, h2));
+
+            // the finalizer releases the remaining handles
+            int finalized = counted_finalized;
+            lua_pop(L, 1);
+            lua_gc(L, LUA_GCCOLLECT);
+            CHECK(counted_finalized == finalized + 1);
+            CHECK(luaC_pushhandle(L, h1) == LUA_TNIL);
+            CHECK(luaC_pushhandle(L, h3) == LUA_TNIL);
+            lua_pop(L, 2);
+            CHECK_FALSE(luaC_releasehandle(L, h1));
+            CHECK_FALSE(luaC_releasehandle(L, h3));
+
+            // without a finalizer, the handle goes stale but keeps its slot
+            REQUIRE(luaC_construct(L, 0, "lcltests.Plain"));
+            luaC_Handle h4 = luaC_newhandle(L, 1, 1);
+            lua_pop(L, 1);
+            lua_gc(L, LUA_GCCOLLECT);
+            CHECK(luaC_pushhandle(L, h4) == LUA_TNIL);
+            lua_pop(L, 1);
+            CHECK(luaC_releasehandle(L, h4));
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Many") {
+            luaC_Handle hs[1000];
+            for (int i = 0; i < 1000; i++) {
+                REQUIRE(luaC_construct(L, 0, "lcltests.Plain"));
+                lua_pushinteger(L, i);
+                lua_setfield(L, -2, "i");
+                hs[i] = luaC_newhandle(L, -1, i % 2);
+                if (i % 2) lua_setfield(L, LUA_REGISTRYINDEX, "keep");
+                else lua_pop(L, 1);
+            }
+
+            for (int i = 0; i < 1000; i += 2) {
+                REQUIRE(luaC_pushhandle(L, hs[i]) == LUA_TUSERDATA);
+                lua_getfield(L, -1, "i");
+                CHECK(lua_tointeger(L, -1) == i);
+                lua_pop(L, 2);
+                CHECK(luaC_releasehandle(L, hs[i]));
+            }
+
+            for (int i = 1; i < 1000; i += 2)
+                luaC_releasehandle(L, hs[i]);
+            LCL_CHECKSTACK(0);
+        }
+
+        LCL_TEST_END
+    }
+}
@@ -0,0 +1,143 @@
+#include "tests.hpp"
+extern "C" {
+#include "classes/points.h"
+
+static int json_plain_greet(lua_State *L) {
+    lua_pushliteral(L, "hi");
+    return 1;
+}
+
+static luaL_Reg json_plain_methods[] = {
+    {"greet", json_plain_greet},
+    {NULL,    NULL            }
+};
+}
+
+TEST_SUITE("JSON") {
+    TEST_CASE("JSON") {
+        LCL_TEST_BEGIN
+
+        REQUIRE(point_register(L));
+        register_lcl_class(L);
+        REQUIRE(point3_register(L));
+        register_lcl_class(L);
+        REQUIRE(luaC_newclass(L, "JsonPlain", NULL, json_plain_methods));
+        register_lcl_class(L);
+        luaL_dostring(
+            L,
+            "lcl = require('lcl')\n"
+            "Point = require('lcltests').Point\n"
+            "Point3 = require('lcltests').Point3\n");
+        LCL_CHECKSTACK(0);
+
+        SUBCASE("Values") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "assert(lcl.tojson(nil) == 'null')\n"
+                        "assert(lcl.tojson({1, 2.5, 'a\\n\"', true}) ==\n"
+                        "       '[1,2.5,\"a\\\\n\\\\\"\",true]')\n"
+                        "assert(lcl.tojson(3.0) == '3.0')\n"
+                        "assert(lcl.tojson(0.1) == '0.1')\n"
+                        "assert(lcl.tojson('\\1') == '\"\\\\u0001\"')\n"
+                        "assert(lcl.tojson({}) == '{}')\n"
+                        "assert(lcl.tojson({a = {b = false}}) == "
+                        "'{\"a\":{\"b\":false}}')\n"
+                        "local t = {x = 1, y = {1, 2, {z = 'w'}}, s = 'é'}\n"
+                        "local d = lcl.fromjson(lcl.tojson(t))\n"
+                        "assert(d.x == 1 and math.type(d.x) == 'integer')\n"
+                        "assert(d.y[3].z == 'w' and d.s == 'é')\n"
+                        "assert(lcl.fromjson('1e2') == 100.0)\n"
+                        "assert(lcl.fromjson(' [ ] ')[1] == nil)\n"
+                        "assert(lcl.fromjson('\"\\\\u00e9\\\\ud83d\\\\ude00\"') "
+                        "== 'é\\u{1F600}')\n"
+                        "assert(lcl.fromjson('[null, 1]')[2] == 1)") ==
+                    LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Errors") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "assert(not pcall(lcl.tojson, {print}))\n"
+                        "assert(not pcall(lcl.tojson, 0 / 0))\n"
+                        "assert(not pcall(lcl.tojson, {[true] = 1}))\n"
+                        "local t = {}\n"
+                        "t.t = t\n"
+                        "assert(not pcall(lcl.tojson, t))\n"
+                        "for _, s in ipairs({'', '[1,]', '{\"a\" 1}', '01',\n"
+                        "                    '\"abc', 'tru', '[1] 2',\n"
+                        "                    '\"\\\\x\"', '-'}) do\n"
+                        "  local v, err = lcl.fromjson(s)\n"
+                        "  assert(v == nil and err:find('at byte'), s)\n"
+                        "end\n"
+                        "local v, err = lcl.fromjson('{}', 'lcltests.None')\n"
+                        "assert(v == nil and err:find('not registered'))\n"
+                        "v, err = lcl.fromjson('{\"x\": \"1\"}', "
+                        "'lcltests.Point')\n"
+                        "assert(v == nil and err:find('number'))\n"
+                        "v, err = lcl.fromjson('{\"hits\": 1.5}', "
+                        "'lcltests.Point')\n"
+                        "assert(v == nil and err:find('integer'))") == LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Objects") {
+            // declared fields first, then the user value table
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local p = Point{x = 3, y = 4.5, label = 'a'}\n"
+                        "assert(lcl.tojson(p) == '{\"x\":3.0,\"y\":4.5,"
+                        "\"hits\":0,\"visible\":false,\"label\":\"a\"}')\n"
+                        "p.extra = {1, 2}\n"
+                        "local d = lcl.fromjson(lcl.tojson(p))\n"
+                        "assert(d.x == 3 and d.extra[2] == 2)\n"
+                        "local q = Point3{x = 1, z = 2, tag = {n = 1}}\n"
+                        "d = lcl.fromjson(lcl.tojson(q))\n"
+                        "assert(d.x == 1 and d.z == 2 and d.tag.n == 1)\n"
+                        "assert(d.label == nil)\n"
+                        "local o = require('lcltests').JsonPlain()\n"
+                        "o.name = 'plain'\n"
+                        "assert(lcl.tojson(o) == '{\"name\":\"plain\"}')\n"
+                        "assert(lcl.tojson({p, o}):find('^%[{\"x\":3.0'))") ==
+                    LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Decoding Instances") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local ps = lcl.fromjson('[{\"x\": 3, \"y\": 4, "
+                        "\"hits\": 2, \"visible\": true, \"label\": \"a\", "
+                        "\"extra\": {\"n\": [1]}}, {\"x\": -1.5e1}]', "
+                        "'lcltests.Point')\n"
+                        "local p = ps[1]\n"
+                        "assert(lcl.rawget(p, 'x') == nil)\n"
+                        "assert(p.x == 3 and p.y == 4 and p.hits == 2)\n"
+                        "assert(p.visible and p.label == 'a')\n"
+                        "assert(p.extra.n[1] == 1 and p:length() == 5)\n"
+                        "assert(ps[2].x == -15 and ps[2].hits == 0)\n"
+                        "local q = lcl.fromjson('{\"z\": 2, \"y\": 1, "
+                        "\"tag\": [true], \"label\": null}', "
+                        "'lcltests.Point3')\n"
+                        "assert(q.z == 2 and q.y == 1 and q.tag[1])\n"
+                        "assert(q:length3() == math.sqrt(5))\n"
+                        "local o = lcl.fromjson('{\"name\": \"x\"}', "
+                        "'lcltests.JsonPlain')\n"
+                        "assert(rawget(o, 'name') == 'x' and o:greet() == "
+                        "'hi')") == LUA_OK);
+            LCL_CHECKSTACK(0);
+
+            // the C API takes a length, so documents need not be terminated
+            const char doc[] = "{\"x\": 2}garbage";
+            REQUIRE(luaC_fromjson(L, doc, 8, "lcltests.Point"));
+            REQUIRE(luaC_isinstance(L, -1, "lcltests.Point"));
+            CHECK(point_check(L, -1)->x == 2);
+            lua_pop(L, 1);
+            CHECK_FALSE(luaC_fromjson(L, doc, sizeof(doc) - 1, NULL));
+            lua_pop(L, 1);
+            LCL_CHECKSTACK(0);
+        }
+
+        LCL_TEST_END
+    }
+}
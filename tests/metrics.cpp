@@ -0,0 +1,92 @@
+#include "tests.hpp"
+#include <string>
+#include <thread>
+extern "C" {
+#include "classes/counted.h"
+}
+
+TEST_SUITE("Metrics") {
+    TEST_CASE("Process-Wide Metrics") {
+        LCL_TEST_BEGIN
+
+        luaC_Metrics m;
+        luaC_enablemetrics(1);
+        lua_pushlightuserdata(L, &metered_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        REQUIRE(luaC_getmetrics(&metered_class, &m));
+        long long base = m.constructions, calls = m.calls;
+
+        // a second state adds to the same counters
+        lua_State *L2 = luaL_newstate();
+        luaL_openlibs(L2);
+        lua_pushlightuserdata(L2, &metered_class);
+        luaC_classfromptr(L2);
+        lua_pop(L2, 1);
+        luaC_enablemetrics(0);
+
+        luaL_dostring(
+            L,
+            "local Metered = require('lcltests').Metered\n"
+            "local objs = {}\n"
+            "for i = 1, 5 do objs[i] = Metered() end\n"
+            "for i = 1, 3 do assert(objs[i]:ping() == 'pong') end");
+        LCL_CHECKSTACK(0);
+
+        REQUIRE(luaC_getmetrics(&metered_class, &m));
+        REQUIRE(m.uclass == &metered_class);
+        REQUIRE(m.constructions - base == 5);
+        REQUIRE(m.calls - calls == 3);
+        REQUIRE(m.live >= 5);
+
+        lua_pushlightuserdata(L2, &metered_class);
+        luaC_classfromptr(L2);
+        luaC_getbase(L2, -1);
+        lua_getfield(L2, -1, "ping");
+        lua_pushnil(L2);
+        lua_call(L2, 1, 0);
+        lua_close(L2);
+
+        lua_gc(L, LUA_GCCOLLECT);
+
+        // readable from any thread
+        std::thread([&] { luaC_getmetrics(&metered_class, &m); }).join();
+        REQUIRE(m.finalizations >= 5);
+        REQUIRE(m.live == m.constructions - m.finalizations);
+        REQUIRE(m.calls - calls == 4);
+
+        luaC_Metrics all[8];
+        size_t       n = luaC_snapshotmetrics(all, 8), found = 0;
+        for (size_t i = 0; i < n && i < 8; i++)
+            found += all[i].uclass == &metered_class;
+        REQUIRE(found == 1);
+
+        size_t      len = luaC_formatmetrics(NULL, 0);
+        std::string text(len, '\0');
+        REQUIRE(luaC_formatmetrics(text.data(), len + 1) == len);
+        std::string line = "lcl_constructions_total{class=\"Metered\"} " +
+                           std::to_string(m.constructions) + "\n";
+        REQUIRE(text.find("# TYPE lcl_live_instances gauge\n") !=
+                std::string::npos);
+        REQUIRE(text.find(line) != std::string::npos);
+
+        // objects whose init fails are still finalized, and were live
+        luaC_Metrics before = m;
+        REQUIRE(
+            luaL_dostring(
+                L,
+                "local Metered = require('lcltests').Metered\n"
+                "Metered.__init = function() error('no') end\n"
+                "for i = 1, 3 do assert(not pcall(Metered)) end") == LUA_OK);
+        lua_gc(L, LUA_GCCOLLECT);
+        REQUIRE(luaC_getmetrics(&metered_class, &m));
+        REQUIRE(m.constructions == before.constructions);
+        REQUIRE(m.finalizations - before.finalizations == 3);
+        REQUIRE(m.live == before.live);
+
+        // classes registered while metrics are disabled are not tracked
+        REQUIRE_FALSE(luaC_getmetrics(&counted_class, &m));
+
+        LCL_TEST_END
+    }
+}
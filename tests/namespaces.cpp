@@ -0,0 +1,152 @@
+#include "tests.hpp"
+extern "C" {
+static int kind_a(lua_State *L) {
+    lua_pushstring(L, "a");
+    return 1;
+}
+
+static int kind_b(lua_State *L) {
+    lua_pushstring(L, "b");
+    return 1;
+}
+
+static luaL_Reg shared_methods[] = {
+    {NULL, NULL}
+};
+
+static luaL_Reg widget_a_methods[] = {
+    {"kind", kind_a},
+    {NULL,   NULL  }
+};
+
+static luaL_Reg widget_b_methods[] = {
+    {"kind", kind_b},
+    {NULL,   NULL  }
+};
+}
+
+TEST_SUITE("Namespaces") {
+    TEST_CASE("Tenant Classes") {
+        LCL_TEST_BEGIN
+
+        // a shared class, visible in every namespace
+        REQUIRE(luaC_newclass(L, "Shared", NULL, shared_methods));
+        register_lcl_class(L);
+
+        // two tenants with their own Widget, derived from the shared class
+        luaC_pushnamespace(L, "a");
+        luaC_setnamespace(L, -1);
+        lua_pop(L, 1);
+        REQUIRE(luaC_newclass(L, "Widget", "lcltests.Shared", widget_a_methods));
+        luaC_register(L, "lcltests.Widget");
+        luaC_pushnamespace(L, "b");
+        luaC_setnamespace(L, -1);
+        lua_pop(L, 1);
+        REQUIRE(luaC_newclass(L, "Widget", "lcltests.Shared", widget_b_methods));
+        luaC_register(L, "lcltests.Widget");
+        lua_pushnil(L);
+        luaC_setnamespace(L, -1);
+        lua_pop(L, 2);
+        LCL_CHECKSTACK(2);
+
+        luaC_pushnamespace(L, "a");
+        CHECK(lua_rawequal(L, -1, 1));
+        lua_pop(L, 1);
+
+        SUBCASE("Resolution") {
+            REQUIRE(luaC_pushclass(L, "lcltests.Widget") == LUA_TNIL);
+            lua_pop(L, 1);
+
+            luaC_setnamespace(L, 1);
+            CHECK(lua_isnil(L, -1));  // no namespace was active
+            lua_pop(L, 1);
+            REQUIRE(luaC_construct(L, 0, "lcltests.Widget"));
+            luaC_mcall(L, "kind", 0, 1);
+            CHECK(String(lua_tostring(L, -1)) == "a");
+            lua_pop(L, 1);
+            CHECK(luaC_isinstance(L, -1, "lcltests.Widget"));
+            CHECK(luaC_isinstance(L, -1, "lcltests.Shared"));
+            LCL_CHECKSTACK(3);
+
+            luaC_setnamespace(L, 2);
+            CHECK(lua_rawequal(L, -1, 1));
+            lua_pop(L, 1);
+            CHECK_FALSE(luaC_isinstance(L, -1, "lcltests.Widget"));
+            CHECK(luaC_isinstance(L, -1, "lcltests.Shared"));
+            REQUIRE(luaC_construct(L, 0, "lcltests.Widget"));
+            luaC_mcall(L, "kind", 0, 1);
+            CHECK(String(lua_tostring(L, -1)) == "b");
+            lua_pop(L, 2);
+
+            lua_pushnil(L);
+            luaC_setnamespace(L, -1);
+            CHECK(lua_rawequal(L, -1, 2));
+            lua_pop(L, 2);
+            CHECK_FALSE(luaC_isinstance(L, -1, "lcltests.Widget"));
+            LCL_CHECKSTACK(3);
+        }
+
+        SUBCASE("Caching") {
+            // a shared class first resolved within a namespace
+            REQUIRE(luaC_newclass(L, "Late", NULL, shared_methods));
+            luaC_register(L, "lcltests.Late");
+            luaC_setnamespace(L, 1);
+            lua_pop(L, 1);
+            REQUIRE(luaC_pushclass(L, "lcltests.Late") == LUA_TTABLE);
+            lua_getfield(L, 1, "lcltests.Late");
+            CHECK(lua_rawequal(L, -1, -2));
+            lua_pop(L, 2);
+
+            // is cached only in that namespace
+            lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+            lua_getfield(L, -1, "lcltests");
+            lua_pushnil(L);
+            lua_setfield(L, -2, "Late");
+            lua_pop(L, 2);
+            REQUIRE(luaC_pushclass(L, "lcltests.Late") == LUA_TTABLE);
+            luaC_setnamespace(L, 2);
+            lua_pop(L, 1);
+            REQUIRE(luaC_pushclass(L, "lcltests.Late") == LUA_TNIL);
+            lua_pop(L, 2);
+            LCL_CHECKSTACK(2);
+        }
+
+        SUBCASE("Unregistration") {
+            luaC_setnamespace(L, 1);
+            lua_pop(L, 1);
+
+            // shared classes cannot be removed from within a namespace
+            luaC_unregister(L, "lcltests.Shared");
+            luaC_unregister(L, "lcltests.Widget");
+            LCL_CHECKSTACK(2);
+            REQUIRE(luaC_pushclass(L, "lcltests.Shared") == LUA_TTABLE);
+            REQUIRE(luaC_pushclass(L, "lcltests.Widget") == LUA_TNIL);
+            lua_pop(L, 2);
+
+            luaC_setnamespace(L, 2);
+            lua_pop(L, 1);
+            REQUIRE(luaC_pushclass(L, "lcltests.Widget") == LUA_TTABLE);
+            lua_pop(L, 1);
+            luaC_unregister(L, "lcltests.Widget");
+            REQUIRE(luaC_pushclass(L, "lcltests.Widget") == LUA_TNIL);
+            lua_pop(L, 1);
+            LCL_CHECKSTACK(2);
+        }
+
+        SUBCASE("Lua") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local lcl = require('lcl')\n"
+                        "local a = lcl.namespace('a')\n"
+                        "assert(lcl.usenamespace(a) == nil)\n"
+                        "assert(a.lcltests.Widget():kind() == 'a')\n"
+                        "local b = lcl.namespace('b')\n"
+                        "assert(lcl.usenamespace(b) == a)\n"
+                        "assert(b.lcltests.Widget():kind() == 'b')\n"
+                        "assert(lcl.usenamespace() == b)") == LUA_OK);
+            LCL_CHECKSTACK(2);
+        }
+
+        LCL_TEST_END
+    }
+}
@@ -0,0 +1,118 @@
+#include "tests.hpp"
+extern "C" {
+#include "classes/counted.h"
+#include "classes/file.h"
+}
+
+TEST_SUITE("Object Lifetime") {
+    TEST_CASE("Scope Release") {
+        LCL_TEST_BEGIN
+
+        counted_finalized = 0;
+        lua_pushlightuserdata(L, &counted_class);
+        luaC_classfromptr(L);
+        LCL_CHECKSTACK(1);
+        register_lcl_class(L);
+
+        SUBCASE("Bulk Release") {
+            REQUIRE(luaC_beginscope(L) == 1);
+            for (int i = 0; i < 10; i++) {
+                luaC_construct(L, 0, "lcltests.Counted");
+                lua_pop(L, 1);
+            }
+            LCL_CHECKSTACK(0);
+            REQUIRE(counted_finalized == 0);
+
+            REQUIRE(luaC_endscope(L, 0) == 0);
+            LCL_CHECKSTACK(0);
+            REQUIRE(counted_finalized == 10);
+
+            // released objects must not be finalized again
+            lua_gc(L, LUA_GCCOLLECT);
+            REQUIRE(counted_finalized == 10);
+        }
+
+        SUBCASE("Nested Scopes") {
+            luaC_beginscope(L);
+            luaC_construct(L, 0, "lcltests.Counted");
+            lua_pop(L, 1);
+            REQUIRE(luaC_beginscope(L) == 2);
+            luaC_construct(L, 0, "lcltests.Counted");
+            luaC_construct(L, 0, "lcltests.Counted");
+            lua_pop(L, 2);
+
+            luaC_endscope(L, 0);
+            REQUIRE(counted_finalized == 2);
+            luaC_endscope(L, 0);
+            REQUIRE(counted_finalized == 3);
+            REQUIRE(luaC_endscope(L, 0) == 0);
+        }
+
+        SUBCASE("Escaped Objects") {
+            lua_pushlightuserdata(L, &file_class);
+            luaC_classfromptr(L);
+            register_lcl_class(L);
+
+            luaC_beginscope(L);
+            luaC_construct(L, 0, "lcltests.Counted");
+            lua_pop(L, 1);
+            lua_pushstring(L, "Derived.moon");
+            luaC_construct(L, 1, "lcltests.File");
+            LCL_CHECKSTACK(1);
+
+            REQUIRE(luaC_endscope(L, 1) == 1);
+            LCL_CHECKSTACK(2);
+            REQUIRE(lua_rawlen(L, -1) == 1);
+            REQUIRE(lua_rawgeti(L, -1, 1) == LUA_TUSERDATA);
+            REQUIRE(lua_rawequal(L, -1, 1));
+            lua_pop(L, 2);
+            REQUIRE(counted_finalized == 1);
+
+            // the escaped object is dead
+            luaL_loadstring(L, "local o = ... return o:filename()");
+            lua_insert(L, -2);
+            REQUIRE(lua_pcall(L, 1, 1, 0) != LUA_OK);
+        }
+
+        SUBCASE("Lua Interface") {
+            luaL_dostring(
+                L,
+                "local lcl = require('lcl')\n"
+                "local Counted = require('lcltests').Counted\n"
+                "lcl.beginscope()\n"
+                "for i = 1, 5 do Counted() end\n"
+                "keep = Counted()\n"
+                "return lcl.endscope(true)");
+            LCL_CHECKSTACK(2);
+            REQUIRE(lua_tointeger(L, 1) == 1);
+            REQUIRE(lua_rawlen(L, 2) == 1);
+            REQUIRE(counted_finalized == 6);
+        }
+
+        LCL_TEST_END
+    }
+
+    TEST_CASE("Fast Close") {
+        LCL_TEST_BEGIN
+
+        counted_finalized = 0;
+        skipped_finalized = 0;
+        lua_pushlightuserdata(L, &counted_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        lua_pushlightuserdata(L, &skipped_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        LCL_CHECKSTACK(0);
+
+        for (int i = 0; i < 4; i++)
+            luaC_construct(L, 0, "lcltests.Counted");
+        for (int i = 0; i < 3; i++)
+            luaC_construct(L, 0, "lcltests.Skipped");
+
+        // Counted destructors still run for Skipped objects
+        luaC_fastclose(L);
+        REQUIRE(counted_finalized == 7);
+        REQUIRE(skipped_finalized == 0);
+    }
+}
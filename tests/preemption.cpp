@@ -0,0 +1,195 @@
+#include "tests.hpp"
+extern "C" {
+static luaL_Reg worker_methods[] = {
+    {NULL, NULL}
+};
+}
+
+// runs the call on *co* to completion, resuming it each time it is preempted,
+// and returns the number of slices it took
+static int run_call(lua_State *L, lua_State *co, int status, int *nres) {
+    int slices = 1;
+    while (status == LUA_YIELD && luaC_preempted(co)) {
+        REQUIRE(*nres == 0);
+        status = luaC_resumecall(co, L, 0, nres);
+        slices++;
+    }
+    REQUIRE(status == LUA_OK);
+    return slices;
+}
+
+TEST_SUITE("Preemption") {
+    TEST_CASE("Instruction Budgets") {
+        LCL_TEST_BEGIN
+
+        REQUIRE(luaC_newclass(L, "Worker", NULL, worker_methods));
+        register_lcl_class(L);
+        REQUIRE(luaC_newclass(L, "Busy", "lcltests.Worker", worker_methods));
+        register_lcl_class(L);
+        REQUIRE(luaL_dostring(
+                    L,
+                    "local lcltests = require('lcltests')\n"
+                    "local base = lcltests.Worker.__base\n"
+                    "function base:spin(n)\n"
+                    "  local s = 0\n"
+                    "  for i = 1, n do s = s + i end\n"
+                    "  return s\n"
+                    "end\n"
+                    "function base:pause(v)\n"
+                    "  return coroutine.yield(v) + 1\n"
+                    "end\n"
+                    "function base:generate(n)\n"
+                    "  local gen = coroutine.wrap(function()\n"
+                    "    for i = 1, n do coroutine.yield(i) end\n"
+                    "  end)\n"
+                    "  local s = 0\n"
+                    "  for i = 1, n do s = s + gen() end\n"
+                    "  return s\n"
+                    "end\n"
+                    "function lcltests.Busy.__init(self, n)\n"
+                    "  self.total = self:spin(n)\n"
+                    "end\n"
+                    "worker = lcltests.Worker()\n"
+                    "busy = lcltests.Busy(1)\n") == LUA_OK);
+
+        lua_State *co = lua_newthread(L);
+        int        nres;
+        luaC_setbudget(L, 1000);
+        LCL_CHECKSTACK(1);
+
+        SUBCASE("Method Calls") {
+            lua_getglobal(L, "worker");
+            lua_pushinteger(L, 100000);
+            lua_xmove(L, co, 2);
+
+            int status = luaC_mstart(co, L, "spin", 1, &nres);
+            CHECK(status == LUA_YIELD);
+            CHECK(luaC_preempted(co));
+            int slices = run_call(L, co, status, &nres);
+            CHECK(slices > 10);
+            REQUIRE(nres == 1);
+            CHECK(lua_tointeger(co, -1) == 5000050000);
+            lua_pop(co, 1);
+
+            // short calls finish in their first slice
+            lua_getglobal(L, "worker");
+            lua_pushinteger(L, 10);
+            lua_xmove(L, co, 2);
+            CHECK(luaC_mstart(co, L, "spin", 1, &nres) == LUA_OK);
+            CHECK(lua_tointeger(co, -1) == 55);
+            lua_pop(co, 1);
+
+            // preemptions are counted per method
+            luaC_pushpreemptions(L);
+            lua_getfield(L, -1, "Worker.spin");
+            CHECK(lua_tointeger(L, -1) == slices - 1);
+            lua_pop(L, 2);
+        }
+
+        SUBCASE("Yielding") {
+            // calls can still yield by themselves
+            lua_getglobal(L, "worker");
+            lua_pushinteger(L, 41);
+            lua_xmove(L, co, 2);
+            REQUIRE(luaC_mstart(co, L, "pause", 1, &nres) == LUA_YIELD);
+            CHECK_FALSE(luaC_preempted(co));
+            REQUIRE(nres == 1);
+            CHECK(lua_tointeger(co, -1) == 41);
+            lua_pop(co, 1);
+
+            lua_pushinteger(co, 1);
+            REQUIRE(luaC_resumecall(co, L, 1, &nres) == LUA_OK);
+            CHECK(lua_tointeger(co, -1) == 2);
+            lua_pop(co, 1);
+        }
+
+        SUBCASE("Generators") {
+            // coroutines created by a budgeted call run unbudgeted, and
+            // yield to the call rather than being preempted
+            luaC_setbudget(L, 100);
+            lua_getglobal(L, "worker");
+            lua_pushinteger(L, 2000);
+            lua_xmove(L, co, 2);
+            int status = luaC_mstart(co, L, "generate", 1, &nres);
+            run_call(L, co, status, &nres);
+            REQUIRE(nres == 1);
+            CHECK(lua_tointeger(co, -1) == 2001000);
+            lua_pop(co, 1);
+        }
+
+        SUBCASE("Class Budgets") {
+            // the budget of a class applies to its subclasses
+            luaC_pushclass(L, "lcltests.Worker");
+            luaC_setclassbudget(L, -1, 100000000);
+            lua_pop(L, 1);
+
+            lua_getglobal(L, "busy");
+            lua_pushinteger(L, 100000);
+            lua_xmove(L, co, 2);
+            CHECK(luaC_mstart(co, L, "spin", 1, &nres) == LUA_OK);
+            lua_pop(co, 1);
+
+            luaC_pushclass(L, "lcltests.Busy");
+            luaC_setclassbudget(L, -1, 500);
+            lua_pop(L, 1);
+
+            lua_getglobal(L, "busy");
+            lua_pushinteger(L, 100000);
+            lua_xmove(L, co, 2);
+            int status = luaC_mstart(co, L, "spin", 1, &nres);
+            CHECK(status == LUA_YIELD);
+            CHECK(run_call(L, co, status, &nres) > 10);
+            lua_pop(co, 1);
+
+            luaC_pushpreemptions(L);
+            lua_getfield(L, -1, "Busy.spin");
+            CHECK(lua_tointeger(L, -1) > 10);
+            lua_getfield(L, -2, "Worker.spin");
+            CHECK(lua_isnil(L, -1));
+            lua_pop(L, 3);
+        }
+
+        SUBCASE("Construction") {
+            lua_pushinteger(co, 100000);
+            int status = luaC_cstart(co, L, 1, "lcltests.Busy", &nres);
+            CHECK(status == LUA_YIELD);
+            run_call(L, co, status, &nres);
+            REQUIRE(nres == 1);
+            REQUIRE(luaC_isinstance(co, -1, "lcltests.Busy"));
+            lua_getfield(co, -1, "total");
+            CHECK(lua_tointeger(co, -1) == 5000050000);
+            lua_pop(co, 2);
+
+            luaC_pushpreemptions(L);
+            lua_getfield(L, -1, "Busy.new");
+            CHECK(lua_tointeger(L, -1) > 0);
+            lua_pop(L, 2);
+
+            CHECK(luaC_cstart(co, L, 0, "lcltests.Missing", &nres) ==
+                  LUA_ERRRUN);
+            lua_pop(co, 1);
+        }
+
+        SUBCASE("Lua API") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local lcl = require('lcl')\n"
+                        "local lcltests = require('lcltests')\n"
+                        "lcl.setbudget(0)\n"
+                        "lcl.setbudget(100, lcltests.Busy)\n"
+                        "assert(not pcall(lcl.setbudget, 100, {}))\n"
+                        "assert(next(lcl.preemptions()) == nil)") == LUA_OK);
+
+            // without a budget, calls run to completion
+            lua_getglobal(L, "worker");
+            lua_pushinteger(L, 100000);
+            lua_xmove(L, co, 2);
+            CHECK(luaC_mstart(co, L, "spin", 1, &nres) == LUA_OK);
+            lua_pop(co, 1);
+        }
+
+        LCL_CHECKSTACK(1);
+        CHECK(lua_gettop(co) == 0);
+        LCL_TEST_END
+    }
+}
@@ -0,0 +1,13 @@
+return {
+    name    = "Point",
+    module  = "lcltests",
+    ctype   = "point",
+    fields  = {
+        {"x",       "number" },
+        {"y",       "number" },
+        {"hits",    "integer"},
+        {"visible", "boolean"},
+        {"label",   "string" },
+    },
+    methods = {"length", "scale"},
+}
@@ -0,0 +1,14 @@
+return {
+    name          = "Point3",
+    module        = "lcltests",
+    ctype         = "point3",
+    parent        = "lcltests.Point",
+    parent_ctype  = "point",
+    fields        = {
+        {"z",   "number"},
+        {"tag", "value" },
+    },
+    methods       = {"length3"},
+    gc            = true,
+    dirty         = true,
+}
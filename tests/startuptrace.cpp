@@ -0,0 +1,139 @@
+#include "tests.hpp"
+#include <cstdio>
+#include <string>
+extern "C" {
+#include "classes/file.h"
+#include "classes/signal.h"
+#include "classes/simple.h"
+}
+
+TEST_SUITE("Startup Trace") {
+    TEST_CASE("Startup Report") {
+        LCL_TEST_BEGIN
+
+        luaC_tracestartup(L, 1);
+        REQUIRE(luaC_newclass(
+            L, "SimpleDerived", "Base", simple_derived_class_methods));
+        register_lcl_class(L);
+        int span = luaC_tracebegin(L, "custom", "Work");
+        REQUIRE(span >= 0);
+        lua_newtable(L);
+        lua_pop(L, 1);
+        luaC_traceend(L, span);
+        luaC_tracestartup(L, 0);
+        REQUIRE(luaC_tracebegin(L, "custom", "Ignored") == -1);
+
+        SUBCASE("Text") {
+            luaC_startupreport(L, 0);
+            LCL_CHECKSTACK(1);
+            std::string report = lua_tostring(L, -1);
+            REQUIRE(report.find("register  SimpleDerived\n") !=
+                    std::string::npos);
+            // the parent was required while registering its child
+            REQUIRE(report.find("require     Base\n") != std::string::npos);
+            REQUIRE(report.find("custom    Work\n") != std::string::npos);
+            REQUIRE(report.find("Ignored") == std::string::npos);
+        }
+
+        SUBCASE("JSON") {
+            luaL_dostring(L, "return require('lcl').startupreport('json')");
+            LCL_CHECKSTACK(1);
+            std::string report = lua_tostring(L, -1);
+            REQUIRE(report.rfind("[{\"kind\":\"", 0) == 0);
+            REQUIRE(
+                report.find("\"name\":\"SimpleDerived\"") != std::string::npos);
+            REQUIRE(
+                report.find("\"children\":[{\"kind\":\"require\",\"name\":"
+                            "\"Base\"") != std::string::npos);
+        }
+
+        LCL_TEST_END
+    }
+
+    TEST_CASE("Errors") {
+        LCL_TEST_BEGIN
+
+        lua_pushlightuserdata(L, &signal_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+
+        // Signal cannot be constructed from Lua, so subclassing it fails
+        luaC_tracestartup(L, 1);
+        REQUIRE(
+            luaL_dostring(
+                L,
+                "local Signal = require('lcltests').Signal\n"
+                "local base = {}\n"
+                "base.__index = base\n"
+                "local cls = setmetatable(\n"
+                "  {__base = base, __name = 'Sub', __parent = Signal},\n"
+                "  {__call = function() end})\n"
+                "Signal.__inherited(Signal, cls)") != LUA_OK);
+        lua_pop(L, 1);
+
+        // the failed span is closed, so later spans are not nested in it
+        lua_pushlightuserdata(L, &file_class);
+        luaC_classfromptr(L);
+        lua_pop(L, 1);
+        luaC_tracestartup(L, 0);
+
+        luaC_startupreport(L, 0);
+        std::string report = lua_tostring(L, -1);
+        REQUIRE(report.find("inherited Sub\n") != std::string::npos);
+        REQUIRE(report.find("register  File\n") != std::string::npos);
+        lua_pop(L, 1);
+
+        LCL_TEST_END
+    }
+
+    TEST_CASE("Nested Spans") {
+        LCL_TEST_BEGIN
+
+        // ending a span closes the spans left open inside it
+        luaC_tracestartup(L, 1);
+        int outer = luaC_tracebegin(L, "custom", "Outer");
+        lua_newtable(L);
+        luaC_tracebegin(L, "custom", "Inner");
+        lua_newtable(L);
+        lua_pop(L, 2);
+        luaC_traceend(L, outer);
+        luaC_traceend(L, outer);  // already ended
+        int after = luaC_tracebegin(L, "custom", "After");
+        luaC_traceend(L, after);
+        luaC_tracestartup(L, 0);
+
+        luaL_dostring(L, "return require('lcl').startupreport('json')");
+        std::string report = lua_tostring(L, -1);
+        lua_pop(L, 1);
+
+        unsigned long long total[2], self[2];
+        size_t             bytes[2], allocs[2];
+        const char        *names[] = {"Outer", "Inner"};
+        for (int i = 0; i < 2; i++) {
+            std::string key = std::string("\"name\":\"") + names[i] + "\"";
+            size_t      pos = report.find(key);
+            REQUIRE(pos != std::string::npos);
+            REQUIRE(
+                sscanf(
+                    report.c_str() + pos + key.size(),
+                    ",\"total_ns\":%llu,\"self_ns\":%llu,\"bytes\":%zu,"
+                    "\"allocs\":%zu",
+                    &total[i], &self[i], &bytes[i], &allocs[i]) == 4);
+        }
+        CHECK(total[1] > 0);
+        CHECK(total[1] <= total[0]);
+        CHECK(allocs[1] >= 1);
+        CHECK(allocs[1] < allocs[0]);
+        CHECK(bytes[1] < bytes[0]);
+
+        // the inner span is nested in the outer one, and later spans in
+        // neither
+        size_t inner = report.find(
+            "\"children\":[{\"kind\":\"custom\",\"name\":\"Inner\"");
+        REQUIRE(inner != std::string::npos);
+        CHECK(report.find("\"children\":[]}]}", inner) ==
+              report.find("\"children\":[]", inner));
+
+        LCL_TEST_END
+    }
+}
@@ -0,0 +1,114 @@
+#include "tests.hpp"
+extern "C" {
+#include "classes/signal.h"
+#include "classes/timerwheel.h"
+}
+
+TEST_SUITE("Timer Wheel") {
+    TEST_CASE("Timer Wheel") {
+        LCL_TEST_BEGIN
+
+        lua_pushlightuserdata(L, &timer_wheel_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        luaL_dostring(
+            L,
+            "wheel = require('lcltests').TimerWheel()\n"
+            "fired = {}\n"
+            "function timer(name)\n"
+            "  return function() fired[#fired + 1] = name end\n"
+            "end\n");
+        LCL_CHECKSTACK(0);
+
+        SUBCASE("Expiry") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "wheel:schedule(3, timer('c'))\n"
+                        "wheel:schedule(1, timer('a'))\n"
+                        "wheel:schedule(0, timer('b'))\n"
+                        "assert(wheel:pending() == 3)\n"
+                        "assert(wheel:advance() == 2)\n"
+                        "assert(#fired == 2 and fired[1] ~= fired[2])\n"
+                        "assert(wheel:advance() == 0)\n"
+                        "assert(wheel:advance() == 1 and fired[3] == 'c')\n"
+                        "assert(wheel:now() == 3 and wheel:pending() == 0)") ==
+                    LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Long Delays") {
+            // each delay lands in a different level and is cascaded down
+            REQUIRE(luaL_dostring(
+                        L,
+                        "wheel:advance(200)\n"
+                        "local delays = {300, 70000, 20000000, 5000000000}\n"
+                        "for _, d in ipairs(delays) do\n"
+                        "  wheel:schedule(d, function()\n"
+                        "    fired[#fired + 1] = wheel:now() - 200\n"
+                        "  end)\n"
+                        "end\n"
+                        "wheel:advance(299)\n"
+                        "assert(#fired == 0)\n"
+                        "assert(wheel:advance() == 1 and fired[1] == 300)\n"
+                        "wheel:advance(70000 - 301)\n"
+                        "assert(#fired == 1)\n"
+                        "wheel:advance()\n"
+                        "assert(fired[2] == 70000)\n"
+                        "wheel:advance(20000000 - 70000)\n"
+                        "assert(fired[3] == 20000000)\n"
+                        "assert(wheel:pending() == 1)") == LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Cancellation") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local a = wheel:schedule(5, timer('a'))\n"
+                        "local b = wheel:schedule(5, timer('b'))\n"
+                        "local c = wheel:schedule(5, timer('c'))\n"
+                        "assert(wheel:cancel(b))\n"
+                        "assert(not wheel:cancel(b))\n"
+                        "assert(wheel:pending() == 2)\n"
+                        "assert(wheel:advance(5) == 2)\n"
+                        "assert(not wheel:cancel(a))\n"
+                        "local d = wheel:schedule(1, timer('d'))\n"
+                        "assert(not wheel:cancel(c))  -- reused node\n"
+                        "assert(wheel:advance() == 1 and fired[3] == 'd')") ==
+                    LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Signals") {
+            lua_pushlightuserdata(L, &signal_class);
+            luaC_classfromptr(L);
+            register_lcl_class(L);
+            luaC_construct(L, 0, "lcltests.Signal");
+            lua_setglobal(L, "sig");
+
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local hits = 0\n"
+                        "sig:connect(function() hits = hits + 1 end)\n"
+                        "for i = 1, 10 do wheel:schedule(i % 3 + 1, sig) end\n"
+                        "assert(wheel:advance(3) == 10)\n"
+                        "assert(hits == 10)") == LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Errors") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "wheel:schedule(1, function() error('boom') end)\n"
+                        "wheel:schedule(3, timer('after'))\n"
+                        "assert(not pcall(wheel.advance, wheel))\n"
+                        "assert(not pcall(wheel.schedule, wheel, 1))\n"
+                        "wheel:schedule(1, function() wheel:advance() end)\n"
+                        "assert(not pcall(wheel.advance, wheel))\n"
+                        "assert(wheel:advance() == 1 and fired[1] == 'after')") ==
+                    LUA_OK);
+            LCL_CHECKSTACK(0);
+        }
+
+        LCL_TEST_END
+    }
+}
@@ -1,10 +1,21 @@
 #include "tests.hpp"
 extern "C" {
+#include "classes/counted.h"
 #include "classes/file.h"
 #include "classes/signal.h"
 
 static int slot1_var, slot2_var;
 
+static luaL_Reg no_methods[] = {
+    {NULL, NULL}
+};
+
+// registered only after heap descriptors are churned
+static luaC_Class churn_class = {
+    "Churn", NULL, 1, NULL, NULL, no_methods, 0, 0, 0, NULL};
+static luaC_Class churn_derived_class = {
+    "ChurnDerived", "lcltests.Churn", 1, NULL, NULL, no_methods, 0, 0, 0, NULL};
+
 static int slot1(lua_State *L) {
     slot1_var = luaL_checknumber(L, 1);
     return 0;
@@ -45,6 +56,91 @@ TEST_SUITE("User Data Classes") {
             REQUIRE(String(lua_tostring(L, -1)) == "Base = require \"Base\"");
         }
 
+        SUBCASE("Shared Descriptors") {
+            // the second state reuses the data derived from the descriptor
+            lua_State *L2 = luaL_newstate();
+            luaL_openlibs(L2);
+            for (lua_State *S : {L, L2}) {
+                lua_pushlightuserdata(S, &file_class);
+                REQUIRE(luaC_classfromptr(S));
+                register_lcl_class(S);
+                lua_pushstring(S, "Derived.moon");
+                luaC_construct(S, 1, "lcltests.File");
+                luaC_mcall(S, "filename", 0, 1);
+                REQUIRE(String(lua_tostring(S, -1)) == "Derived.moon");
+                lua_getfield(S, -2, "new");
+                REQUIRE(lua_isnil(S, -1));  // "new" became __init
+                lua_pop(S, 3);
+            }
+            lua_close(L2);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Shared Parents") {
+            lua_pushlightuserdata(L, &plain_class);
+            REQUIRE(luaC_classfromptr(L));
+            register_lcl_class(L);
+            lua_pushlightuserdata(L, &plain_derived_class);
+            REQUIRE(luaC_classfromptr(L));
+            lua_pop(L, 1);
+
+            // other states find the parent by descriptor, even if its name is
+            // not registered
+            lua_State *L2 = luaL_newstate();
+            luaL_openlibs(L2);
+            lua_pushlightuserdata(L2, &plain_class);
+            REQUIRE(luaC_classfromptr(L2));
+            lua_pushlightuserdata(L2, &plain_derived_class);
+            REQUIRE(luaC_classfromptr(L2));
+            REQUIRE(luaC_getparent(L2, -1));
+            REQUIRE(lua_rawequal(L2, -1, -3));
+            lua_close(L2);
+
+            // but names are resolved within namespaces
+            L2 = luaL_newstate();
+            luaL_openlibs(L2);
+            lua_pushlightuserdata(L2, &plain_class);
+            REQUIRE(luaC_classfromptr(L2));
+            luaC_pushnamespace(L2, "a");
+            luaC_setnamespace(L2, -1);
+            lua_pop(L2, 2);
+            REQUIRE(luaC_newclass(L2, "Plain", NULL, no_methods));
+            luaC_register(L2, "lcltests.Plain");
+            lua_pushlightuserdata(L2, &plain_derived_class);
+            REQUIRE(luaC_classfromptr(L2));
+            REQUIRE(luaC_getparent(L2, -1));
+            REQUIRE(luaC_uclass(L2, -1) != &plain_class);
+            lua_close(L2);
+            LCL_CHECKSTACK(0);
+        }
+
+        SUBCASE("Heap Descriptors") {
+            // heap descriptors die with their state, so they are not shared
+            // and cannot crowd out static ones
+            for (int i = 0; i < 8192; i++) {
+                REQUIRE(luaC_newclass(L, "Heap", NULL, no_methods));
+                lua_pop(L, 1);
+            }
+
+            lua_pushlightuserdata(L, &churn_class);
+            REQUIRE(luaC_classfromptr(L));
+            register_lcl_class(L);
+            lua_pushlightuserdata(L, &churn_derived_class);
+            REQUIRE(luaC_classfromptr(L));
+            lua_pop(L, 1);
+
+            lua_State *L2 = luaL_newstate();
+            luaL_openlibs(L2);
+            lua_pushlightuserdata(L2, &churn_class);
+            REQUIRE(luaC_classfromptr(L2));
+            lua_pushlightuserdata(L2, &churn_derived_class);
+            REQUIRE(luaC_classfromptr(L2));
+            REQUIRE(luaC_getparent(L2, -1));
+            REQUIRE(lua_rawequal(L2, -1, -3));
+            lua_close(L2);
+            LCL_CHECKSTACK(0);
+        }
+
         SUBCASE("Signal Class") {
             lua_pushlightuserdata(L, &signal_class);
             luaC_classfromptr(L);
@@ -81,6 +177,202 @@ TEST_SUITE("User Data Classes") {
             REQUIRE(slot2_var == 17);
         }
 
+        SUBCASE("Weak Slots") {
+            lua_pushlightuserdata(L, &signal_class);
+            luaC_classfromptr(L);
+            register_lcl_class(L);
+
+            luaC_construct(L, 0, "lcltests.Signal");
+            lua_setglobal(L, "sig");
+            luaL_dostring(
+                L,
+                "probe = setmetatable({}, {__mode = 'v'})\n"
+                "local recv = {hits = 0}\n"
+                "function recv:hit(n) self.hits = self.hits + n end\n"
+                "probe[1] = recv\n"
+                "sig:connect(recv, 'hit')\n"
+                "sig(3)\n"
+                "sig(4)\n"
+                "sig:disconnect(recv, 'hit')\n"
+                "sig(100)\n"
+                "sig:connect(recv, 'hit')\n"
+                "sig(5)\n"
+                "return recv.hits");
+            LCL_CHECKSTACK(1);
+            REQUIRE(lua_tonumber(L, -1) == 12);
+            lua_pop(L, 1);
+
+            // the connection does not keep the receiver alive
+            lua_gc(L, LUA_GCCOLLECT);
+            luaL_dostring(L, "sig(1) return probe[1] == nil");
+            REQUIRE(lua_toboolean(L, -1));
+            lua_pop(L, 1);
+
+            lua_getglobal(L, "sig");
+            REQUIRE(lua_getiuservalue(L, -1, 3) == LUA_TTABLE);
+            lua_pushnil(L);
+            REQUIRE(lua_next(L, -2) == 0);
+        }
+
+        SUBCASE("Finalized Weak Receivers") {
+            lua_pushlightuserdata(L, &signal_class);
+            luaC_classfromptr(L);
+            register_lcl_class(L);
+            lua_pushlightuserdata(L, &file_class);
+            luaC_classfromptr(L);
+            register_lcl_class(L);
+
+            luaC_construct(L, 0, "lcltests.Signal");
+            lua_setglobal(L, "sig");
+            REQUIRE(
+                luaL_dostring(
+                    L,
+                    "local File = require('lcltests').File\n"
+                    "hits = 0\n"
+                    "local function hit(self, n) hits = hits + n end\n"
+                    "kept = File('kept.moon')\n"
+                    "kept.hit = hit\n"
+                    "sig:connect(kept, 'hit')\n"
+                    "local dropped = File('dropped.moon')\n"
+                    "dropped.hit = hit\n"
+                    "sig:connect(dropped, 'hit')\n"
+                    "sig(1)") == LUA_OK);
+
+            // finalized receivers stay in the weak slot table for another
+            // cycle, and must not be called
+            lua_gc(L, LUA_GCCOLLECT);
+            REQUIRE(luaL_dostring(L, "sig(10) return hits") == LUA_OK);
+            REQUIRE(lua_tointeger(L, -1) == 12);
+            lua_pop(L, 1);
+
+            lua_gc(L, LUA_GCCOLLECT);
+            REQUIRE(luaL_dostring(L, "sig(100) return hits") == LUA_OK);
+            REQUIRE(lua_tointeger(L, -1) == 112);
+            lua_pop(L, 1);
+        }
+
+        SUBCASE("Deferred Emission") {
+            lua_pushlightuserdata(L, &signal_class);
+            luaC_classfromptr(L);
+            register_lcl_class(L);
+
+            luaC_construct(L, 0, "lcltests.Signal");
+            lua_setglobal(L, "sig");
+            luaC_construct(L, 0, "lcltests.Signal");
+            lua_setglobal(L, "acc");
+            luaL_dostring(
+                L,
+                "calls, last, batch = 0, nil, nil\n"
+                "sig:connect(function(a, b)\n"
+                "  calls, last = calls + 1, a + b\n"
+                "end)\n"
+                "acc:connect(function(list) batch = list end)\n"
+                "sig:defer('last')\n"
+                "acc:defer('accumulate')\n"
+                "for i = 1, 1000 do sig(i, 1) end\n"
+                "acc(1, 2) acc(3) acc()\n"
+                "assert(calls == 0 and batch == nil)");
+            LCL_CHECKSTACK(0);
+
+            REQUIRE(luaC_flush(L) == 2);
+            luaL_dostring(
+                L,
+                "return calls, last, #batch, batch[1][2], batch[2].n, "
+                "batch[3].n");
+            LCL_CHECKSTACK(6);
+            REQUIRE(lua_tointeger(L, 1) == 1);
+            REQUIRE(lua_tointeger(L, 2) == 1001);
+            REQUIRE(lua_tointeger(L, 3) == 3);
+            REQUIRE(lua_tointeger(L, 4) == 2);
+            REQUIRE(lua_tointeger(L, 5) == 1);
+            REQUIRE(lua_tointeger(L, 6) == 0);
+            lua_settop(L, 0);
+
+            // emissions made while flushing wait for the next flush
+            luaL_dostring(
+                L,
+                "local lcl = require 'lcl'\n"
+                "sig:connect(function(a) if a < 3 then sig(a + 1, 0) end end)\n"
+                "sig(1, 0)\n"
+                "local n = lcl.flush()\n"
+                "local first = last\n"
+                "n = n + lcl.flush()\n"
+                "local second = last\n"
+                "sig:defer()\n"
+                "sig(5, 5)\n"
+                "return n, first, second, last");
+            LCL_CHECKSTACK(4);
+            REQUIRE(lua_tointeger(L, 1) == 2);
+            REQUIRE(lua_tointeger(L, 2) == 1);
+            REQUIRE(lua_tointeger(L, 3) == 2);
+            REQUIRE(lua_tointeger(L, 4) == 10);
+        }
+
+        LCL_TEST_END
+    }
+
+    TEST_CASE("Finalizer Installation") {
+        LCL_TEST_BEGIN
+
+        counted_finalized = 0;
+        lua_pushlightuserdata(L, &plain_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        lua_pushlightuserdata(L, &plain_derived_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        LCL_CHECKSTACK(0);
+
+        // no destructor anywhere in the heirarchy
+        luaC_construct(L, 0, "lcltests.Plain");
+        REQUIRE(luaL_getmetafield(L, -1, "__gc") == LUA_TNIL);
+        lua_pushstring(L, "x");
+        lua_pushnumber(L, 4);
+        lua_settable(L, -3);
+        REQUIRE(lua_getfield(L, -1, "x") == LUA_TNUMBER);
+        lua_pop(L, 2);
+
+        // destructor added further down the heirarchy
+        luaC_construct(L, 0, "lcltests.PlainDerived");
+        REQUIRE(luaC_isinstance(L, -1, "lcltests.Plain"));
+        REQUIRE(luaL_getmetafield(L, -1, "__gc") == LUA_TFUNCTION);
+        lua_pop(L, 2);
+
+        lua_gc(L, LUA_GCCOLLECT);
+        REQUIRE(counted_finalized == 1);
+
+        // finalized objects share a single metatable
+        luaC_beginscope(L);
+        luaC_construct(L, 0, "lcltests.PlainDerived");
+        luaC_construct(L, 0, "lcltests.PlainDerived");
+        luaC_endscope(L, 0);
+        REQUIRE(counted_finalized == 3);
+        lua_getmetatable(L, -1);
+        lua_getmetatable(L, -3);
+        REQUIRE(lua_rawequal(L, -1, -2));
+
+        LCL_TEST_END
+    }
+
+    TEST_CASE("Managed Allocation") {
+        LCL_TEST_BEGIN
+
+        lua_pushlightuserdata(L, &managed_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+
+        luaC_construct(L, 0, "lcltests.Managed");
+        LCL_CHECKSTACK(1);
+        REQUIRE(luaC_isinstance(L, -1, "lcltests.Managed"));
+        REQUIRE(lua_rawlen(L, -1) == 4 * sizeof(int));
+
+        int *p = (int *)lua_touserdata(L, -1);
+        REQUIRE((p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 0));
+
+        REQUIRE(lua_getiuservalue(L, -1, 1) == LUA_TTABLE);
+        REQUIRE(lua_getiuservalue(L, -2, 3) == LUA_TNIL);
+        REQUIRE(lua_getiuservalue(L, -3, 4) == LUA_TNONE);
+
         LCL_TEST_END
     }
 }
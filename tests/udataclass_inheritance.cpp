@@ -72,6 +72,22 @@ TEST_SUITE("User Data Classes") {
         REQUIRE(slot1_var == 56235);
         REQUIRE(slot2_var == 56235);
 
+        SUBCASE("Deferred Emission") {
+            // blocking does not change how emissions are deferred
+            lua_setglobal(L, "sig");
+            REQUIRE(luaL_dostring(
+                        L,
+                        "sig:defer('last')\n"
+                        "sig:block()\n"
+                        "sig:unblock()\n"
+                        "sig(7)") == LUA_OK);
+            REQUIRE(slot1_var == 56235);
+            REQUIRE(luaC_flush(L) == 1);
+            REQUIRE(slot1_var == 7);
+            REQUIRE(slot2_var == 7);
+            lua_getglobal(L, "sig");
+        }
+
         LCL_TEST_END
     }
 
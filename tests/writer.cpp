@@ -0,0 +1,101 @@
+#include "tests.hpp"
+extern "C" {
+#include "classes/writer.h"
+}
+
+TEST_SUITE("Writer") {
+    TEST_CASE("Buffered Writer") {
+        LCL_TEST_BEGIN
+
+        lua_pushlightuserdata(L, &writer_class);
+        luaC_classfromptr(L);
+        register_lcl_class(L);
+        luaL_dostring(
+            L,
+            "Writer = require('lcltests').Writer\n"
+            "path = 'writer_test.out'\n"
+            "function contents()\n"
+            "  local f = assert(io.open(path, 'rb'))\n"
+            "  local s = f:read('a')\n"
+            "  f:close()\n"
+            "  return s\n"
+            "end\n");
+        LCL_CHECKSTACK(0);
+
+        SUBCASE("Buffering") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local w = Writer(path, {size = 16})\n"
+                        "assert(w:write('ab', 'cd', 1) == w)\n"
+                        "local bytes, calls = w:stats()\n"
+                        "assert(bytes == 0 and calls == 0)\n"
+                        "-- a write that does not fit goes out with the buffer\n"
+                        "-- in a single call\n"
+                        "w:write(('x'):rep(20), 'y')\n"
+                        "bytes, calls = w:stats()\n"
+                        "assert(bytes == 26 and calls == 1)\n"
+                        "assert(w:writev({'a', 'b', 'c', 'd'}, 2, 3) == w)\n"
+                        "assert(w:writev({}) == w)\n"
+                        "assert(w:flush() == w)\n"
+                        "bytes, calls = w:stats()\n"
+                        "assert(bytes == 28 and calls == 2)\n"
+                        "assert(contents() == 'abcd1' .. ('x'):rep(20) .. "
+                        "'ybc')\n"
+                        "assert(w:close() == w)\n"
+                        "assert(not pcall(w.write, w, 'z'))\n"
+                        "os.remove(path)") == LUA_OK);
+        }
+
+        SUBCASE("Background Thread") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local w = Writer(path, {size = 64, background = true})\n"
+                        "local expected = {}\n"
+                        "for i = 1, 2000 do\n"
+                        "  local rec = 'record ' .. i\n"
+                        "  if i % 100 == 0 then rec = rec:rep(20) end\n"
+                        "  w:write(rec, '\\n')\n"
+                        "  expected[#expected + 1] = rec .. '\\n'\n"
+                        "end\n"
+                        "w:writev(expected, 1, 10)\n"
+                        "for i = 1, 10 do expected[#expected + 1] = expected[i] "
+                        "end\n"
+                        "assert(w:close() == w)\n"
+                        "local text = table.concat(expected)\n"
+                        "assert(contents() == text)\n"
+                        "assert(select(1, w:stats()) == #text)\n"
+                        "os.remove(path)") == LUA_OK);
+        }
+
+        SUBCASE("Flush On Collection") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "local w = Writer(path, {background = true})\n"
+                        "w:write('hello')\n"
+                        "w = nil\n"
+                        "collectgarbage()\n"
+                        "assert(contents() == 'hello')\n"
+                        "w = Writer(path, {append = true})\n"
+                        "w:write(' world')\n"
+                        "w = nil\n"
+                        "collectgarbage()\n"
+                        "collectgarbage()\n"
+                        "assert(contents() == 'hello world')\n"
+                        "os.remove(path)") == LUA_OK);
+        }
+
+        SUBCASE("Errors") {
+            REQUIRE(luaL_dostring(
+                        L,
+                        "assert(not pcall(Writer, 'missing/dir/file.out'))\n"
+                        "assert(not pcall(Writer, path, {size = 0}))\n"
+                        "local w = Writer(path)\n"
+                        "assert(not pcall(w.writev, w, {'a', 1}))\n"
+                        "assert(not pcall(w.write, w, {}))\n"
+                        "w:close()\n"
+                        "os.remove(path)") == LUA_OK);
+        }
+
+        LCL_TEST_END
+    }
+}
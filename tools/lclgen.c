@@ -0,0 +1,496 @@
+#include <ctype.h>
+#include <lauxlib.h>
+#include <lualib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// lclgen - generates specialized C for user data classes from a schema.
+//
+// usage: lclgen <schema.lua> <out.h> <out.c>
+//
+// the schema is a Lua file returning a table:
+//
+//   return {
+//       name    = "Point",        -- the class name
+//       module  = "lcltests",     -- the module the class is registered in
+//       ctype   = "point",        -- the C type, also used as a prefix
+//       parent  = "lcltests.Shape",  -- optional, a generated class
+//       parent_ctype  = "shape",     -- the C type of the parent
+//       parent_header = "shape.h",   -- optional, defaults to <parent_ctype>.h
+//       fields  = {{"x", "number"}, {"label", "string"}},
+//       methods = {"length"},     -- implemented by the user
+//       init    = false,          -- whether the user implements "new"
+//       gc      = false,          -- whether the user implements a destructor
+//       dirty   = false,          -- whether field writes mark objects dirty
+//   }
+//
+// field types are number, integer, boolean, string and value. the first three
+// are stored in the struct, and the others in user values.
+
+#define MAX_ITEMS 256
+
+enum { T_NUMBER, T_INTEGER, T_BOOLEAN, T_STRING, T_VALUE };
+
+static const char *const type_names[] = {
+    "number", "integer", "boolean", "string", "value", NULL};
+
+static const char *const field_types[] = {
+    "LUAC_FIELD_NUMBER",
+    "LUAC_FIELD_INTEGER",
+    "LUAC_FIELD_BOOLEAN",
+    "LUAC_FIELD_STRING",
+    "LUAC_FIELD_VALUE"};
+
+typedef struct {
+    const char *name;
+    int         type;
+    int         uv;  // the user value holding the field, if not in the struct
+} field;
+
+typedef struct {
+    const char *name, *module, *ctype, *upper;
+    const char *parent, *parent_ctype, *parent_upper, *parent_header;
+    field       fields[MAX_ITEMS];
+    const char *methods[MAX_ITEMS];
+    int         nfields, nmethods, nuv, init, gc, dirty;
+} schema;
+
+static FILE       *out;
+static const char *schema_path;
+
+static void fail(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "lclgen: %s: ", schema_path);
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+    exit(1);
+}
+
+static void emit(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(out, fmt, ap);
+    va_end(ap);
+}
+
+static void check_ident(const char *what, const char *s) {
+    if (!s || !(isalpha((unsigned char)*s) || *s == '_'))
+        fail("%s '%s' is not a C identifier", what, s ? s : "");
+    for (const char *c = s; *c; c++)
+        if (!(isalnum((unsigned char)*c) || *c == '_'))
+            fail("%s '%s' is not a C identifier", what, s);
+}
+
+// pushes an upper case copy of *str* for macro names, and returns it
+static const char *to_upper(lua_State *L, const char *str) {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    for (const char *c = str; *c; c++)
+        luaL_addchar(&b, (char)toupper((unsigned char)*c));
+    luaL_pushresult(&b);
+    lua_insert(L, 1);  // keep it below the schema
+    return lua_tostring(L, 1);
+}
+
+// gets an optional string field of the schema table at the top of the stack.
+// the string stays valid while the schema is on the stack.
+static const char *opt_string(lua_State *L, const char *key) {
+    lua_getfield(L, -1, key);
+    const char *s = lua_tostring(L, -1);
+    if (!s && !lua_isnil(L, -1)) fail("'%s' must be a string", key);
+    lua_pop(L, 1);
+    return s;
+}
+
+static int opt_boolean(lua_State *L, const char *key) {
+    lua_getfield(L, -1, key);
+    int b = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    return b;
+}
+
+static void read_schema(lua_State *L, schema *s) {
+    memset(s, 0, sizeof(schema));
+
+    if (luaL_dofile(L, schema_path) != LUA_OK)
+        fail("%s", lua_tostring(L, -1));
+    if (!lua_istable(L, -1)) fail("schema must return a table");
+
+    s->name          = opt_string(L, "name");
+    s->module        = opt_string(L, "module");
+    s->ctype         = opt_string(L, "ctype");
+    s->parent        = opt_string(L, "parent");
+    s->parent_ctype  = opt_string(L, "parent_ctype");
+    s->parent_header = opt_string(L, "parent_header");
+    s->init          = opt_boolean(L, "init");
+    s->gc            = opt_boolean(L, "gc");
+    s->dirty         = opt_boolean(L, "dirty");
+
+    if (!s->name) fail("'name' is required");
+    check_ident("ctype", s->ctype);
+    if (s->parent && !s->parent_ctype)
+        fail("'parent_ctype' is required with 'parent'");
+    if (s->parent) check_ident("parent_ctype", s->parent_ctype);
+
+    s->upper = to_upper(L, s->ctype);
+    if (s->parent) s->parent_upper = to_upper(L, s->parent_ctype);
+
+    if (lua_getfield(L, -1, "fields") == LUA_TTABLE) {
+        int n = (int)lua_rawlen(L, -1);
+        if (n > MAX_ITEMS) fail("too many fields");
+
+        for (int i = 1; i <= n; i++) {
+            field *f = &s->fields[s->nfields++];
+            if (lua_rawgeti(L, -1, i) != LUA_TTABLE)
+                fail("field %d must be a table {name, type}", i);
+            lua_rawgeti(L, -1, 1);
+            lua_rawgeti(L, -2, 2);
+            f->name = lua_tostring(L, -2);
+            check_ident("field", f->name);
+            f->type = -1;
+            for (int t = 0; type_names[t]; t++)
+                if (lua_tostring(L, -1) &&
+                    strcmp(lua_tostring(L, -1), type_names[t]) == 0)
+                    f->type = t;
+            if (f->type < 0) fail("field '%s' has an unknown type", f->name);
+            lua_pop(L, 3);
+        }
+    }
+    lua_pop(L, 1);
+
+    if (lua_getfield(L, -1, "methods") == LUA_TTABLE) {
+        int n = (int)lua_rawlen(L, -1);
+        if (n > MAX_ITEMS) fail("too many methods");
+
+        for (int i = 1; i <= n; i++) {
+            lua_rawgeti(L, -1, i);
+            s->methods[s->nmethods] = lua_tostring(L, -1);
+            check_ident("method", s->methods[s->nmethods++]);
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+
+    for (int i = 0; i < s->nfields; i++)
+        if (s->fields[i].type >= T_STRING) s->fields[i].uv = ++s->nuv;
+}
+
+// the expression for the first user value index of the class's own fields
+static void emit_uvbase(const schema *s) {
+    if (s->parent) emit("%s_NUV", s->parent_upper);
+    else emit("1");
+}
+
+static void emit_header(const schema *s, const char *base) {
+    emit("/* generated by lclgen from %s. do not edit. */\n\n", base);
+    emit("#ifndef LCLGEN_%s_H\n#define LCLGEN_%s_H\n\n", s->upper, s->upper);
+    emit("#include <luaclasslib.h>\n");
+    if (s->parent) {
+        if (s->parent_header) emit("#include \"%s\"\n", s->parent_header);
+        else emit("#include \"%s.h\"\n", s->parent_ctype);
+    }
+
+    emit("\n/// The number of user values of %s objects.\n", s->ctype);
+    emit("#define %s_NUV (", s->upper);
+    emit_uvbase(s);
+    emit(" + %d)\n\n", s->nuv);
+
+    int members = s->parent != NULL;
+    emit("typedef struct {\n");
+    if (s->parent) emit("    %s super;\n", s->parent_ctype);
+    for (int i = 0; i < s->nfields; i++) {
+        members += s->fields[i].type < T_STRING;
+        const field *f = &s->fields[i];
+        switch (f->type) {
+            case T_NUMBER: emit("    lua_Number %s;\n", f->name); break;
+            case T_INTEGER: emit("    lua_Integer %s;\n", f->name); break;
+            case T_BOOLEAN: emit("    int %s;\n", f->name); break;
+            default: break;  // kept in user values
+        }
+    }
+    if (!members) emit("    char unused_;  // C structs may not be empty\n");
+    emit("} %s;\n\n", s->ctype);
+
+    emit("extern luaC_Class %s_class;\n\n", s->ctype);
+
+    emit("/* implemented by the user */\n");
+    for (int i = 0; i < s->nmethods; i++)
+        emit("int %s_%s(lua_State *L, %s *self);\n",
+             s->ctype, s->methods[i], s->ctype);
+    if (s->init) emit("int %s_new(lua_State *L, %s *self);\n", s->ctype, s->ctype);
+    if (s->gc) emit("void %s_gc(lua_State *L, %s *self);\n", s->ctype, s->ctype);
+
+    emit("\n/* generated */\n");
+    emit("int %s_register(lua_State *L);\n", s->ctype);
+    emit("%s *%s_check(lua_State *L, int arg);\n", s->ctype, s->ctype);
+    emit("int %s_getfield(lua_State *L, int idx, const char *k, size_t len);\n",
+         s->ctype);
+    emit("int %s_setfield(\n    lua_State *L, int idx, const char *k, size_t "
+         "len, int val);\n", s->ctype);
+    emit("void %s_totable(lua_State *L, int idx);\n", s->ctype);
+    emit("void %s_fromtable(lua_State *L, int idx, int t);\n\n", s->ctype);
+    emit("#endif\n");
+}
+
+static int cmp_len(const void *a, const void *b) {
+    const field *x = a, *y = b;
+    return (int)strlen(x->name) - (int)strlen(y->name);
+}
+
+static void emit_source(const schema *s, const char *base, const char *header) {
+    const char *t = s->ctype, *U = s->upper;
+    field       sorted[MAX_ITEMS];
+
+    emit("/* generated by lclgen from %s. do not edit. */\n\n", base);
+    emit("#include \"%s\"\n", header);
+    emit("#include <stddef.h>\n#include <string.h>\n\n");
+    emit("static const char %s_key = 0;  // registry key of the cached base\n\n",
+         t);
+
+    // field ids
+    emit("enum {\n    %s_NONE_,\n", U);
+    for (int i = 0; i < s->nfields; i++)
+        emit("    %s_F_%s,\n", U, s->fields[i].name);
+    emit("};\n\n");
+
+    // field lookup, by length first
+    memcpy(sorted, s->fields, sizeof(field) * s->nfields);
+    qsort(sorted, s->nfields, sizeof(field), cmp_len);
+    emit("static int %s_field(const char *k, size_t len) {\n", t);
+    emit("    switch (len) {\n");
+    for (int i = 0; i < s->nfields;) {
+        size_t len = strlen(sorted[i].name);
+        emit("        case %zu:\n", len);
+        for (; i < s->nfields && strlen(sorted[i].name) == len; i++)
+            emit("            if (memcmp(k, \"%s\", %zu) == 0) return %s_F_%s;\n",
+                 sorted[i].name, len, U, sorted[i].name);
+        emit("            break;\n");
+    }
+    emit("    }\n    return 0;\n}\n\n");
+
+    // push and assign by id
+    emit("static void %s_push(lua_State *L, int idx, %s *self, int id) {\n", t, t);
+    emit("    switch (id) {\n");
+    for (int i = 0; i < s->nfields; i++) {
+        const field *f = &s->fields[i];
+        emit("        case %s_F_%s:\n            ", U, f->name);
+        switch (f->type) {
+            case T_NUMBER: emit("lua_pushnumber(L, self->%s);\n", f->name); break;
+            case T_INTEGER: emit("lua_pushinteger(L, self->%s);\n", f->name); break;
+            case T_BOOLEAN: emit("lua_pushboolean(L, self->%s);\n", f->name); break;
+            default:
+                emit("lua_getiuservalue(L, idx, ");
+                emit_uvbase(s);
+                emit(" + %d);\n", f->uv);
+        }
+        emit("            break;\n");
+    }
+    emit("    }\n    (void)idx;\n    (void)self;\n}\n\n");
+
+    emit("static void\n%s_assign(lua_State *L, int idx, %s *self, int id, int val) "
+         "{\n", t, t);
+    emit("    switch (id) {\n");
+    for (int i = 0; i < s->nfields; i++) {
+        const field *f = &s->fields[i];
+        emit("        case %s_F_%s:\n", U, f->name);
+        switch (f->type) {
+            case T_NUMBER:
+                emit("            self->%s = luaL_checknumber(L, val);\n", f->name);
+                break;
+            case T_INTEGER:
+                emit("            self->%s = luaL_checkinteger(L, val);\n", f->name);
+                break;
+            case T_BOOLEAN:
+                emit("            self->%s = lua_toboolean(L, val);\n", f->name);
+                break;
+            default:
+                if (f->type == T_STRING)
+                    emit("            if (!lua_isnil(L, val)) luaL_checkstring(L, "
+                         "val);\n");
+                emit("            lua_pushvalue(L, val);\n");
+                emit("            lua_setiuservalue(L, idx, ");
+                emit_uvbase(s);
+                emit(" + %d);\n", f->uv);
+        }
+        emit("            break;\n");
+    }
+    emit("    }\n    (void)idx;\n    (void)self;\n}\n\n");
+
+    // field access by name
+    emit("int %s_getfield(lua_State *L, int idx, const char *k, size_t len) {\n",
+         t);
+    emit("    int id = %s_field(k, len);\n", t);
+    emit("    if (id) {\n");
+    emit("        %s_push(L, idx, (%s *)lua_touserdata(L, idx), id);\n", t, t);
+    emit("        return 1;\n    }\n");
+    if (s->parent) emit("    return %s_getfield(L, idx, k, len);\n}\n\n", s->parent_ctype);
+    else emit("    return 0;\n}\n\n");
+
+    emit("int %s_setfield(\n    lua_State *L, int idx, const char *k, size_t "
+         "len, int val) {\n", t);
+    emit("    int id = %s_field(k, len);\n", t);
+    emit("    if (id) {\n");
+    emit("        %s_assign(L, idx, (%s *)lua_touserdata(L, idx), id, val);\n",
+         t, t);
+    emit("        return 1;\n    }\n");
+    if (s->parent)
+        emit("    return %s_setfield(L, idx, k, len, val);\n}\n\n", s->parent_ctype);
+    else emit("    return 0;\n}\n\n");
+
+    // serialization
+    emit("void %s_totable(lua_State *L, int idx) {\n", t);
+    emit("    idx = lua_absindex(L, idx);\n");
+    emit("    %s *self = (%s *)lua_touserdata(L, idx);\n", t, t);
+    if (s->parent) emit("    %s_totable(L, idx);\n", s->parent_ctype);
+    else emit("    lua_createtable(L, 0, %d);\n", s->nfields);
+    for (int i = 0; i < s->nfields; i++) {
+        emit("    %s_push(L, idx, self, %s_F_%s);\n", t, U, s->fields[i].name);
+        emit("    lua_setfield(L, -2, \"%s\");\n", s->fields[i].name);
+    }
+    emit("    (void)self;\n}\n\n");
+
+    emit("void %s_fromtable(lua_State *L, int idx, int t) {\n", t);
+    emit("    idx = lua_absindex(L, idx);\n");
+    emit("    t   = lua_absindex(L, t);\n");
+    emit("    %s *self = (%s *)lua_touserdata(L, idx);\n", t, t);
+    if (s->parent) emit("    %s_fromtable(L, idx, t);\n", s->parent_ctype);
+    for (int i = 0; i < s->nfields; i++) {
+        emit("    if (lua_getfield(L, t, \"%s\") != LUA_TNIL)\n", s->fields[i].name);
+        emit("        %s_assign(L, idx, self, %s_F_%s, lua_gettop(L));\n",
+             t, U, s->fields[i].name);
+        emit("    lua_pop(L, 1);\n");
+    }
+    emit("    (void)self;\n}\n\n");
+
+    // self check
+    emit("%s *%s_check(lua_State *L, int arg) {\n", t, t);
+    emit("    void *p = lua_touserdata(L, arg);\n\n");
+    emit("    // instances of this class have the cached base as their "
+         "metatable\n");
+    emit("    if (p && lua_getmetatable(L, arg)) {\n");
+    emit("        lua_rawgetp(L, LUA_REGISTRYINDEX, &%s_key);\n", t);
+    emit("        int exact = lua_rawequal(L, -1, -2);\n");
+    emit("        lua_pop(L, 2);\n");
+    emit("        if (exact) return (%s *)p;\n    }\n\n", t);
+    emit("    return (%s *)luaC_checkuclass(L, arg, \"%s%s%s\");\n}\n\n", t,
+         s->module ? s->module : "", s->module ? "." : "", s->name);
+
+    // metamethods
+    emit("static int %s_index(lua_State *L) {\n", t);
+    emit("    size_t len;\n");
+    emit("    if (lua_type(L, 2) == LUA_TSTRING && lua_isuserdata(L, 1)) {\n");
+    emit("        const char *k = lua_tolstring(L, 2, &len);\n");
+    emit("        if (%s_getfield(L, 1, k, len)) return 1;\n    }\n", t);
+    emit("    luaC_deferindex(L);\n    return 1;\n}\n\n");
+
+    emit("static int %s_newindex(lua_State *L) {\n", t);
+    emit("    size_t len;\n");
+    emit("    if (lua_type(L, 2) == LUA_TSTRING && lua_isuserdata(L, 1)) {\n");
+    emit("        const char *k = lua_tolstring(L, 2, &len);\n");
+    emit("        if (%s_setfield(L, 1, k, len, 3)) {\n", t);
+    if (s->dirty) emit("            luaC_markdirty(L, 1);\n");
+    emit("            return 0;\n        }\n    }\n");
+    emit("    luaC_defernewindex(L);\n    return 0;\n}\n\n");
+
+    // method wrappers
+    for (int i = 0; i < s->nmethods; i++)
+        emit("static int %s_m_%s(lua_State *L) {\n"
+             "    return %s_%s(L, %s_check(L, 1));\n}\n\n",
+             t, s->methods[i], t, s->methods[i], t);
+
+    emit("static int %s_m_new(lua_State *L) {\n", t);
+    if (s->init) emit("    return %s_new(L, %s_check(L, 1));\n}\n\n", t, t);
+    else
+        emit("    %s_check(L, 1);\n"
+             "    if (lua_istable(L, 2)) %s_fromtable(L, 1, 2);\n"
+             "    return 0;\n}\n\n", t, t);
+
+    emit("static int %s_m_totable(lua_State *L) {\n", t);
+    emit("    %s_check(L, 1);\n    %s_totable(L, 1);\n    return 1;\n}\n\n", t, t);
+
+    if (s->gc)
+        emit("static void %s_m_gc(lua_State *L, void *p) {\n"
+             "    %s_gc(L, (%s *)p);\n}\n\n", t, t, t);
+
+    emit("static luaL_Reg %s_methods[] = {\n", t);
+    emit("    {\"new\", %s_m_new},\n", t);
+    emit("    {\"totable\", %s_m_totable},\n", t);
+    for (int i = 0; i < s->nmethods; i++)
+        emit("    {\"%s\", %s_m_%s},\n", s->methods[i], t, s->methods[i]);
+    emit("    {NULL, NULL}\n};\n\n");
+
+    // field descriptors, so LCL can read and write fields without Lua code
+    emit("static const luaC_Field %s_fields[] = {\n", t);
+    for (int i = 0; i < s->nfields; i++) {
+        const field *f = &s->fields[i];
+        emit("    {\"%s\", %s, ", f->name, field_types[f->type]);
+        if (f->type >= T_STRING) {
+            emit_uvbase(s);
+            emit(" + %d},\n", f->uv);
+        } else emit("offsetof(%s, %s)},\n", t, f->name);
+    }
+    emit("    {NULL, 0, 0}\n};\n\n");
+
+    emit("luaC_Class %s_class = {\n", t);
+    emit("    .name      = \"%s\",\n", s->name);
+    if (s->parent) emit("    .parent    = \"%s\",\n", s->parent);
+    else emit("    .parent    = NULL,\n");
+    emit("    .user_ctor = 1,\n");
+    emit("    .alloc     = NULL,\n");
+    emit("    .gc        = %s%s,\n", s->gc ? t : "NULL", s->gc ? "_m_gc" : "");
+    emit("    .methods   = %s_methods,\n", t);
+    emit("    .flags     = LUAC_ZEROINIT%s,\n", s->dirty ? " | LUAC_TRACKDIRTY" : "");
+    emit("    .size      = sizeof(%s),\n", t);
+    emit("    .nuv       = %s_NUV,\n", U);
+    emit("    .fields    = %s_fields};\n\n", t);
+
+    // registration
+    emit("int %s_register(lua_State *L) {\n", t);
+    emit("    lua_pushlightuserdata(L, &%s_class);\n", t);
+    emit("    if (!luaC_classfromptr(L)) return 0;\n\n");
+    emit("    // install the field accessors once per class table\n");
+    emit("    lua_getfield(L, -1, \"__base\");\n");
+    emit("    lua_rawgetp(L, LUA_REGISTRYINDEX, &%s_key);\n", t);
+    emit("    int installed = lua_rawequal(L, -1, -2);\n");
+    emit("    lua_pop(L, 1);\n");
+    emit("    if (!installed) {\n");
+    emit("        lua_rawsetp(L, LUA_REGISTRYINDEX, &%s_key);\n", t);
+    emit("        luaC_injectindex(L, -1, %s_index);\n", t);
+    emit("        luaC_injectnewindex(L, -1, %s_newindex);\n", t);
+    emit("    } else lua_pop(L, 1);\n");
+    emit("    return 1;\n}\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <schema.lua> <out.h> <out.c>\n", argv[0]);
+        return 1;
+    }
+
+    schema_path   = argv[1];
+    lua_State *L  = luaL_newstate();
+    schema    *s  = malloc(sizeof(schema));
+    luaL_openlibs(L);
+    read_schema(L, s);
+
+    const char *header = strrchr(argv[2], '/');
+    const char *base   = strrchr(schema_path, '/');
+    header             = header ? header + 1 : argv[2];
+    base               = base ? base + 1 : schema_path;
+
+    if (!(out = fopen(argv[2], "w"))) fail("cannot write %s", argv[2]);
+    emit_header(s, base);
+    fclose(out);
+
+    if (!(out = fopen(argv[3], "w"))) fail("cannot write %s", argv[3]);
+    emit_source(s, base, header);
+    fclose(out);
+
+    free(s);
+    lua_close(L);
+    return 0;
+}